@@ -0,0 +1,55 @@
+# ----------------------------
+# Host benchmark of every phase of the pipeline, see src/bench/main.c
+#
+#   make -f bench.mk          builds bin/bench
+#   make -f bench.mk run      writes bench_output.txt
+#   make -f bench.mk counts   writes only the exact columns, for diffing
+#   make -f bench.mk check    diffs the counts and outputs against the baselines
+#   make -f bench.mk baseline writes new baselines, after a change meant to alter them
+#
+# The baselines were made on a 64 bit host, where pointers and the arena's alignment are
+# 8 bytes. Elsewhere only outputs.tsv is expected to match.
+# ----------------------------
+
+CC      ?= cc
+CFLAGS  ?= -O2
+LDLIBS  ?= -lm
+
+SRCDIR   ?= src
+OBJDIR   ?= obj/bench
+BINDIR   ?= bin
+BENCHOUT ?= bench_output.txt
+BASELINE ?= $(SRCDIR)/bench
+
+# everything but the pc front end, which has its own main
+SOURCES := $(wildcard $(SRCDIR)/*.c) $(SRCDIR)/bench/main.c
+OBJECTS := $(patsubst $(SRCDIR)/%.c,$(OBJDIR)/%.o,$(SOURCES))
+
+all: $(BINDIR)/bench
+
+$(BINDIR)/bench: $(OBJECTS)
+	@mkdir -p $(@D)
+	$(CC) $(CFLAGS) -o $@ $^ $(LDLIBS)
+
+$(OBJDIR)/%.o: $(SRCDIR)/%.c $(wildcard $(SRCDIR)/*.h)
+	@mkdir -p $(@D)
+	$(CC) $(CFLAGS) -DCOMPILE_PC -DCOMPILE_BENCH -c -o $@ $<
+
+run: $(BINDIR)/bench
+	$(BINDIR)/bench $(BENCHFLAGS) > $(BENCHOUT)
+
+counts: $(BINDIR)/bench
+	$(BINDIR)/bench --counts $(BENCHFLAGS) > $(BENCHOUT)
+
+check: $(BINDIR)/bench
+	$(BINDIR)/bench --counts | diff $(BASELINE)/counts.tsv -
+	$(BINDIR)/bench --outputs | diff $(BASELINE)/outputs.tsv -
+
+baseline: $(BINDIR)/bench
+	$(BINDIR)/bench --counts > $(BASELINE)/counts.tsv
+	$(BINDIR)/bench --outputs > $(BASELINE)/outputs.tsv
+
+clean:
+	rm -rf $(OBJDIR) $(BINDIR)/bench
+
+.PHONY: all run counts check baseline clean
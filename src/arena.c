@@ -0,0 +1,111 @@
+#include "arena.h"
+
+#include <stdlib.h>
+
+#define align(size) (((size) + ARENA_ALIGN - 1) / ARENA_ALIGN * ARENA_ALIGN)
+
+//the block header sits in front of its data
+#define BLOCK_HEADER align(sizeof(arena_block_t))
+#define block_data(block) ((uint8_t*)(block) + BLOCK_HEADER)
+
+//the most that can still be aligned and have a header put in front of it without wrapping
+#define ARENA_MAX_SIZE ((unsigned)-1 - BLOCK_HEADER - ARENA_ALIGN)
+
+void arena_Create(arena_t *a, unsigned block_size) {
+    a->head = a->current = a->tail = NULL;
+    a->block_size = block_size;
+    a->fixed = false;
+}
+
+bool arena_CreateFixed(arena_t *a, void *buffer, unsigned size) {
+    arena_block_t *block = buffer;
+
+    a->head = a->current = a->tail = NULL;
+    a->block_size = size;
+    a->fixed = true;
+
+    if (buffer == NULL || size <= BLOCK_HEADER)
+        return false;
+
+    block->next = NULL;
+    block->size = size - BLOCK_HEADER;
+    block->used = 0;
+
+    a->head = a->current = a->tail = block;
+
+    return true;
+}
+
+void arena_Cleanup(arena_t *a) {
+    arena_block_t *block = a->head;
+
+    //the buffer of a fixed arena belongs to whoever created it
+    if (!a->fixed) {
+        while (block != NULL) {
+            arena_block_t *next = block->next;
+            free(block);
+            block = next;
+        }
+    }
+
+    a->head = a->current = a->tail = NULL;
+}
+
+void *arena_Alloc(arena_t *a, unsigned size) {
+    arena_block_t *block;
+
+    if (size > ARENA_MAX_SIZE)
+        return NULL;
+
+    size = align(size);
+
+    //blocks before current are full, so only look from there on
+    for (block = a->current; block != NULL; block = block->next) {
+        if (block->size - block->used >= size) {
+            void *ret = block_data(block) + block->used;
+            block->used += size;
+            a->current = block;
+            return ret;
+        }
+    }
+
+    if (a->fixed)
+        return NULL;
+
+    block = malloc(BLOCK_HEADER + (size > a->block_size ? size : a->block_size));
+
+    if (block == NULL)
+        return NULL;
+
+    block->next = NULL;
+    block->size = size > a->block_size ? size : a->block_size;
+    block->used = size;
+
+    if (a->tail != NULL)
+        a->tail->next = block;
+    else
+        a->head = block;
+
+    a->tail = a->current = block;
+
+    return block_data(block);
+}
+
+void arena_Reset(arena_t *a) {
+    arena_block_t *block;
+
+    for (block = a->head; block != NULL; block = block->next)
+        block->used = 0;
+
+    a->current = a->head;
+}
+
+unsigned long arena_Used(arena_t *a) {
+    arena_block_t *block;
+    unsigned long used = 0;
+
+    for (block = a->head; block != NULL; block = block->next)
+        used += block->used;
+
+    return used;
+}
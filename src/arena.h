@@ -0,0 +1,51 @@
+#ifndef _ARENA_H_
+#define _ARENA_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+
+//Bump allocator that everything in one tokenize->parse->simplify->derivative->to_binary
+//request can allocate from. Nothing is freed individually, the whole request is released
+//at once with arena_Reset.
+
+//every allocation is rounded up to this so doubles and pointers stay aligned on host
+#ifdef __TICE__
+#define ARENA_ALIGN 1
+#else
+#define ARENA_ALIGN 8
+#endif
+
+//the default size of each block a growable arena mallocs
+#define ARENA_BLOCK_SIZE 16384
+
+typedef struct _ArenaBlock {
+    struct _ArenaBlock *next;
+    unsigned size;
+    unsigned used;
+} arena_block_t;
+
+typedef struct _Arena {
+    arena_block_t *head, *current, *tail;
+
+    unsigned block_size;
+
+    //fixed arenas live in one caller supplied buffer and never grow. used on the calculator
+    bool fixed;
+} arena_t;
+
+//growable arena that mallocs blocks of block_size (or bigger) as it fills up
+void arena_Create(arena_t *a, unsigned block_size);
+//fixed arena living entirely inside buffer. returns false if buffer is too small to be used
+bool arena_CreateFixed(arena_t *a, void *buffer, unsigned size);
+void arena_Cleanup(arena_t *a);
+
+//returns NULL when out of memory
+void *arena_Alloc(arena_t *a, unsigned size);
+
+//releases everything allocated so far but keeps the blocks around for the next request
+void arena_Reset(arena_t *a);
+
+//bytes handed out since the last reset
+unsigned long arena_Used(arena_t *a);
+
+#endif
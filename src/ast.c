@@ -1,79 +1,227 @@
 #include "ast.h"
 
-#include <stdlib.h> //for atof
+#include <stdlib.h> //for malloc, strtod
 #include <string.h> //for memcpy
 #include <stdio.h> //for sprintf
 
 #include "system.h"
+#include "stack.h"
+
+static THREAD_LOCAL arena_t *arena = NULL;
+
+#ifdef COMPILE_BENCH
+static THREAD_LOCAL unsigned long allocations = 0;
+
+unsigned long ast_Allocations(void) {
+    return allocations;
+}
+#endif
+
+void ast_UseArena(arena_t *a) {
+    arena = a;
+}
+
+arena_t *ast_GetArena(void) {
+    return arena;
+}
+
+void *ast_Alloc(unsigned size) {
+#ifdef COMPILE_BENCH
+    allocations++;
+#endif
+    if (arena != NULL)
+        return arena_Alloc(arena, size);
+    return malloc(size);
+}
+
+void ast_Free(void *ptr) {
+    //arena memory is only released all at once by arena_Reset
+    if (arena == NULL)
+        free(ptr);
+}
 
 double num_ToDouble(num_t num) {
-    char buffer[20] = { 0 };
+    return num.value;
+}
+
+//a mantissa of this many digits or less, and the power of 10 it's divided by, are exact in a
+//double, so one division rounds correctly
+#define NUM_EXACT_DIGITS 15
+
+//numbers short enough are handed to strtod without an allocation
+#define NUM_BUFFER_SIZE 32
+
+void num_Parse(num_t *num) {
+    double mantissa = 0, scale = 1;
+    bool negative = false, fraction = false;
+    uint16_t i, digits = 0;
+
+    num->integer = true;
+
+    for (i = 0; i < num->length; i++) {
+        char c = num_Char(*num, i);
+
+        if (c == '-' && i == 0) {
+            negative = true;
+        } else if (c == '.') {
+            //doesn't matter if . is at the end of the number
+            num->integer &= i == num->length - 1;
+            fraction = true;
+        } else if (c >= '0' && c <= '9') {
+            mantissa = mantissa * 10 + (c - '0');
+            digits++;
+            if (fraction)
+                scale *= 10;
+        }
+    }
 
-    memcpy(buffer, num.number, num.length);
-    return atof(buffer);
+    if (digits <= NUM_EXACT_DIGITS) {
+        num->value = negative ? -(mantissa / scale) : mantissa / scale;
+    } else {
+        char small[NUM_BUFFER_SIZE];
+        char *buffer = num->length < NUM_BUFFER_SIZE ? small : malloc(num->length + 1);
+
+        if (buffer == NULL) {
+            num->value = negative ? -(mantissa / scale) : mantissa / scale;
+            return;
+        }
+
+        for (i = 0; i < num->length; i++)
+            buffer[i] = num_Char(*num, i);
+        buffer[num->length] = 0;
+
+        num->value = strtod(buffer, NULL);
+
+        if (buffer != small)
+            free(buffer);
+    }
 }
+
 num_t num_Create(const char *number) {
     num_t ret;
+    char *text;
 
     ret.length = (uint16_t)strlen(number);
-    ret.number = malloc(ret.length);
+    ret.number = text = ast_Alloc(ret.length);
+    ret.owned = true;
 
-#ifdef __TICE__
-    memcpy(ret.number, number, ret.length);
+    if (text == NULL)
+        return ret;
+
+#ifdef _MSC_VER
+    memcpy_s(text, ret.length, number, ret.length);
 #else
-    memcpy_s(ret.number, ret.length, number, ret.length);
+    memcpy(text, number, ret.length);
 #endif
 
+    num_Parse(&ret);
+
     return ret;
 }
 
 num_t num_Copy(num_t num) {
+    num_t ret = num;
+    char *text = ast_Alloc(ret.length);
+
+    if (text != NULL)
+        memcpy(text, num.number, ret.length);
+
+    ret.number = text;
+    ret.owned = true;
+    return ret;
+}
+
+num_t num_Borrow(const uint8_t *text, uint16_t length) {
     num_t ret;
-    ret.length = num.length;
-    ret.number = malloc(ret.length);
-    memcpy(ret.number, num.number, ret.length);
+
+    ret.length = length;
+    ret.number = (const char*)text;
+    ret.owned = false;
+
+    num_Parse(&ret);
+
     return ret;
 }
 
-bool num_IsInteger(num_t num) {
+int num_Compare(num_t a, num_t b) {
     uint16_t i;
-    //doesn't matter if . is at the end of the number
-    for (i = 0; i < num.length - 1; i++) {
-        if (num.number[i] == '.')
-            return false;
+
+    if (a.length != b.length)
+        return a.length < b.length ? -1 : 1;
+
+    for (i = 0; i < a.length; i++) {
+        if (num_Char(a, i) != num_Char(b, i))
+            return num_Char(a, i) < num_Char(b, i) ? -1 : 1;
     }
-    return true;
+
+    return 0;
+}
+
+bool num_IsInteger(num_t num) {
+    return num.integer;
 }
 
 void num_Cleanup(num_t num) {
-    if(num.number != NULL) {
-        free(num.number);
+    if(num.owned && num.number != NULL) {
+        ast_Free((char*)num.number);
         num.number = NULL;
     }
 }
 
 ast_t *ast_MakeNumber(num_t num) {
-    ast_t *e = malloc(sizeof(ast_t));
+    ast_t *e;
+
+    if (num.number == NULL)
+        return NULL;
+
+    e = ast_Alloc(sizeof(ast_t));
+
+    if (e == NULL) {
+        num_Cleanup(num);
+        return NULL;
+    }
 
     e->type = NODE_NUMBER;
+    e->refs = 1;
+    e->simplified = false;
+    e->analyzed = false;
     e->op.number = num;
 
     return e;
 }
 
 ast_t *ast_MakeSymbol(uint8_t symbol) {
-    ast_t *e = malloc(sizeof(ast_t));
+    ast_t *e = ast_Alloc(sizeof(ast_t));
+
+    if (e == NULL)
+        return NULL;
 
     e->type = NODE_SYMBOL;
+    e->refs = 1;
+    e->simplified = false;
+    e->analyzed = false;
     e->op.symbol = symbol;
 
     return e;
 }
 
 ast_t *ast_MakeUnary(TokenType operator, ast_t *operand) {
-    ast_t *e = malloc(sizeof(ast_t));
+    ast_t *e;
+
+    if (operand == NULL)
+        return NULL;
+
+    e = ast_Alloc(sizeof(ast_t));
+
+    if (e == NULL) {
+        ast_Cleanup(operand);
+        return NULL;
+    }
 
     e->type = NODE_UNARY;
+    e->refs = 1;
+    e->simplified = false;
+    e->analyzed = false;
     e->op.unary.operator = operator;
     e->op.unary.operand = operand;
 
@@ -81,9 +229,26 @@ ast_t *ast_MakeUnary(TokenType operator, ast_t *operand) {
 }
 
 ast_t *ast_MakeBinary(TokenType operator, ast_t *left, ast_t *right) {
-    ast_t *e = malloc(sizeof(ast_t));
+    ast_t *e;
+
+    if (left == NULL || right == NULL) {
+        ast_Cleanup(left);
+        ast_Cleanup(right);
+        return NULL;
+    }
+
+    e = ast_Alloc(sizeof(ast_t));
+
+    if (e == NULL) {
+        ast_Cleanup(left);
+        ast_Cleanup(right);
+        return NULL;
+    }
 
     e->type = NODE_BINARY;
+    e->refs = 1;
+    e->simplified = false;
+    e->analyzed = false;
     e->op.binary.operator = operator;
     e->op.binary.left = left;
     e->op.binary.right = right;
@@ -92,63 +257,176 @@ ast_t *ast_MakeBinary(TokenType operator, ast_t *left, ast_t *right) {
 }
 
 ast_t *ast_Copy(ast_t *e) {
-    ast_t *ret;
-
     if (e == NULL) return NULL;
 
-    ret = malloc(sizeof(ast_t));
-
-    ret->type = e->type;
-
-    switch (ret->type) {
-    case NODE_NUMBER:
-        ret->op.number = num_Copy(e->op.number);
-        break;
-    case NODE_SYMBOL:
-        ret->op.symbol = e->op.symbol;
-        break;
-    case NODE_UNARY:
-        ret->op.unary.operator = e->op.unary.operator;
-        ret->op.unary.operand = ast_Copy(e->op.unary.operand);
-        break;
-    case NODE_BINARY:
-        ret->op.binary.operator = e->op.binary.operator;
-        ret->op.binary.left = ast_Copy(e->op.binary.left);
-        ret->op.binary.right = ast_Copy(e->op.binary.right);
-        break;
+    e->refs++;
+    return e;
+}
+
+unsigned ast_CountNodes(ast_t *e) {
+    stack_t pending;
+    unsigned nodes = 0;
+
+    stack_CreateOf(&pending, ast_t*);
+
+    //down the left side, coming back for the right sides afterwards
+    for (;;) {
+        switch (e->type) {
+        case NODE_UNARY:
+            nodes += 1;
+            e = e->op.unary.operand;
+            continue;
+        case NODE_BINARY:
+            nodes += 2;
+
+            //out of memory for the stack, count this side on the call stack instead
+            if (!stack_PushOf(&pending, ast_t*, &e->op.binary.right))
+                nodes += ast_CountNodes(e->op.binary.right);
+
+            e = e->op.binary.left;
+            continue;
+        default:
+            nodes += 1;
+            break;
+        }
+
+        if (stack_IsEmpty(&pending))
+            break;
+
+        e = *stack_PopOf(&pending, ast_t*);
     }
 
-    return ret;
+    stack_Cleanup(&pending);
+    return nodes;
 }
 
-unsigned ast_CountNodes(ast_t *e) {
-    switch (e->type) {
-    case NODE_NUMBER:
-    case NODE_SYMBOL:
-        return 1;
-    case NODE_UNARY:
-        return 1 + ast_CountNodes(e->op.unary.operand);
-    case NODE_BINARY:
-        return 2 + ast_CountNodes(e->op.binary.left) + ast_CountNodes(e->op.binary.right);
+//a pair of subtrees still to be compared
+typedef struct _Comparing {
+    ast_t *a, *b;
+} comparing_t;
+
+int ast_Compare(ast_t *a, ast_t *b) {
+    stack_t pending;
+    comparing_t right;
+    int order = 0;
+
+    stack_CreateOf(&pending, comparing_t);
+
+    //down the left sides, coming back for the right sides afterwards like ast_CountNodes
+    for (;;) {
+        if (a != b && a->type != b->type) {
+            order = a->type < b->type ? -1 : 1;
+            break;
+        }
+
+        if (a != b) {
+            switch (a->type) {
+            case NODE_NUMBER:
+                order = num_Compare(a->op.number, b->op.number);
+                break;
+            case NODE_SYMBOL:
+                order = (int)a->op.symbol - b->op.symbol;
+                break;
+            case NODE_UNARY:
+                if (a->op.unary.operator != b->op.unary.operator) {
+                    order = (int)a->op.unary.operator - b->op.unary.operator;
+                    break;
+                }
+
+                a = a->op.unary.operand;
+                b = b->op.unary.operand;
+                continue;
+            case NODE_BINARY:
+                if (a->op.binary.operator != b->op.binary.operator) {
+                    order = (int)a->op.binary.operator - b->op.binary.operator;
+                    break;
+                }
+
+                right.a = a->op.binary.right;
+                right.b = b->op.binary.right;
+
+                if (stack_PushOf(&pending, comparing_t, &right)) {
+                    a = a->op.binary.left;
+                    b = b->op.binary.left;
+                    continue;
+                }
+
+                //out of memory for the stack, compare the left side on the call stack instead
+                if ((order = ast_Compare(a->op.binary.left, b->op.binary.left)) != 0)
+                    break;
+
+                a = right.a;
+                b = right.b;
+                continue;
+            }
+
+            if (order != 0)
+                break;
+        }
+
+        if (stack_IsEmpty(&pending))
+            break;
+
+        right = *stack_PopOf(&pending, comparing_t);
+        a = right.a;
+        b = right.b;
     }
-    return 0;
+
+    stack_Cleanup(&pending);
+    return order;
 }
 
+//drops one reference to a child of a node being freed, giving it back if that was the last one
+#define release(e) (--(e)->refs > 0 ? NULL : (e))
+
 void ast_Cleanup(ast_t *e) {
-    if (e == NULL) return;
-
-    switch (e->type) {
-    case NODE_NUMBER:
-        num_Cleanup(e->op.number);
-        break;
-    case NODE_UNARY:
-        ast_Cleanup(e->op.unary.operand);
-        break;
-    case NODE_BINARY:
-        ast_Cleanup(e->op.binary.left);
-        ast_Cleanup(e->op.binary.right);
-        break;
+    ast_t *later = NULL;
+
+    //no need to walk the tree, arena_Reset releases it all at once
+    if (e == NULL || arena != NULL) return;
+
+    //still shared with another tree
+    if (--e->refs > 0) return;
+
+    //Nothing else can see a node once it's down to no references, so a binary node with both
+    //children to free is kept around to remember the right one in its own fields. That chains
+    //them into a list of subtrees left for later, so freeing takes no stack and no memory.
+    while (e != NULL) {
+        ast_t *next = NULL;
+
+        switch (e->type) {
+        case NODE_NUMBER:
+            num_Cleanup(e->op.number);
+            break;
+        case NODE_UNARY:
+            next = release(e->op.unary.operand);
+            break;
+        case NODE_BINARY: {
+            ast_t *left = release(e->op.binary.left);
+            ast_t *right = release(e->op.binary.right);
+
+            if (left != NULL && right != NULL) {
+                e->op.binary.left = right;
+                e->op.binary.right = later;
+                later = e;
+                e = left;
+                continue;
+            }
+
+            next = left != NULL ? left : right;
+            break;
+        }
+        }
+
+        ast_Free(e);
+
+        if (next == NULL && later != NULL) {
+            e = later;
+            later = later->op.binary.right;
+            next = e->op.binary.left;
+            ast_Free(e);
+        }
+
+        e = next;
     }
-
-    free(e);
 }
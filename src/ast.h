@@ -4,14 +4,53 @@
 #include <stdint.h>
 #include <stdbool.h>
 
+#include "arena.h"
+
+//Every node and number is allocated through these. When an arena is in use on the current
+//thread they come out of it and ast_Free does nothing, otherwise they are plain malloc/free.
+//Anything must be released under the same allocator it was made with.
+void ast_UseArena(arena_t *arena); //NULL goes back to malloc
+arena_t *ast_GetArena(void);
+
+void *ast_Alloc(unsigned size); //NULL when out of memory
+void ast_Free(void *ptr);
+
+#ifdef COMPILE_BENCH
+//how many times ast_Alloc has been called on this thread
+unsigned long ast_Allocations(void);
+#endif
+
+//the char code for . on calculators. numbers borrowed from an equation still have it in place of '.'
+#define CHAR_PERIOD 0x3A
+
 typedef struct _Num {
+    //the textual form, only needed again by to_binary. read it with num_Char
     uint16_t length;
-    char *number;
+    const char *number;
+
+    //parsed once when the number is made so evaluating never has to
+    double value;
+    bool integer;
+
+    //false when number points into memory someone else owns, like the equation it was parsed
+    //from, which then has to outlive the number. only owned numbers are freed by num_Cleanup
+    bool owned;
 } num_t;
 
 double num_ToDouble(num_t num);
 num_t num_Create(const char *number);
 num_t num_Copy(num_t num);
+//a number reading length bytes of text in place, without copying them
+num_t num_Borrow(const uint8_t *text, uint16_t length);
+
+//character i of the textual form, with the calculator's . read as '.'
+#define num_Char(num, i) ((num).number[i] == CHAR_PERIOD ? '.' : (num).number[i])
+
+//orders numbers by their text, so the same number borrowed or owned compares equal
+int num_Compare(num_t a, num_t b);
+
+//fills in value and integer from the textual form
+void num_Parse(num_t *num);
 
 bool num_IsInteger(num_t num);
 
@@ -27,7 +66,11 @@ typedef enum _Error {
     E_PARSE_UNMATCHED_CLOSE_PAR,
 
     E_DERIV_UNIMPLEMENTED,
-    E_DERIV_NOT_ALLOWED
+    E_DERIV_NOT_ALLOWED,
+
+    E_EVAL_UNBOUND,
+
+    E_MEMORY
 } Error;
 
 typedef enum _NodeType {
@@ -74,10 +117,25 @@ typedef enum _TokenType {
     TOK_ERROR
 } TokenType;
 
+//Nodes are immutable once made, so subtrees can be shared between trees instead of copied.
+//refs counts the trees holding on to a node, it is released when the last one lets go.
 typedef struct _Node {
 
     NodeType type;
 
+    unsigned refs;
+
+    //simplify_fixpoint has nothing left to do here
+    bool simplified;
+
+    //cached by analyze() in cas.c the first time it's asked about the node. since nodes
+    //never change, this stays valid for as long as the node lives
+    bool analyzed;
+    bool evaluable; //can_evaluate()
+    bool arithmetic; //nothing but constants and what poly_IsArithmetic allows, see poly.h
+    uint32_t symbols; //bitmask of the symbols below, see symbol_bit
+    double value; //evaluate() when evaluable
+
     union {
         //NODE_NUMBER
         num_t number;
@@ -101,15 +159,22 @@ typedef struct _Node {
 
 } ast_t;
 
+//These return NULL when out of memory, or when given a NULL operand (which is then released
+//along with the other operand) so allocation failures propagate up through nested calls.
 ast_t *ast_MakeNumber(num_t num);
 ast_t *ast_MakeSymbol(uint8_t symbol);
 ast_t *ast_MakeUnary(TokenType operator, ast_t *operand);
 ast_t *ast_MakeBinary(TokenType operator, ast_t *left, ast_t *right);
 
+//shares e instead of copying it, O(1)
 ast_t *ast_Copy(ast_t *e);
 
 unsigned ast_CountNodes(ast_t *e);
 
+//total order on trees, 0 only when they're identical
+int ast_Compare(ast_t *a, ast_t *b);
+
+//releases this reference to e, freeing it once nothing else shares it
 void ast_Cleanup(ast_t *e);
 
 //since 'e' uses an extension byte, we represent it as 0x01 in char symbol
@@ -0,0 +1,100 @@
+#include "batch.h"
+
+#include <string.h>
+#include <math.h>
+
+#include "cas.h"
+
+void scalar_unary(TokenType operator, double *dest, const double *x, unsigned n) {
+    unsigned i;
+    for (i = 0; i < n; i++)
+        dest[i] = evaluate_unary(operator, x[i]);
+}
+
+void scalar_binary(TokenType operator, double *dest, const double *left, const double *right, unsigned n) {
+    unsigned i;
+    for (i = 0; i < n; i++)
+        dest[i] = evaluate_binary(operator, left[i], right[i]);
+}
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__)) && !defined(__TICE__)
+
+//The kernels are written once with gcc vector extensions in batch_kernels.h and compiled
+//twice, for plain SSE2 (4 lanes split over 2 registers) and for AVX2 with FMA.
+//the vector helpers are always inlined, so they never cross an ABI boundary
+#pragma GCC diagnostic ignored "-Wpsabi"
+
+typedef double v4d __attribute__((vector_size(32)));
+typedef long long v4l __attribute__((vector_size(32)));
+
+#define BATCH_TARGET
+#define BATCH_SUFFIX sse2
+#include "batch_kernels.h"
+#undef BATCH_TARGET
+#undef BATCH_SUFFIX
+
+#define BATCH_TARGET __attribute__((target("avx2,fma")))
+#define BATCH_SUFFIX avx2
+#include "batch_kernels.h"
+#undef BATCH_TARGET
+#undef BATCH_SUFFIX
+
+typedef bool (*unary_kernel_t)(TokenType, double*, const double*, unsigned);
+typedef bool (*binary_kernel_t)(TokenType, double*, const double*, const double*, unsigned);
+
+static unary_kernel_t unary_kernel = NULL;
+static binary_kernel_t binary_kernel = NULL;
+static const char *kernels = "scalar";
+
+void pick_kernels(void) {
+    __builtin_cpu_init();
+
+    if (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma")) {
+        unary_kernel = unary_avx2;
+        binary_kernel = binary_avx2;
+        kernels = "avx2";
+    } else {
+        unary_kernel = unary_sse2;
+        binary_kernel = binary_sse2;
+        kernels = "sse2";
+    }
+}
+
+void batch_Unary(TokenType operator, double *dest, const double *x, unsigned n) {
+    if (unary_kernel == NULL)
+        pick_kernels();
+
+    //the kernels only do the operators worth vectorizing
+    if (!unary_kernel(operator, dest, x, n))
+        scalar_unary(operator, dest, x, n);
+}
+
+void batch_Binary(TokenType operator, double *dest, const double *left, const double *right, unsigned n) {
+    if (binary_kernel == NULL)
+        pick_kernels();
+
+    if (!binary_kernel(operator, dest, left, right, n))
+        scalar_binary(operator, dest, left, right, n);
+}
+
+const char *batch_Kernels(void) {
+    if (unary_kernel == NULL)
+        pick_kernels();
+    return kernels;
+}
+
+#else
+
+void batch_Unary(TokenType operator, double *dest, const double *x, unsigned n) {
+    scalar_unary(operator, dest, x, n);
+}
+
+void batch_Binary(TokenType operator, double *dest, const double *left, const double *right, unsigned n) {
+    scalar_binary(operator, dest, left, right, n);
+}
+
+const char *batch_Kernels(void) {
+    return "scalar";
+}
+
+#endif
@@ -0,0 +1,15 @@
+#ifndef _BATCH_H_
+#define _BATCH_H_
+
+#include "ast.h"
+
+//Applies a single operator across whole arrays, dest[i] = operator(x[i]). On x86 hosts this
+//uses AVX2 or SSE2 kernels picked at runtime, everywhere else it loops evaluate_unary and
+//evaluate_binary. The vector kernels agree with evaluate() to within a few ulps.
+void batch_Unary(TokenType operator, double *dest, const double *x, unsigned n);
+void batch_Binary(TokenType operator, double *dest, const double *left, const double *right, unsigned n);
+
+//which kernels are in use, "avx2", "sse2" or "scalar"
+const char *batch_Kernels(void);
+
+#endif
@@ -0,0 +1,290 @@
+//Vector kernels for batch.c, included once per instruction set with BATCH_TARGET and
+//BATCH_SUFFIX defined. Lanes a kernel can't handle accurately (huge arguments, negative
+//bases, nan) are redone with the scalar functions so results match evaluate().
+
+#define KERNEL_CAT(name, suffix) name##_##suffix
+#define KERNEL_NAME(name, suffix) KERNEL_CAT(name, suffix)
+#define K(name) KERNEL_NAME(name, BATCH_SUFFIX)
+
+#define INLINE static inline __attribute__((always_inline)) BATCH_TARGET
+
+INLINE v4d K(load)(const double *p) { v4d v; memcpy(&v, p, sizeof(v)); return v; }
+INLINE void K(store)(double *p, v4d v) { memcpy(p, &v, sizeof(v)); }
+INLINE v4d K(broadcast)(double x) { v4d v = { x, x, x, x }; return v; }
+INLINE v4d K(select)(v4l mask, v4d a, v4d b) { return (v4d)((mask & (v4l)a) | (~mask & (v4l)b)); }
+INLINE bool K(any)(v4l mask) { return (mask[0] | mask[1] | mask[2] | mask[3]) != 0; }
+//lanes outside [low, high], nan included
+INLINE v4l K(outside)(v4d x, double low, double high) { return ~((x >= low) & (x <= high)); }
+
+#define DBL_NORMAL_MIN 2.2250738585072014e-308
+#define DBL_LARGEST 1.7976931348623157e+308
+
+//rounds to the nearest integer, only valid for |x| < 2^51
+#define ROUND_MAGIC 6755399441055744.0
+INLINE v4d K(round)(v4d x) { return (x + ROUND_MAGIC) - ROUND_MAGIC; }
+INLINE v4l K(round_int)(v4d x) { v4d t = x + ROUND_MAGIC; return (v4l)t - (v4l)K(broadcast)(ROUND_MAGIC); }
+
+#define LN2_HI 6.93147180369123816490e-01
+#define LN2_LO 1.90821492927058770002e-10
+
+//e^x for -708 <= x <= 709
+INLINE v4d K(exp)(v4d x) {
+    v4d k = K(round)(x * 1.44269504088896338700e+00);
+    v4l ki = K(round_int)(x * 1.44269504088896338700e+00);
+    v4d r = x - k * LN2_HI - k * LN2_LO;
+    v4d p;
+
+    //taylor series, |r| <= ln(2)/2
+    p = K(broadcast)(1.0 / 6227020800.0);
+    p = p * r + 1.0 / 479001600.0;
+    p = p * r + 1.0 / 39916800.0;
+    p = p * r + 1.0 / 3628800.0;
+    p = p * r + 1.0 / 362880.0;
+    p = p * r + 1.0 / 40320.0;
+    p = p * r + 1.0 / 5040.0;
+    p = p * r + 1.0 / 720.0;
+    p = p * r + 1.0 / 120.0;
+    p = p * r + 1.0 / 24.0;
+    p = p * r + 1.0 / 6.0;
+    p = p * r + 0.5;
+    p = p * r + 1.0;
+    p = p * r + 1.0;
+
+    return p * (v4d)((ki + 1023) << 52);
+}
+
+//ln(x) for normal positive x
+INLINE v4d K(log)(v4d x) {
+    v4l bits = (v4l)x;
+    v4l e = ((bits >> 52) & 0x7FF) - 1023;
+    v4d m = (v4d)((bits & 0x000FFFFFFFFFFFFFLL) | 0x3FF0000000000000LL);
+    v4l big = m > 1.41421356237309504880;
+    v4d f, s, p, ed;
+
+    //keep m in [sqrt(1/2), sqrt(2)) so the series converges quickly
+    m = K(select)(big, m * 0.5, m);
+    e = e - big;
+
+    //ln(m) = 2 atanh(f)
+    f = (m - 1.0) / (m + 1.0);
+    s = f * f;
+
+    p = K(broadcast)(1.0 / 25.0);
+    p = p * s + 1.0 / 23.0;
+    p = p * s + 1.0 / 21.0;
+    p = p * s + 1.0 / 19.0;
+    p = p * s + 1.0 / 17.0;
+    p = p * s + 1.0 / 15.0;
+    p = p * s + 1.0 / 13.0;
+    p = p * s + 1.0 / 11.0;
+    p = p * s + 1.0 / 9.0;
+    p = p * s + 1.0 / 7.0;
+    p = p * s + 1.0 / 5.0;
+    p = p * s + 1.0 / 3.0;
+    p = p * s * f;
+
+    ed = __builtin_convertvector(e, v4d);
+    return ed * LN2_HI + ((2.0 * f + 2.0 * p) + ed * LN2_LO);
+}
+
+#define PIO2_1 1.57079632673412561417e+00
+#define PIO2_2 6.07710050630396597660e-11
+#define PIO2_3 2.02226624871116645580e-21
+#define PIO2_3T 8.47842766036889956997e-32
+
+//sin and cos together for |x| <= 1e5
+INLINE void K(sincos)(v4d x, v4d *sin_out, v4d *cos_out) {
+    v4d q = K(round)(x * 6.36619772367581382433e-01);
+    v4l qi = K(round_int)(x * 6.36619772367581382433e-01);
+    v4d r = ((x - q * PIO2_1) - q * PIO2_2) - q * PIO2_3 - q * PIO2_3T;
+    v4d r2 = r * r;
+    v4d s, c;
+    v4l swap, sin_negative, cos_negative;
+    v4l sign = (v4l)K(broadcast)(-0.0);
+
+    //taylor series, |r| <= pi/4
+    s = K(broadcast)(-1.0 / 1307674368000.0);
+    s = s * r2 + 1.0 / 6227020800.0;
+    s = s * r2 - 1.0 / 39916800.0;
+    s = s * r2 + 1.0 / 362880.0;
+    s = s * r2 - 1.0 / 5040.0;
+    s = s * r2 + 1.0 / 120.0;
+    s = s * r2 - 1.0 / 6.0;
+    s = r + s * r2 * r;
+
+    c = K(broadcast)(1.0 / 20922789888000.0);
+    c = c * r2 - 1.0 / 87178291200.0;
+    c = c * r2 + 1.0 / 479001600.0;
+    c = c * r2 - 1.0 / 3628800.0;
+    c = c * r2 + 1.0 / 40320.0;
+    c = c * r2 - 1.0 / 720.0;
+    c = c * r2 + 1.0 / 24.0;
+    c = c * r2 - 0.5;
+    c = 1.0 + c * r2;
+
+    //quadrants 1 and 3 swap sin and cos
+    swap = (qi & 1) != 0;
+    sin_negative = (qi & 2) != 0;
+    cos_negative = ((qi + 1) & 2) != 0;
+
+    *sin_out = (v4d)((v4l)K(select)(swap, c, s) ^ (sin_negative & sign));
+    *cos_out = (v4d)((v4l)K(select)(swap, s, c) ^ (cos_negative & sign));
+}
+
+//x^n for a whole number n by repeated squaring
+INLINE v4d K(ipow)(v4d x, int n) {
+    v4d result = K(broadcast)(1.0);
+    unsigned e = n < 0 ? -n : n;
+
+    while (e) {
+        if (e & 1)
+            result = result * x;
+        x = x * x;
+        e >>= 1;
+    }
+
+    return n < 0 ? 1.0 / result : result;
+}
+
+//redoes the lanes in fallback with the scalar functions
+INLINE void K(fix_unary)(v4l fallback, TokenType operator, double *dest, const double *x) {
+    unsigned lane;
+    for (lane = 0; lane < 4; lane++) {
+        if (fallback[lane])
+            dest[lane] = evaluate_unary(operator, x[lane]);
+    }
+}
+
+INLINE void K(fix_binary)(v4l fallback, TokenType operator, double *dest, const double *left, const double *right) {
+    unsigned lane;
+    for (lane = 0; lane < 4; lane++) {
+        if (fallback[lane])
+            dest[lane] = evaluate_binary(operator, left[lane], right[lane]);
+    }
+}
+
+BATCH_TARGET bool K(unary)(TokenType operator, double *dest, const double *src, unsigned n) {
+    unsigned i;
+
+    switch (operator) {
+    case TOK_NEGATE: case TOK_RECRIPROCAL: case TOK_SQUARE: case TOK_CUBE: case TOK_ABS:
+    case TOK_LN: case TOK_LOG: case TOK_E_TO_POWER: case TOK_10_TO_POWER:
+    case TOK_SIN: case TOK_COS: case TOK_TAN:
+        break;
+    default:
+        return false;
+    }
+
+    for (i = 0; i + 4 <= n; i += 4) {
+        v4d x = K(load)(src + i), result = x, s, c;
+        v4l fallback = x != x;
+
+        switch (operator) {
+        case TOK_NEGATE: result = -x; break;
+        case TOK_RECRIPROCAL: result = 1.0 / x; break;
+        case TOK_SQUARE: result = x * x; break;
+        case TOK_CUBE: result = x * x * x; break;
+        case TOK_ABS: result = (v4d)((v4l)x & ~(v4l)K(broadcast)(-0.0)); break;
+        case TOK_LN:
+        case TOK_LOG:
+            fallback |= K(outside)(x, DBL_NORMAL_MIN, DBL_LARGEST);
+            result = K(log)(x);
+            if (operator == TOK_LOG)
+                result = result / 2.30258509299404568402;
+            break;
+        case TOK_E_TO_POWER:
+        case TOK_10_TO_POWER:
+            if (operator == TOK_10_TO_POWER)
+                x = x * 2.30258509299404568402;
+            fallback |= K(outside)(x, -708.0, 709.0);
+            result = K(exp)(x);
+            break;
+        case TOK_SIN:
+        case TOK_COS:
+        case TOK_TAN:
+            fallback |= K(outside)(x, -1e5, 1e5);
+            K(sincos)(x, &s, &c);
+            result = operator == TOK_SIN ? s : operator == TOK_COS ? c : s / c;
+            break;
+        }
+
+        K(store)(dest + i, result);
+
+        if (K(any)(fallback))
+            K(fix_unary)(fallback, operator, dest + i, src + i);
+    }
+
+    //scalar tail
+    for (; i < n; i++)
+        dest[i] = evaluate_unary(operator, src[i]);
+
+    return true;
+}
+
+BATCH_TARGET bool K(binary)(TokenType operator, double *dest, const double *left, const double *right, unsigned n) {
+    unsigned i;
+    bool integer_power = false;
+    int exponent = 0;
+
+    switch (operator) {
+    case TOK_ADD: case TOK_SUBTRACT: case TOK_MULTIPLY: case TOK_DIVIDE: case TOK_FRACTION:
+    case TOK_LOG_BASE:
+        break;
+    case TOK_POWER:
+        //most powers are a constant whole number, like the x^2 out of derivative()
+        if (n > 0 && right[0] >= -64 && right[0] <= 64 && right[0] == (int)right[0]) {
+            integer_power = true;
+            exponent = (int)right[0];
+            for (i = 1; i < n && integer_power; i++)
+                integer_power = right[i] == right[0];
+        }
+        break;
+    default:
+        return false;
+    }
+
+    for (i = 0; i + 4 <= n; i += 4) {
+        v4d l = K(load)(left + i), r = K(load)(right + i), result = l;
+        v4l fallback = l != l;
+
+        switch (operator) {
+        case TOK_ADD: result = l + r; break;
+        case TOK_SUBTRACT: result = l - r; break;
+        case TOK_MULTIPLY: result = l * r; break;
+        case TOK_DIVIDE:
+        case TOK_FRACTION: result = l / r; break;
+        case TOK_POWER:
+            if (integer_power) {
+                result = K(ipow)(l, exponent);
+                fallback = fallback & 0;
+            } else {
+                //l^r = e^(r ln l), only for positive l
+                v4d product;
+                fallback |= (r != r) | K(outside)(l, DBL_NORMAL_MIN, DBL_LARGEST);
+                product = r * K(log)(l);
+                fallback |= K(outside)(product, -708.0, 709.0);
+                result = K(exp)(product);
+            }
+            break;
+        case TOK_LOG_BASE:
+            fallback |= K(outside)(l, DBL_NORMAL_MIN, DBL_LARGEST);
+            fallback |= K(outside)(r, DBL_NORMAL_MIN, DBL_LARGEST);
+            result = K(log)(l) / K(log)(r);
+            break;
+        }
+
+        K(store)(dest + i, result);
+
+        if (operator != TOK_ADD && operator != TOK_SUBTRACT && operator != TOK_MULTIPLY
+            && operator != TOK_DIVIDE && operator != TOK_FRACTION && K(any)(fallback))
+            K(fix_binary)(fallback, operator, dest + i, left + i, right + i);
+    }
+
+    for (; i < n; i++)
+        dest[i] = evaluate_binary(operator, left[i], right[i]);
+
+    return true;
+}
+
+#undef INLINE
+#undef K
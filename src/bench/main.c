@@ -0,0 +1,635 @@
+#ifdef COMPILE_BENCH
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <time.h>
+#endif
+
+#include "../parser.h"
+#include "../cas.h"
+
+//Times every phase of the pipeline on its own over a fixed corpus of equations, realistic ones
+//and ones made to be hard on the parser and the cas. Each phase gets a fresh input every
+//iteration, made outside of the timing, so nothing it measures is sitting in a node's cache
+//from the iteration before. Everything goes in one arena that's reset between iterations.
+//
+//The output is tab separated with a header, one line per case and phase, so two revisions can
+//be compared with diff or a spreadsheet. --counts leaves out the timings, which makes it exact.
+//--outputs instead writes what each case simplifies and differentiates to, over more cases.
+//Both are checked against the baselines next to this file by make -f bench.mk check.
+
+#define DEFAULT_BUDGET_MS 200
+#define MIN_ITERATIONS 5
+#define MAX_ITERATIONS 1000000
+
+#define EQUATION_MAX 16384
+
+typedef enum _Phase {
+    PHASE_TOKENIZE, PHASE_PARSE, PHASE_SIMPLIFY, PHASE_DERIVATIVE, PHASE_EVALUATE, PHASE_TO_BINARY,
+    AMOUNT_PHASES
+} Phase;
+
+const char *phase_names[AMOUNT_PHASES] = {
+    "tokenize", "parse", "simplify", "derivative", "evaluate", "to_binary"
+};
+
+//what the output column counts for each phase
+const char *phase_units[AMOUNT_PHASES] = {
+    "tokens", "nodes", "nodes", "nodes", "value", "bytes"
+};
+
+typedef struct _Case {
+    char name[32];
+    uint8_t *tokens;
+    unsigned length;
+} case_t;
+
+typedef struct _Result {
+    unsigned long iterations;
+    double ns;
+    double allocations;
+    double bytes;
+    double output;
+    Error error;
+} result_t;
+
+//equations are written in a small ascii shorthand and turned into tokens with identifiers[]:
+//lowercase letters are functions, which are written with their parenthesis like sin( is, ~ is
+//negate, p is pi and e is e. ' @ and ` are the reciprocal, square and cube after what they
+//apply to, | is the fraction bar, # is xroot and & is the E in 3E2. digits, '.' and the
+//uppercase variables are themselves
+TokenType shorthand_token(char c) {
+    switch (c) {
+    case '+': return TOK_ADD;
+    case '-': return TOK_SUBTRACT;
+    case '*': return TOK_MULTIPLY;
+    case '/': return TOK_DIVIDE;
+    case '^': return TOK_POWER;
+    case '~': return TOK_NEGATE;
+    case '(': return TOK_OPEN_PAR;
+    case ')': return TOK_CLOSE_PAR;
+    case ',': return TOK_COMMA;
+    case '\'': return TOK_RECRIPROCAL;
+    case '@': return TOK_SQUARE;
+    case '`': return TOK_CUBE;
+    case '|': return TOK_FRACTION;
+    case '#': return TOK_ROOT;
+    case '&': return TOK_SCIENTIFIC;
+    case 'b': return TOK_LOG_BASE;
+    case 'a': return TOK_ABS;
+    case 'q': return TOK_SQRT;
+    case 'u': return TOK_CUBED_ROOT;
+    case 'l': return TOK_LN;
+    case 'x': return TOK_E_TO_POWER;
+    case 'g': return TOK_LOG;
+    case 'j': return TOK_10_TO_POWER;
+    case 's': return TOK_SIN;
+    case 'c': return TOK_COS;
+    case 't': return TOK_TAN;
+    case 'h': return TOK_TANH;
+    case 'i': return TOK_SIN_INV;
+    case 'o': return TOK_COS_INV;
+    case 'n': return TOK_TAN_INV;
+    case 'y': return TOK_SINH;
+    case 'k': return TOK_SINH_INV;
+    case 'z': return TOK_COSH;
+    case 'v': return TOK_COSH_INV;
+    case 'w': return TOK_TANH_INV;
+    default: return TOK_ERROR;
+    }
+}
+
+//NULL if the shorthand has a character it doesn't know
+uint8_t *encode(const char *text, unsigned *length) {
+    uint8_t *tokens = malloc(strlen(text) * IDENTIFIER_MAX_BYTES + 1);
+    unsigned i = 0;
+
+    if (tokens == NULL)
+        return NULL;
+
+    for (; *text; text++) {
+        char c = *text;
+        TokenType type;
+
+        if ((c >= '0' && c <= '9') || (c >= 'A' && c <= 'Z')) {
+            tokens[i++] = (uint8_t)c;
+        } else if (c == '.') {
+            tokens[i++] = CHAR_PERIOD;
+        } else if (c == 'p') {
+            tokens[i++] = SYMBOL_PI;
+        } else if (c == 'e') {
+            tokens[i++] = 0xBB;
+            tokens[i++] = 0x31;
+        } else if ((type = shorthand_token(c)) != TOK_ERROR) {
+            memcpy(tokens + i, identifiers[type].bytes, identifiers[type].length);
+            i += identifiers[type].length;
+
+            //the function's token already opens it
+            if (c >= 'a' && c <= 'z' && text[1] == '(')
+                text++;
+        } else {
+            free(tokens);
+            return NULL;
+        }
+    }
+
+    *length = i;
+    return tokens;
+}
+
+//the generated cases are built up in here before they're encoded
+char text[EQUATION_MAX];
+
+#define append(...) (used += snprintf(text + used, sizeof(text) - used, __VA_ARGS__))
+
+//sin(sin(...sin(X)...))
+void make_deep_sin(unsigned depth) {
+    unsigned used = 0, i;
+
+    for (i = 0; i < depth; i++)
+        append("s(");
+    append("X");
+    for (i = 0; i < depth; i++)
+        append(")");
+}
+
+//every kind of function inside the next, with a little arithmetic at each level
+void make_deep_composition(unsigned depth) {
+    const char *functions = "sclqxah";
+    unsigned used = 0, i;
+
+    for (i = 0; i < depth; i++)
+        append("%c(%u*", functions[i % 7], i % 5 + 1);
+    append("X");
+    for (i = 0; i < depth; i++)
+        append("+1)");
+}
+
+//a polynomial with every power down to the constant and coefficients of all signs and sizes
+void make_long_polynomial(unsigned degree) {
+    unsigned used = 0, i;
+
+    for (i = degree; i > 0; i--)
+        append("%s%u.%u*X^%u", i == degree ? "" : i % 3 ? "+" : "-", i * 7 % 23 + 1, i % 10, i);
+    append("-17");
+}
+
+//((X^2)^3)^... and then X^(X^(...)), which derivative has to take the log of
+void make_nested_powers(unsigned depth) {
+    unsigned used = 0, i;
+
+    for (i = 0; i < depth; i++)
+        append("(");
+    append("X");
+    for (i = 0; i < depth; i++)
+        append("^%u)", i % 3 + 2);
+
+    append("+");
+
+    for (i = 0; i < depth; i++)
+        append("X^(");
+    append("X");
+    for (i = 0; i < depth; i++)
+        append(")");
+}
+
+//logBASE(X+1,2)+logBASE(X^2+2,3)+..., every one a different base
+void make_log_bases(unsigned amount) {
+    unsigned used = 0, i;
+
+    for (i = 0; i < amount; i++)
+        append("%sb(X^%u+%u,%u)", i ? "+" : "", i % 4 + 1, i + 1, i + 2);
+}
+
+//(X+1)(X-2)(X+3)..., which the product rule has to expand term by term
+void make_product_chain(unsigned amount) {
+    unsigned used = 0, i;
+
+    for (i = 0; i < amount; i++)
+        append("%s(X%c%u)", i ? "*" : "", i % 2 ? '-' : '+', i + 1);
+}
+
+//1/(1+1/(1+...1/(1+X)))
+void make_continued_fraction(unsigned depth) {
+    unsigned used = 0, i;
+
+    for (i = 0; i < depth; i++)
+        append("1/(1+");
+    append("X");
+    for (i = 0; i < depth; i++)
+        append(")");
+}
+
+//the same few terms over and over, which simplify has to gather back together
+void make_like_terms(unsigned amount) {
+    unsigned used = 0, i;
+
+    for (i = 0; i < amount; i++)
+        append("%s%u*s(X)^2*X", i ? "+" : "", i % 4 + 1);
+}
+
+bool add_case(case_t *cases, unsigned *amount, const char *name, const char *shorthand) {
+    case_t *c = &cases[*amount];
+
+    c->tokens = encode(shorthand, &c->length);
+    if (c->tokens == NULL) {
+        fprintf(stderr, "Bad shorthand for %s.\n", name);
+        return false;
+    }
+
+    snprintf(c->name, sizeof(c->name), "%s", name);
+    (*amount)++;
+    return true;
+}
+
+typedef struct _Generated {
+    const char *name;
+    void (*make)(unsigned);
+    unsigned size;
+} generated_t;
+
+//cases that look like what people actually put in Y1
+const char *realistic[][2] = {
+    {"pythagorean", "s(X)^2+c(X)^2"},
+    {"normal_pdf", "x(~X^2/2)/q(2*p)"},
+    {"cubic", "X^3-6*X^2+11*X-6"},
+    {"ln_quadratic", "l(X^2+1)"},
+    {"log_base", "b(X,10)"},
+    {"rational", "(2*X+1)/(X-3)"},
+    {"product_rule", "X*x(X)*s(X)"},
+    {"chain_rule", "s(c(t(X^2)))"},
+    {"quotient_trig", "t(X)/(1+c(X)^2)"},
+    {"decimals", "3.14159*X^2-0.5*X+2.71828"},
+    {"e_power", "e^(2*X)-e^(~X)"},
+    {"arcsin", "i(X/2)*q(4-X^2)"}
+};
+
+//small cases that each go through a rule or token, only checked with --outputs
+const char *regression[][2] = {
+    {"poly_plus_sin", "3X^2+s(X)"},
+    {"square_ln", "X@*l(X)"},
+    {"exp_quotient", "x(2X)/(X+1)"},
+    {"sqrt_square", "q(X@+1)"},
+    {"log_base_2", "b(X,2)"},
+    {"x_to_x", "X^X"},
+    {"constant", "5"},
+    {"variable", "X"},
+    {"negate", "~X"},
+    {"reciprocal", "X'"},
+    {"cube", "X`"},
+    {"cube_poly", "2X`+4X-7"},
+    {"cbrt", "u(X)"},
+    {"log", "g(X)"},
+    {"ten_power", "j(X)"},
+    {"asin", "i(X)"},
+    {"acos", "o(X)"},
+    {"tan", "t(X)"},
+    {"atan", "n(X)"},
+    {"sinh", "y(X)"},
+    {"cosh", "z(X)"},
+    {"asinh", "k(X)"},
+    {"acosh", "v(X)"},
+    {"tanh", "h(X)"},
+    {"atanh", "w(X)"},
+    {"abs", "a(X)"},
+    {"decimal_coefficient", "2.5X"},
+    {"scientific", "3&2X"},
+    {"root_of_x", "2#X"},
+    {"x_root", "X#2"},
+    {"nested_trig", "s(c(t(X)))"},
+    {"product_of_sums", "(X+1)(X-1)(X+2)"},
+    {"square_quotient", "X@/(X@+1)"},
+    {"exp_sin", "x(s(X))"},
+    {"ln_ln", "l(l(X))"},
+    {"fraction_bar", "X|2"},
+    {"other_variables", "AX+B"},
+    {"pi", "pX"},
+    {"e", "eX"},
+    {"half_power", "X^(1/2)"},
+    {"sin_squared", "s(X)^2"},
+    {"two_power", "2^X"},
+    {"constant_sum", "(3+4)X"},
+    {"constant_product", "(2*3)X^2"},
+    {"minus_zero", "X-0"},
+    {"zero_plus", "0+X"},
+    {"one_times", "1*X"},
+    {"power_one", "X^1"},
+    {"power_zero", "X^0"},
+    {"cubic_terms", "2X^3-3X^2+X-1"},
+    {"sin_5", "s(s(s(s(s(X)))))"},
+    {"repeated_factor", "X*X*X*X"},
+    {"binomial_cube", "(X+1)^3"},
+    {"exp_square", "x(X@)"},
+    {"ln_over_x", "l(X)/X"},
+    {"three_factors", "X@*s(X)*x(X)"},
+    {"big_coefficient", "12345678901X"},
+    {"decimal_square", "0.5X^2"},
+    {"log_base_e", "b(X,e)"},
+    {"decimal_sum", "0.1+0.2*X"},
+    {"long_decimal", "0.333333333333333333*X"},
+    {"fraction_sum", "1/4+X"},
+    {"repeating_decimal", "0.1/3*X"},
+    {"binomial_quotient", "1/(X+1)^5"},
+    {"exp_of_one", "x(X/X)"},
+    {"ln_exp_one", "l(x(1))*X"},
+    {"ten_power_one", "j(1)*X"}
+};
+
+//cases made to be slow, sized to stay within the parser's recursion
+generated_t adversarial[] = {
+    {"deep_sin_300", make_deep_sin, 300},
+    {"deep_composition_150", make_deep_composition, 150},
+    {"long_polynomial_60", make_long_polynomial, 60},
+    {"nested_powers_25", make_nested_powers, 25},
+    {"log_bases_50", make_log_bases, 50},
+    {"product_chain_30", make_product_chain, 30},
+    {"continued_fraction_60", make_continued_fraction, 60},
+    {"like_terms_80", make_like_terms, 80}
+};
+
+#define AMOUNT_REALISTIC (sizeof(realistic) / sizeof(realistic[0]))
+#define AMOUNT_ADVERSARIAL (sizeof(adversarial) / sizeof(adversarial[0]))
+#define AMOUNT_REGRESSION (sizeof(regression) / sizeof(regression[0]))
+
+#ifdef _WIN32
+double now_ns(void) {
+    static LARGE_INTEGER frequency;
+    LARGE_INTEGER counter;
+
+    if (frequency.QuadPart == 0)
+        QueryPerformanceFrequency(&frequency);
+
+    QueryPerformanceCounter(&counter);
+    return (double)counter.QuadPart * 1e9 / frequency.QuadPart;
+}
+#else
+double now_ns(void) {
+    struct timespec t;
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return t.tv_sec * 1e9 + t.tv_nsec;
+}
+#endif
+
+//what reading the clock twice costs, taken off every timing
+double timer_overhead;
+
+void measure_timer_overhead(void) {
+    double best = 1e9;
+    unsigned i;
+
+    for (i = 0; i < 1000; i++) {
+        double start = now_ns();
+        double took = now_ns() - start;
+
+        if (took < best)
+            best = took;
+    }
+
+    timer_overhead = best;
+}
+
+//makes whatever the phase starts from out of the case, through the phases before it
+Error prepare(const case_t *c, Phase phase, tokenizer_t *t, ast_t **input) {
+    Error error = E_SUCCESS;
+    ast_t *e;
+
+    *input = NULL;
+
+    if (phase == PHASE_TOKENIZE)
+        return E_SUCCESS;
+
+    if ((error = tokenize(t, c->tokens, c->length)) != E_SUCCESS)
+        return error;
+
+    if (phase == PHASE_PARSE)
+        return E_SUCCESS;
+
+    e = parse(t, &error);
+    if (e == NULL)
+        return error != E_SUCCESS ? error : E_PARSE_BAD_OPERATOR;
+
+    //to_binary writes what would go in Y2, the simplified derivative
+    if (phase == PHASE_TO_BINARY) {
+        e = derivative(e, 'X', &error);
+        if (e == NULL)
+            return error != E_SUCCESS ? error : E_DERIV_UNIMPLEMENTED;
+
+        e = simplify_fixpoint(e, NULL);
+        if (e == NULL)
+            return E_MEMORY;
+    }
+
+    *input = e;
+    return E_SUCCESS;
+}
+
+//runs the phase once on input and returns what goes in the output column
+double run(const case_t *c, Phase phase, tokenizer_t *t, ast_t *input, Error *error) {
+    ast_t *e;
+    unsigned size;
+
+    *error = E_SUCCESS;
+
+    switch (phase) {
+    case PHASE_TOKENIZE:
+        *error = tokenize(t, c->tokens, c->length);
+        return *error == E_SUCCESS ? t->amount : 0;
+    case PHASE_PARSE:
+        e = parse(t, error);
+        if (e == NULL && *error == E_SUCCESS)
+            *error = E_PARSE_BAD_OPERATOR;
+        return e != NULL ? ast_CountNodes(e) : 0;
+    case PHASE_SIMPLIFY:
+        e = simplify_fixpoint(input, NULL);
+        if (e == NULL)
+            *error = E_MEMORY;
+        return e != NULL ? ast_CountNodes(e) : 0;
+    case PHASE_DERIVATIVE:
+        e = derivative(input, 'X', error);
+        if (e == NULL && *error == E_SUCCESS)
+            *error = E_DERIV_UNIMPLEMENTED;
+        return e != NULL ? ast_CountNodes(e) : 0;
+    case PHASE_EVALUATE:
+        return evaluate(input);
+    case PHASE_TO_BINARY:
+        return to_binary(input, &size, error) != NULL ? size : 0;
+    default:
+        return 0;
+    }
+}
+
+//iterates until the budget is spent, at least MIN_ITERATIONS times
+void measure(arena_t *arena, const case_t *c, Phase phase, double budget_ns, result_t *r) {
+    double started = now_ns(), ns = 0, allocations = 0, bytes = 0;
+    unsigned long i;
+
+    r->error = E_SUCCESS;
+    r->output = 0;
+
+    for (i = 0; i < MAX_ITERATIONS && (i < MIN_ITERATIONS || now_ns() - started < budget_ns); i++) {
+        tokenizer_t t;
+        ast_t *input;
+        unsigned long allocations_before, bytes_before;
+        double start, took;
+
+        arena_Reset(arena);
+
+        r->error = prepare(c, phase, &t, &input);
+        if (r->error != E_SUCCESS)
+            break;
+
+        allocations_before = ast_Allocations();
+        bytes_before = arena_Used(arena);
+
+        start = now_ns();
+        r->output = run(c, phase, &t, input, &r->error);
+        took = now_ns() - start - timer_overhead;
+
+        ns += took > 0 ? took : 0;
+        allocations += ast_Allocations() - allocations_before;
+        bytes += arena_Used(arena) - bytes_before;
+
+        if (r->error != E_SUCCESS)
+            break;
+    }
+
+    r->iterations = i;
+    r->ns = i ? ns / i : 0;
+    r->allocations = i ? allocations / i : 0;
+    r->bytes = i ? bytes / i : 0;
+}
+
+//the tokens of e as hex, or the error that stopped it
+void print_tokens(ast_t *e, Error error) {
+    uint8_t *tokens = NULL;
+    unsigned size, i;
+
+    if (error == E_SUCCESS && e == NULL)
+        error = E_MEMORY;
+
+    if (error == E_SUCCESS)
+        tokens = to_binary(e, &size, &error);
+
+    if (tokens == NULL) {
+        printf("\terror %i", error);
+        return;
+    }
+
+    putchar('\t');
+    for (i = 0; i < size; i++)
+        printf("%02X", tokens[i]);
+}
+
+//what the case puts in Y1 after simplifying and what goes in Y2, unlike the counts this
+//changes with any change to the output
+void print_outputs(arena_t *arena, const case_t *c) {
+    tokenizer_t t;
+    ast_t *e;
+    Error error;
+
+    printf("%s", c->name);
+
+    arena_Reset(arena);
+    error = prepare(c, PHASE_SIMPLIFY, &t, &e);
+    print_tokens(error == E_SUCCESS ? simplify_fixpoint(e, NULL) : NULL, error);
+
+    arena_Reset(arena);
+    error = prepare(c, PHASE_TO_BINARY, &t, &e);
+    print_tokens(e, error);
+
+    putchar('\n');
+}
+
+int main(int argc, const char **argv) {
+    static case_t cases[AMOUNT_REALISTIC + AMOUNT_ADVERSARIAL + AMOUNT_REGRESSION];
+    unsigned amount_cases = 0, i;
+    const char *filter = NULL;
+    double budget_ms = DEFAULT_BUDGET_MS;
+    bool counts_only = false, outputs = false;
+    arena_t arena;
+
+    for (i = 1; i < (unsigned)argc; i++) {
+        if (!strcmp(argv[i], "--filter") && i + 1 < (unsigned)argc) {
+            filter = argv[++i];
+        } else if (!strcmp(argv[i], "--ms") && i + 1 < (unsigned)argc) {
+            budget_ms = atof(argv[++i]);
+        } else if (!strcmp(argv[i], "--counts")) {
+            counts_only = true;
+        } else if (!strcmp(argv[i], "--outputs")) {
+            outputs = true;
+        } else {
+            printf("Usage: bench [--filter substring] [--ms per phase] [--counts] [--outputs]\n");
+            return -1;
+        }
+    }
+
+    for (i = 0; i < AMOUNT_REALISTIC; i++) {
+        if (!add_case(cases, &amount_cases, realistic[i][0], realistic[i][1]))
+            return -1;
+    }
+
+    //what the adversarial cases write out is far too long to keep a baseline of
+    for (i = 0; !outputs && i < AMOUNT_ADVERSARIAL; i++) {
+        adversarial[i].make(adversarial[i].size);
+        if (!add_case(cases, &amount_cases, adversarial[i].name, text))
+            return -1;
+    }
+
+    for (i = 0; outputs && i < AMOUNT_REGRESSION; i++) {
+        if (!add_case(cases, &amount_cases, regression[i][0], regression[i][1]))
+            return -1;
+    }
+
+    measure_timer_overhead();
+
+    arena_Create(&arena, ARENA_BLOCK_SIZE);
+    ast_UseArena(&arena);
+
+    if (outputs)
+        printf("case\tsimplified\tderivative\n");
+    else if (counts_only)
+        printf("case\tphase\tallocs_per_op\tbytes_per_op\toutput\tunit\terror\n");
+    else
+        printf("case\tphase\titerations\tns_per_op\tallocs_per_op\tbytes_per_op\toutput\tunit\terror\n");
+
+    for (i = 0; i < amount_cases; i++) {
+        const case_t *c = &cases[i];
+        Phase phase;
+
+        if (filter != NULL && strstr(c->name, filter) == NULL)
+            continue;
+
+        if (outputs) {
+            print_outputs(&arena, c);
+            continue;
+        }
+
+        for (phase = 0; phase < AMOUNT_PHASES; phase++) {
+            result_t r;
+
+            measure(&arena, c, phase, counts_only ? 0 : budget_ms * 1e6, &r);
+
+            printf("%s\t%s\t", c->name, phase_names[phase]);
+            if (!counts_only)
+                printf("%lu\t%.1f\t", r.iterations, r.ns);
+            printf("%.1f\t%.1f\t%.17g\t%s\t%i\n", r.allocations, r.bytes, r.output, phase_units[phase], r.error);
+
+            fflush(stdout);
+        }
+    }
+
+    ast_UseArena(NULL);
+    arena_Cleanup(&arena);
+
+    for (i = 0; i < amount_cases; i++)
+        free(cases[i].tokens);
+
+    return 0;
+}
+
+#endif
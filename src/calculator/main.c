@@ -17,41 +17,37 @@
 #include "../parser.h"
 #include "../cas.h"
 
-#define SIMPLIFY_ITERATIONS 10
+//the whole calculation is allocated out of one fixed block that is released at
+//once when we're done. the heap is only about 60k, so leave some room for the rest
+#define ARENA_SIZE 40000
 
 void printText(int8_t xpos, int8_t ypos, const char *text);
 
-ast_t *simplify_amount(ast_t *e, unsigned amount) {
-	unsigned i;
-
-	if(amount == 0)
-		return ast_Copy(e);
-
-	e = simplify(e);
-
-	for(i = 0; i < amount - 1; i++) {
-		ast_t *temp = simplify(e);
-		free(e);
-		e = temp;
-	}
-
-	return e;
-}
-
 void main(void) {
     ti_var_t y1, y2;
 
     uint8_t *data;
     uint16_t size;
 
+    void *arena_memory;
+    arena_t arena;
+
     os_ClrHome();
     ti_CloseAll();
 
+    arena_memory = malloc(ARENA_SIZE);
+
+    if(!arena_CreateFixed(&arena, arena_memory, ARENA_SIZE)) {
+    	printText(0, 2, "Out of memory.");
+    	goto err;
+    }
+
+    ast_UseArena(&arena);
+
     y1 = ti_OpenVar(ti_Y1, "r", TI_EQU_TYPE);
 
     if(y1) {
     	Error error;
-    	tokenizer_t t;
     	ast_t *e, *simplified, *deriv, *simplified_deriv;
 
     	uint8_t *deriv_data;
@@ -61,52 +57,73 @@ void main(void) {
 
 		printText(0, 2, "Calculating...");
 
+    	//the numbers parsed from data point straight into it. nothing here creates or resizes a
+    	//variable until after to_binary, so Y1 doesn't move while they're in use
     	data = ti_GetDataPtr(y1);
     	size = ti_GetSize(y1);
 
-    	error = tokenize(&t, data, size);
+    	e = parse_equation(data, size, &error);
 
     	ti_Close(y1);
-    	
-    	e = parse(&t, &error);
+
+    	if(error == E_MEMORY) {
+    		printText(0, 3, "Out of memory.");
+    		goto err;
+    	}
 
     	if(error != E_SUCCESS) {
     		printText(0, 3, "Error parsing: syntax error.");
     		goto err;
     	}
 
-    	simplified = simplify_amount(e, SIMPLIFY_ITERATIONS);
+    	//nothing in Y1 parses to no tree without an error
+    	if(e == NULL) {
+    		printText(0, 3, "Y1 is empty.");
+    		goto err;
+    	}
+
+    	simplified = simplify_fixpoint(e, NULL);
     	ast_Cleanup(e); //to save on some space
 
     	deriv = derivative(simplified, 'X', &error);
     	ast_Cleanup(simplified);
 
+    	if(error == E_MEMORY) {
+    		printText(0, 3, "Out of memory.");
+    		goto err;
+    	}
+
     	if(error != E_SUCCESS) {
     		printText(0, 3, "Error calculating derivative.");
     		goto err;
     	}
 
-    	simplified_deriv = 
-    	simplify_amount(deriv, SIMPLIFY_ITERATIONS);
+    	simplified_deriv = simplify_fixpoint(deriv, NULL);
     	ast_Cleanup(deriv);
     	//deriv;
 
     	deriv_data = to_binary(simplified_deriv, &deriv_data_size, &error);
     	ast_Cleanup(simplified_deriv);
 
+    	if(simplified_deriv == NULL || error != E_SUCCESS) {
+    		printText(0, 3, "Out of memory.");
+    		goto err;
+    	}
+
     	y2 = ti_OpenVar(ti_Y2, "w", TI_EQU_TYPE);
     	ti_Write(deriv_data, deriv_data_size, 1, y2);
 
     	ti_Close(y2);
 
-    	free(deriv_data);
-
     } else {
     	printText(0, 2, "Couldn't open equation.");
     }
 
     printText(0, 3, "Done.");
 err:
+    ast_UseArena(NULL);
+    free(arena_memory);
+
     while(!os_GetCSC());
     //TODO:
 	//_YEquOnOff                 equ 0021044h
@@ -4,37 +4,141 @@
 
 #include "cas.h"
 
-#include <stdio.h>
 #include <stdlib.h>
 #include <math.h>
 
 #include "system.h"
+#include "stack.h"
+#include "rational.h"
+#include "nary.h"
+#include "poly.h"
+
+uint32_t symbol_bit(uint8_t symbol) {
+    int slot = env_Slot(symbol);
+
+    if (slot >= 0) return (uint32_t)1 << slot;
+    if (symbol == SYMBOL_E) return SYMBOL_BIT_E;
+    if (symbol == SYMBOL_PI) return SYMBOL_BIT_PI;
+    return SYMBOL_BIT_OTHER;
+}
 
-//expression does not contain symbol
-bool is_constant(ast_t *e, uint8_t symbol) {
+//fills in e from children that are analyzed already
+void analyze_node(ast_t *e) {
     switch (e->type) {
     case NODE_NUMBER:
-        return true;
+        e->symbols = 0;
+        e->evaluable = e->op.number.length < 16;
+        e->value = e->op.number.value;
+        e->arithmetic = true;
+        break;
     case NODE_SYMBOL:
-        return symbol != 0 && e->op.symbol != symbol;
-    case NODE_UNARY:
-        return is_constant(e->op.unary.operand, symbol);
-    case NODE_BINARY:
-        return is_constant(e->op.binary.left, symbol) && is_constant(e->op.binary.right, symbol);
+        e->symbols = symbol_bit(e->op.symbol);
+        e->evaluable = false;
+        e->arithmetic = true;
+        break;
+    case NODE_UNARY: {
+        ast_t *op = e->op.unary.operand;
+
+        e->symbols = op->symbols;
+        e->evaluable = op->evaluable;
+        e->arithmetic = e->symbols == 0 || (op->arithmetic && poly_IsArithmetic(e->op.unary.operator));
+        if (e->evaluable)
+            e->value = evaluate_unary(e->op.unary.operator, op->value);
+        break;
+    } case NODE_BINARY: {
+        ast_t *left = e->op.binary.left, *right = e->op.binary.right;
+
+        e->symbols = left->symbols | right->symbols;
+        e->evaluable = left->evaluable && right->evaluable;
+        //only the base of a power has to be a polynomial
+        e->arithmetic = e->symbols == 0 || (left->arithmetic && poly_IsArithmetic(e->op.binary.operator)
+            && (right->arithmetic || e->op.binary.operator == TOK_POWER));
+        if (e->evaluable)
+            e->value = evaluate_binary(e->op.binary.operator, left->value, right->value);
+        break;
     }
-    return false;
+    }
+
+    e->analyzed = true;
+}
+
+//the first child of e still to be analyzed, NULL once they all are
+#define unanalyzed_child(e) ((e)->type == NODE_UNARY ? ((e)->op.unary.operand->analyzed ? NULL : (e)->op.unary.operand) \
+    : (e)->type != NODE_BINARY ? NULL \
+    : !(e)->op.binary.left->analyzed ? (e)->op.binary.left \
+    : !(e)->op.binary.right->analyzed ? (e)->op.binary.right : NULL)
+
+void analyze(ast_t *e) {
+    stack_t parents;
+
+    if (e->analyzed)
+        return;
+
+    stack_CreateOf(&parents, ast_t*);
+
+    //the parents of e wait on the stack until everything below them is done
+    for (;;) {
+        ast_t *child = unanalyzed_child(e);
+
+        if (child != NULL) {
+            if (stack_PushOf(&parents, ast_t*, &e))
+                e = child;
+            else
+                analyze(child); //out of memory for the stack, use the call stack for this one
+            continue;
+        }
+
+        analyze_node(e);
+
+        if (stack_IsEmpty(&parents))
+            break;
+
+        e = *stack_PopOf(&parents, ast_t*);
+    }
+
+    stack_Cleanup(&parents);
+}
+
+//expression does not contain symbol, or any symbol at all for 0
+bool is_constant(ast_t *e, uint8_t symbol) {
+    analyze(e);
+    return symbol == 0 ? e->symbols == 0 : !(e->symbols & symbol_bit(symbol));
+}
+
+//only allocates the number when it's actually used
+ast_t *make_number(const char *number) {
+    num_t num = num_Create(number);
+    return ast_MakeNumber(num);
 }
 
 bool can_evaluate(ast_t *e);
-#define is_val(ast, val) (can_evaluate(ast) && evaluate(ast) == val)
+#define is_val(ast, val) (can_evaluate(ast) && ast->value == val)
 
-ast_t *simplify(ast_t *e) {
-    ast_t *simplified = NULL, *target, *ret;
+//an operator on nothing but exact numbers becomes a single reduced number or fraction
+ast_t *fold_rational(ast_t *e) {
+    rational_t r;
+
+    if (e->type == NODE_NUMBER || !is_constant(e, 0))
+        return NULL;
+
+    if (!rational_FromAst(e, &r) || !rational_IsWritable(&r) || rational_IsCanonical(e, &r))
+        return NULL;
+
+    return rational_ToAst(&r);
+}
+
+//applies the rules to e itself, returns NULL if none of them fire
+ast_t *simplify_node(ast_t *e) {
+    ast_t *simplified = fold_rational(e);
+
+    if (simplified != NULL)
+        return simplified;
+
+    //sums and products are handled as a whole
+    simplified = nary_Simplify(e);
 
-    num_t num_value_0, num_value_1, num_value_10;
-    num_value_0 = num_Create("0");
-    num_value_1 = num_Create("1");
-    num_value_10 = num_Create("10");
+    if (simplified != NULL)
+        return simplified;
 
     switch (e->type) {
     case NODE_NUMBER:
@@ -46,56 +150,57 @@ ast_t *simplify(ast_t *e) {
         switch (e->op.unary.operator) {
         case TOK_NEGATE:
             if (is_val(op, 0))
-                simplified = ast_MakeNumber(num_value_0);
+                simplified = make_number("0");
             break;
         case TOK_RECRIPROCAL:
             //TODO: trig identities
             if (is_val(op, 1))
-                simplified = ast_MakeNumber(num_value_1);
+                simplified = make_number("1");
             break;
         case TOK_SQUARE:
             if (is_val(op, 0))
-                simplified = ast_MakeNumber(num_value_0);
+                simplified = make_number("0");
             break;
         case TOK_CUBE:
             if (is_val(op, 0))
-                simplified = ast_MakeNumber(num_value_0);
+                simplified = make_number("0");
             break;
         case TOK_INT:
         case TOK_ABS:
             break;
         case TOK_SQRT:
             if (is_val(op, 0))
-                simplified = ast_MakeNumber(num_value_0);
+                simplified = make_number("0");
             break;
         case TOK_CUBED_ROOT:
             if (is_val(op, 0))
-                simplified = ast_MakeNumber(num_value_0);
+                simplified = make_number("0");
             break;
         case TOK_LN:
             if (is_val(op, M_E))
-                simplified = ast_MakeNumber(num_value_1);
+                simplified = make_number("1");
             break;
         case TOK_E_TO_POWER:
             if (is_val(op, 0))
-                simplified = ast_MakeNumber(num_value_1);
+                simplified = make_number("1");
             else if (is_val(op, 1))
-                simplified = ast_Copy(op);
+                simplified = ast_MakeSymbol(SYMBOL_E);
             break;
         case TOK_LOG:
             if (is_val(op, 1))
-                simplified = ast_MakeNumber(num_value_0);
+                simplified = make_number("0");
             else if (is_val(op, 10))
-                simplified = ast_MakeNumber(num_value_1);
+                simplified = make_number("1");
             break;
         case TOK_10_TO_POWER:
             if (is_val(op, 0))
-                simplified = ast_MakeNumber(num_value_1);
+                simplified = make_number("1");
             else if (is_val(op, 1))
-                simplified = ast_Copy(op);
-            simplified = ast_MakeBinary(TOK_POWER,
-                ast_MakeNumber(num_value_10),
-                ast_Copy(op));
+                simplified = make_number("10");
+            else
+                simplified = ast_MakeBinary(TOK_POWER,
+                    make_number("10"),
+                    ast_Copy(op));
             break;
 
         //TODO: pi
@@ -125,68 +230,37 @@ ast_t *simplify(ast_t *e) {
                 simplified = ast_Copy(right);
             else if (is_val(right, 0))
                 simplified = ast_Copy(left);
-            else if(left->type == NODE_NUMBER && right->type == NODE_NUMBER
-                && num_IsInteger(left->op.number) && num_IsInteger(right->op.number)
-                && left->op.number.length <= 10 && right->op.number.length <= 10) {
-                char buffer[50];
-                num_t num;
-                int result = (int)evaluate(e);
-                sprintf(buffer, "%d", result);
-                num = num_Create(buffer);
-                simplified = ast_MakeNumber(num);
-            }
             break;
         case TOK_SUBTRACT:
             if (is_val(left, 0))
                 simplified = ast_MakeUnary(TOK_NEGATE, ast_Copy(right));
             else if (is_val(right, 0))
                 simplified = ast_Copy(left);
-            else if(left->type == NODE_NUMBER && right->type == NODE_NUMBER
-                && num_IsInteger(left->op.number) && num_IsInteger(right->op.number)
-                && left->op.number.length <= 10 && right->op.number.length <= 10) {
-                char buffer[50];
-                num_t num;
-                int result = (int)evaluate(e);
-                sprintf(buffer, "%d", result);
-                num = num_Create(buffer);
-                simplified = ast_MakeNumber(num);
-            }
             break;
         case TOK_MULTIPLY:
             if (is_val(left, 0) || is_val(right, 0))
-                simplified = ast_MakeNumber(num_value_0);
+                simplified = make_number("0");
             else if(is_val(left, 1))
                 simplified = ast_Copy(right);
             else if(is_val(right, 1))
                 simplified = ast_Copy(left);
-            else if(left->type == NODE_NUMBER && right->type == NODE_NUMBER
-                && num_IsInteger(left->op.number) && num_IsInteger(right->op.number)
-                && left->op.number.length <= 10 && right->op.number.length <= 10) {
-                //can be better simplified by using n-ary instead of binary
-                char buffer[50];
-                num_t num;
-                int result = (int)evaluate(e);
-                sprintf(buffer, "%d", result);
-                num = num_Create(buffer);
-                simplified = ast_MakeNumber(num);
-            }
             break;
         case TOK_DIVIDE:
         case TOK_FRACTION:
             //TODO: trig identities
             if (is_val(left, 0))
-                simplified = ast_MakeNumber(num_value_0);
+                simplified = make_number("0");
             //TODO: Why does this mess up?
             //if (is_val(right, 1))
                 //simplified = ast_Copy(left);
             break;
         case TOK_POWER:
             if (is_val(left, 0))
-                simplified = ast_MakeNumber(num_value_0);
+                simplified = make_number("0");
             else if (is_val(left, 1))
-                simplified = ast_MakeNumber(num_value_1);
+                simplified = make_number("1");
             else if (is_val(right, 0))
-                simplified = ast_MakeNumber(num_value_1);
+                simplified = make_number("1");
             else if (is_val(right, 1))
                 simplified = ast_Copy(left);
             break;
@@ -194,16 +268,16 @@ ast_t *simplify(ast_t *e) {
             if (is_val(left, 1))
                 simplified = ast_Copy(right);
             else if(is_val(right, 0))
-                simplified = ast_MakeNumber(num_value_0);
+                simplified = make_number("0");
             else if (is_val(right, 1))
-                simplified = ast_MakeNumber(num_value_1);
+                simplified = make_number("1");
             break;
         case TOK_LOG_BASE:
             if (is_val(left, 1))
-                simplified = ast_MakeNumber(num_value_0);
+                simplified = make_number("0");
             else if (is_constant(left, 0) && is_constant(right, 0)
                 && evaluate(left) == evaluate(right))
-                simplified = ast_MakeNumber(num_value_1);
+                simplified = make_number("1");
             break;
         }
 
@@ -211,437 +285,701 @@ ast_t *simplify(ast_t *e) {
     }
     }
 
-    target = simplified == NULL ? e : simplified;
+    return simplified;
+}
+
+//e with its children swapped for the ones given, sharing e itself if they're the same.
+//takes the children given
+ast_t *rebuild(ast_t *e, ast_t *left, ast_t *right) {
+    if (e->type == NODE_UNARY) {
+        if (left == e->op.unary.operand) {
+            ast_Cleanup(left);
+            return ast_Copy(e);
+        }
+        return ast_MakeUnary(e->op.unary.operator, left);
+    }
+
+    if (left == e->op.binary.left && right == e->op.binary.right) {
+        ast_Cleanup(left);
+        ast_Cleanup(right);
+        return ast_Copy(e);
+    }
+    return ast_MakeBinary(e->op.binary.operator, left, right);
+}
 
-    switch (target->type) {
-    case NODE_NUMBER:
-    case NODE_SYMBOL:
-        ret = ast_Copy(target);
-        break;
-    case NODE_UNARY:
-        ret = ast_MakeUnary(target->op.unary.operator, simplify(target->op.unary.operand));
-        break;
-    case NODE_BINARY:
-        ret = ast_MakeBinary(target->op.unary.operator, simplify(target->op.binary.left), simplify(target->op.binary.right));
-        break;
-    default:
-        ret = NULL;
-        break;
+//A node whose children are being worked out. The results for them are pushed on a second stack
+//as they finish, so the node only has to pop them once they are all there.
+typedef struct _Visit {
+    ast_t *e;
+    ast_t *owned; //released once e is done
+    bool expanded; //the children have been pushed
+} visit_t;
+
+#define amount_children(e) ((e)->type == NODE_BINARY ? 2 : (e)->type == NODE_UNARY ? 1 : 0)
+
+//pushes the children of e so the left one is done first
+bool push_children(stack_t *visits, ast_t *e) {
+    visit_t v;
+
+    v.owned = NULL;
+    v.expanded = false;
+
+    if (e->type == NODE_UNARY) {
+        v.e = e->op.unary.operand;
+        return stack_PushOf(visits, visit_t, &v);
     }
 
-    if (simplified != NULL)
-        ast_Cleanup(simplified);
+    v.e = e->op.binary.right;
+    if (!stack_PushOf(visits, visit_t, &v))
+        return false;
+    v.e = e->op.binary.left;
+    return stack_PushOf(visits, visit_t, &v);
+}
+
+//pops the results for the children of e, NULL for ones it doesn't have
+void pop_children(stack_t *results, ast_t *e, ast_t **left, ast_t **right) {
+    *right = e->type == NODE_BINARY ? *stack_PopOf(results, ast_t*) : NULL;
+    *left = e->type != NODE_NUMBER && e->type != NODE_SYMBOL ? *stack_PopOf(results, ast_t*) : NULL;
+}
+
+//releases whatever is left on the stacks after giving up
+void abandon(stack_t *visits, stack_t *results) {
+    visit_t *v;
+    ast_t **result;
+
+    while ((v = stack_PopOf(visits, visit_t)) != NULL)
+        ast_Cleanup(v->owned);
+    while ((result = stack_PopOf(results, ast_t*)) != NULL)
+        ast_Cleanup(*result);
 
+    stack_Cleanup(visits);
+    stack_Cleanup(results);
+}
+
+ast_t *simplify(ast_t *e) {
+    stack_t visits, results;
+    visit_t v;
+    ast_t *ret = NULL;
+
+    //out of memory further down
+    if (e == NULL)
+        return NULL;
+
+    stack_CreateOf(&visits, visit_t);
+    stack_CreateOf(&results, ast_t*);
+
+    v.e = e;
+    v.owned = NULL;
+    v.expanded = false;
+
+    if (!stack_PushOf(&visits, visit_t, &v))
+        return NULL;
+
+    while (!stack_IsEmpty(&visits)) {
+        visit_t *top = stack_PeekOf(&visits, visit_t);
+
+        //the rules go top down, the children of whatever they leave get the next turn
+        if (!top->expanded) {
+            top->owned = simplify_node(top->e);
+            if (top->owned != NULL)
+                top->e = top->owned;
+            top->expanded = true;
+
+            if (amount_children(top->e) > 0) {
+                if (!push_children(&visits, top->e)) {
+                    abandon(&visits, &results);
+                    return NULL;
+                }
+                continue;
+            }
+        }
+
+        v = *stack_PopOf(&visits, visit_t);
+
+        if (amount_children(v.e) > 0) {
+            ast_t *left, *right;
+
+            //a NULL from out of memory below goes straight through rebuild
+            pop_children(&results, v.e, &left, &right);
+            ret = rebuild(v.e, left, right);
+        } else {
+            ret = ast_Copy(v.e);
+        }
+
+        ast_Cleanup(v.owned);
+
+        if (!stack_PushOf(&results, ast_t*, &ret)) {
+            ast_Cleanup(ret);
+            abandon(&visits, &results);
+            return NULL;
+        }
+    }
+
+    ret = *stack_PopOf(&results, ast_t*);
+
+    stack_Cleanup(&visits);
+    stack_Cleanup(&results);
     return ret;
 }
 
-#define needs_chain(ast) (!is_constant(ast, symbol) && ast->type != NODE_SYMBOL)
-#define chain(ast, inner) (needs_chain(ast) ? ast_MakeBinary(TOK_MULTIPLY, derivative(inner, symbol, error), ast) : ast)
+ast_t *_simplify_fixpoint(ast_t *e, bool *changed) {
+    stack_t visits, results;
+    visit_t v;
+    ast_t *ret;
 
-ast_t *derivative(ast_t *e, uint8_t symbol, Error *error) {
-    ast_t *ret = NULL, *temp = NULL;
+    stack_CreateOf(&visits, visit_t);
+    stack_CreateOf(&results, ast_t*);
 
-    /*
-    There is a huge compiler bug on the ti calc compiler that does not allow a
-    nested function to return a struct type to another function that returns a
-    pointer. The workaround is to store each function into a local variable,
-    which I've made an array of num_t
-    */
-    num_t n[4];
+    v.e = e;
+    v.owned = NULL;
+    v.expanded = false;
 
-    *error = E_SUCCESS;
+    if (!stack_PushOf(&visits, visit_t, &v))
+        return NULL;
+
+    while (!stack_IsEmpty(&visits)) {
+        visit_t *top = stack_PeekOf(&visits, visit_t);
+        ast_t *rewritten;
+
+        //the children first, unless there's nothing left to do below here
+        if (!top->expanded && top->e != NULL && !top->e->simplified && amount_children(top->e) > 0) {
+            top->expanded = true;
+
+            if (!push_children(&visits, top->e)) {
+                abandon(&visits, &results);
+                return NULL;
+            }
+            continue;
+        }
+
+        if (top->e == NULL) {
+            //out of memory further down
+            ret = NULL;
+        } else if (top->e->simplified) {
+            //already as simple as it gets, nothing below can have changed
+            ret = ast_Copy(top->e);
+        } else {
+            if (top->expanded) {
+                ast_t *left, *right;
+
+                pop_children(&results, top->e, &left, &right);
+                ret = rebuild(top->e, left, right);
+            } else {
+                ret = ast_Copy(top->e);
+            }
+
+            //the children are simplified, so only the parts a rule builds have to be revisited
+            rewritten = ret != NULL ? simplify_node(ret) : NULL;
+
+            if (rewritten != NULL) {
+                *changed = true;
+                ast_Cleanup(ret);
+
+                //this visit starts over on the rewritten tree instead of waiting on a new one
+                ast_Cleanup(top->owned);
+                top->e = top->owned = rewritten;
+                top->expanded = false;
+                continue;
+            }
+
+            if (ret != NULL)
+                ret->simplified = true;
+        }
+
+        v = *stack_PopOf(&visits, visit_t);
+        ast_Cleanup(v.owned);
+
+        if (!stack_PushOf(&results, ast_t*, &ret)) {
+            ast_Cleanup(ret);
+            abandon(&visits, &results);
+            return NULL;
+        }
+    }
+
+    ret = *stack_PopOf(&results, ast_t*);
+
+    stack_Cleanup(&visits);
+    stack_Cleanup(&results);
+    return ret;
+}
+
+ast_t *simplify_fixpoint(ast_t *e, bool *changed) {
+    bool dummy;
+
+    if (changed == NULL)
+        changed = &dummy;
 
-    if (is_constant(e, symbol)) {
-        n[0] = num_Create("0");
-        ret = ast_MakeNumber(n[0]);
+    *changed = false;
+    return _simplify_fixpoint(e, changed);
+}
+
+#define needs_chain(ast, symbol) (!is_constant(ast, symbol) && (ast)->type != NODE_SYMBOL)
+
+//the derivative of the outside of a composition, times d, the derivative of the inside. takes both
+ast_t *chain(ast_t *outer, ast_t *d, uint8_t symbol) {
+    if (outer != NULL && needs_chain(outer, symbol))
+        return ast_MakeBinary(TOK_MULTIPLY, d, outer);
+
+    ast_Cleanup(d);
+    return outer;
+}
+
+//The rule for e is built from the derivatives of up to two other trees, which are found first.
+//Those are children of e, or a rewritten form of e made here and kept in temp. Returns how many.
+uint8_t derivative_inputs(ast_t *e, uint8_t symbol, ast_t **inputs, ast_t **temp, Error *error) {
+    if (e->type == NODE_UNARY) {
+        ast_t *op = e->op.unary.operand;
+
+        switch (e->op.unary.operator) {
+        case TOK_INT:
+            *error = E_DERIV_NOT_ALLOWED;
+            return 0;
+        case TOK_10_TO_POWER:
+            *temp = ast_MakeBinary(TOK_MULTIPLY,
+                ast_MakeUnary(TOK_LN,
+                    make_number("10")),
+                ast_Copy(op));
+            inputs[0] = *temp;
+            return 1;
+        case TOK_NEGATE:
+        case TOK_RECRIPROCAL:
+        case TOK_SQUARE:
+        case TOK_CUBE:
+        case TOK_ABS:
+        case TOK_SQRT:
+        case TOK_CUBED_ROOT:
+        case TOK_LN:
+        case TOK_E_TO_POWER:
+        case TOK_LOG:
+        case TOK_SIN:
+        case TOK_SIN_INV:
+        case TOK_COS:
+        case TOK_COS_INV:
+        case TOK_TAN:
+        case TOK_TAN_INV:
+        case TOK_SINH:
+        case TOK_SINH_INV:
+        case TOK_COSH:
+        case TOK_COSH_INV:
+        case TOK_TANH:
+        case TOK_TANH_INV:
+            inputs[0] = op;
+            return 1;
+        default:
+            *error = E_DERIV_UNIMPLEMENTED;
+            return 0;
+        }
     }
-    else {
-        switch (e->type) {
-        case NODE_NUMBER:
-            n[0] = num_Create("0");
-            ret = ast_MakeNumber(n[0]);
+
+    if (e->type == NODE_BINARY) {
+        ast_t *left = e->op.binary.left, *right = e->op.binary.right;
+
+        switch (e->op.binary.operator) {
+        case TOK_ADD:
+        case TOK_SUBTRACT:
+        case TOK_MULTIPLY:
+        case TOK_DIVIDE:
+        case TOK_FRACTION:
+            inputs[0] = left;
+            inputs[1] = right;
+            return 2;
+        case TOK_POWER:
+            if (is_constant(right, symbol)) {
+                inputs[0] = left;
+                return 1;
+            }
+
+            *temp = ast_MakeBinary(TOK_MULTIPLY,
+                ast_MakeUnary(TOK_LN,
+                    ast_Copy(left)),
+                ast_Copy(right));
             break;
-        case NODE_SYMBOL:
-            n[0] = num_Create("0");
-            n[1] = num_Create("1");
-
-            if (e->op.symbol == SYMBOL_PI
-                || e->op.symbol == SYMBOL_E
-                || e->op.symbol != symbol)
-                ret = ast_MakeNumber(n[0]);
-            ret = ast_MakeNumber(n[1]);
+        case TOK_SCIENTIFIC:
+            //ti doesn't allow anything except a number on right,
+            //so we don't have to check for chaining right side
+
+            //instead, we're going to rewrite it as 10^() and find
+            //its derivative
+            *temp = ast_MakeBinary(TOK_MULTIPLY,
+                ast_Copy(left),
+                ast_MakeBinary(TOK_POWER,
+                    make_number("10"),
+                    ast_Copy(right)));
             break;
-        case NODE_UNARY: {
-            ast_t *op = e->op.unary.operand;
-
-            switch (e->op.unary.operator) {
-            case TOK_NEGATE:
-                ret = ast_MakeUnary(TOK_NEGATE, derivative(op, symbol, error));
-                break;
-            case TOK_RECRIPROCAL:
-                ret = ast_MakeUnary(TOK_NEGATE,
-                    ast_MakeBinary(TOK_FRACTION,
-                        derivative(op, symbol, error),
-                        ast_MakeUnary(TOK_SQUARE,
-                            ast_Copy(op))));
-                break;
-            case TOK_SQUARE:
-                n[0] = num_Create("2");
-                ret = chain(ast_MakeBinary(TOK_MULTIPLY,
-                    ast_MakeNumber(n[0]),
-                    ast_Copy(op)), op);
-                break;
-            case TOK_CUBE:
-                n[0] = num_Create("3");
-                ret = chain(ast_MakeBinary(TOK_MULTIPLY,
-                    ast_MakeNumber(n[0]),
-                    ast_MakeUnary(TOK_SQUARE,
-                        ast_Copy(op))), op);
-                break;
-            case TOK_INT:
-                *error = E_DERIV_NOT_ALLOWED;
-                ret = NULL;
-                break;
-            case TOK_ABS:
-                ret = chain(ast_MakeBinary(TOK_FRACTION,
-                    ast_Copy(op),
-                    ast_MakeUnary(TOK_ABS,
-                        ast_Copy(op))), op);
-                break;
-            case TOK_SQRT:
-                n[0] = num_Create("1");
-                n[1] = num_Create("2");
-                n[2] = num_Create("1");
-                n[3] = num_Create("2");
-
-                ret = chain(ast_MakeBinary(TOK_MULTIPLY,
-                    ast_MakeBinary(TOK_FRACTION,
-                        ast_MakeNumber(n[0]),
-                        ast_MakeNumber(n[1])),
-                    ast_MakeBinary(TOK_POWER,
-                        ast_Copy(op),
-                        ast_MakeUnary(TOK_NEGATE,
-                            ast_MakeBinary(TOK_FRACTION,
-                                ast_MakeNumber(n[2]),
-                                ast_MakeNumber(n[3]))))), op);
-                break;
-            case TOK_CUBED_ROOT:
-                n[0] = num_Create("1");
-                n[1] = num_Create("3");
-                n[2] = num_Create("2");
-                n[3] = num_Create("3");
-
-                ret = chain(ast_MakeBinary(TOK_MULTIPLY,
-                    ast_MakeBinary(TOK_FRACTION,
-                        ast_MakeNumber(n[0]),
-                        ast_MakeNumber(n[1])),
-                    ast_MakeBinary(TOK_POWER,
-                        ast_Copy(op),
-                        ast_MakeUnary(TOK_NEGATE,
-                            ast_MakeBinary(TOK_FRACTION,
-                                ast_MakeNumber(n[2]),
-                                ast_MakeNumber(n[3]))))), op);
-                break;
-            case TOK_LN:
-                n[0] = num_Create("1");
+        case TOK_ROOT:
+            if (is_constant(left, symbol)) {
+                inputs[0] = right;
+                return 1;
+            }
 
-                ret = chain(ast_MakeBinary(TOK_FRACTION,
-                    ast_MakeNumber(n[0]),
-                    ast_Copy(op)), op);
-                break;
-            case TOK_E_TO_POWER:
-                return chain(ast_MakeUnary(TOK_E_TO_POWER,
-                    ast_Copy(op)), op);
-            case TOK_LOG:
-                n[0] = num_Create("1");
-                n[1] = num_Create("10");
-
-                ret = chain(ast_MakeBinary(TOK_FRACTION,
-                    ast_MakeNumber(n[0]),
-                    ast_MakeBinary(TOK_MULTIPLY,
-                        ast_Copy(op),
-                        ast_MakeUnary(TOK_LN,
-                            ast_MakeNumber(n[1])))), op);
-                break;
-            case TOK_10_TO_POWER: {
-                n[0] = num_Create("10");
+            *temp = ast_MakeBinary(TOK_MULTIPLY,
+                ast_MakeUnary(TOK_LN,
+                    ast_Copy(right)),
+                ast_MakeBinary(TOK_FRACTION,
+                    make_number("1"),
+                    ast_Copy(left)));
+            break;
+        case TOK_LOG_BASE:
+            if (right->type == NODE_SYMBOL && right->op.symbol == SYMBOL_E)
+                return 0;
+
+            *temp = ast_MakeBinary(TOK_FRACTION,
+                ast_MakeUnary(TOK_LN,
+                    ast_Copy(left)),
+                ast_MakeUnary(TOK_LN,
+                    ast_Copy(right)));
+            break;
+        default:
+            return 0;
+        }
 
-                temp = ast_MakeBinary(TOK_MULTIPLY,
-                    ast_MakeUnary(TOK_LN,
-                        ast_MakeNumber(n[0])),
-                    ast_Copy(op));
+        inputs[0] = *temp;
+        return 1;
+    }
 
-                ret = ast_MakeBinary(TOK_MULTIPLY,
-                    ast_MakeUnary(TOK_E_TO_POWER,
-                        ast_Copy(temp)),
-                    derivative(temp, symbol, error));
+    return 0;
+}
 
-                ast_Cleanup(temp);
+//builds the derivative of e from d, the derivatives of what derivative_inputs asked for, which it takes
+ast_t *derivative_rule(ast_t *e, uint8_t symbol, ast_t *temp, ast_t **d) {
+    if (e->type == NODE_SYMBOL)
+        return make_number("1");
 
-                break;
-            } case TOK_SIN:
-                ret = chain(ast_MakeUnary(TOK_COS,
-                    ast_Copy(op)), op);
-                break;
-            case TOK_SIN_INV:
-                n[0] = num_Create("1");
-                n[1] = num_Create("1");
+    if (e->type == NODE_UNARY) {
+        ast_t *op = e->op.unary.operand;
 
-                ret = chain(ast_MakeBinary(TOK_FRACTION,
-                    ast_MakeNumber(n[0]),
+        switch (e->op.unary.operator) {
+        case TOK_NEGATE:
+            return ast_MakeUnary(TOK_NEGATE, d[0]);
+        case TOK_RECRIPROCAL:
+            return ast_MakeUnary(TOK_NEGATE,
+                ast_MakeBinary(TOK_FRACTION,
+                    d[0],
+                    ast_MakeUnary(TOK_SQUARE,
+                        ast_Copy(op))));
+        case TOK_SQUARE:
+            return chain(ast_MakeBinary(TOK_MULTIPLY,
+                make_number("2"),
+                ast_Copy(op)), d[0], symbol);
+        case TOK_CUBE:
+            return chain(ast_MakeBinary(TOK_MULTIPLY,
+                make_number("3"),
+                ast_MakeUnary(TOK_SQUARE,
+                    ast_Copy(op))), d[0], symbol);
+        case TOK_ABS:
+            return chain(ast_MakeBinary(TOK_FRACTION,
+                ast_Copy(op),
+                ast_MakeUnary(TOK_ABS,
+                    ast_Copy(op))), d[0], symbol);
+        case TOK_SQRT:
+            return chain(ast_MakeBinary(TOK_MULTIPLY,
+                ast_MakeBinary(TOK_FRACTION,
+                    make_number("1"),
+                    make_number("2")),
+                ast_MakeBinary(TOK_POWER,
+                    ast_Copy(op),
+                    ast_MakeUnary(TOK_NEGATE,
+                        ast_MakeBinary(TOK_FRACTION,
+                            make_number("1"),
+                            make_number("2"))))), d[0], symbol);
+        case TOK_CUBED_ROOT:
+            return chain(ast_MakeBinary(TOK_MULTIPLY,
+                ast_MakeBinary(TOK_FRACTION,
+                    make_number("1"),
+                    make_number("3")),
+                ast_MakeBinary(TOK_POWER,
+                    ast_Copy(op),
+                    ast_MakeUnary(TOK_NEGATE,
+                        ast_MakeBinary(TOK_FRACTION,
+                            make_number("2"),
+                            make_number("3"))))), d[0], symbol);
+        case TOK_LN:
+            return chain(ast_MakeBinary(TOK_FRACTION,
+                make_number("1"),
+                ast_Copy(op)), d[0], symbol);
+        case TOK_E_TO_POWER:
+            return chain(ast_MakeUnary(TOK_E_TO_POWER,
+                ast_Copy(op)), d[0], symbol);
+        case TOK_LOG:
+            return chain(ast_MakeBinary(TOK_FRACTION,
+                make_number("1"),
+                ast_MakeBinary(TOK_MULTIPLY,
+                    ast_Copy(op),
+                    ast_MakeUnary(TOK_LN,
+                        make_number("10")))), d[0], symbol);
+        case TOK_10_TO_POWER:
+            return ast_MakeBinary(TOK_MULTIPLY,
+                ast_MakeUnary(TOK_E_TO_POWER,
+                    ast_Copy(temp)),
+                d[0]);
+        case TOK_SIN:
+            return chain(ast_MakeUnary(TOK_COS,
+                ast_Copy(op)), d[0], symbol);
+        case TOK_SIN_INV:
+            return chain(ast_MakeBinary(TOK_FRACTION,
+                make_number("1"),
+                ast_MakeUnary(TOK_SQRT,
+                    ast_MakeBinary(TOK_SUBTRACT,
+                        make_number("1"),
+                        ast_MakeUnary(TOK_SQUARE,
+                            ast_Copy(op))))), d[0], symbol);
+        case TOK_COS:
+            return chain(ast_MakeUnary(TOK_NEGATE,
+                ast_MakeUnary(TOK_SIN,
+                    ast_Copy(op))), d[0], symbol);
+        case TOK_COS_INV:
+            return chain(ast_MakeUnary(TOK_NEGATE,
+                ast_MakeBinary(TOK_FRACTION,
+                    make_number("1"),
                     ast_MakeUnary(TOK_SQRT,
                         ast_MakeBinary(TOK_SUBTRACT,
-                            ast_MakeNumber(n[1]),
+                            make_number("1"),
                             ast_MakeUnary(TOK_SQUARE,
-                                ast_Copy(op))))), op);
-                break;
-            case TOK_COS:
-                ret = chain(ast_MakeUnary(TOK_NEGATE,
-                    ast_MakeUnary(TOK_SIN,
-                        ast_Copy(op))), op);
-                break;
-            case TOK_COS_INV:
-                n[0] = num_Create("1");
-                n[1] = num_Create("1");
-
-                ret = chain(ast_MakeUnary(TOK_NEGATE,
-                    ast_MakeBinary(TOK_FRACTION,
-                        ast_MakeNumber(n[0]),
-                        ast_MakeUnary(TOK_SQRT,
-                            ast_MakeBinary(TOK_SUBTRACT,
-                                ast_MakeNumber(n[1]),
-                                ast_MakeUnary(TOK_SQUARE,
-                                    ast_Copy(op)))))), op);
-                break;
-            case TOK_TAN:
-                n[0] = num_Create("1");
-
-                ret = chain(ast_MakeBinary(TOK_FRACTION,
-                    ast_MakeNumber(n[0]),
+                                ast_Copy(op)))))), d[0], symbol);
+        case TOK_TAN:
+            return chain(ast_MakeBinary(TOK_FRACTION,
+                make_number("1"),
+                ast_MakeUnary(TOK_SQUARE,
+                    ast_MakeUnary(TOK_COS,
+                        ast_Copy(op)))), d[0], symbol);
+        case TOK_TAN_INV:
+            return chain(ast_MakeBinary(TOK_FRACTION,
+                make_number("1"),
+                ast_MakeBinary(TOK_ADD,
+                    make_number("1"),
                     ast_MakeUnary(TOK_SQUARE,
-                        ast_MakeUnary(TOK_COS,
-                            ast_Copy(op)))), op);
-                break;
-            case TOK_TAN_INV:
-                n[0] = num_Create("1");
-                n[1] = num_Create("1");
-
-                ret = chain(ast_MakeBinary(TOK_FRACTION,
-                    ast_MakeNumber(n[0]),
+                        ast_Copy(op)))), d[0], symbol);
+        case TOK_SINH:
+            return chain(ast_MakeUnary(TOK_COSH,
+                ast_Copy(op)), d[0], symbol);
+        case TOK_SINH_INV:
+            return chain(ast_MakeBinary(TOK_FRACTION,
+                make_number("1"),
+                ast_MakeUnary(TOK_SQRT,
                     ast_MakeBinary(TOK_ADD,
-                        ast_MakeNumber(n[1]),
                         ast_MakeUnary(TOK_SQUARE,
-                            ast_Copy(op)))), op);
-                break;
-            case TOK_SINH:
-                ret = chain(ast_MakeUnary(TOK_COSH,
-                    ast_Copy(op)), op);
-                break;
-            case TOK_SINH_INV:
-                n[0] = num_Create("1");
-                n[1] = num_Create("1");
+                            ast_Copy(op)),
+                        make_number("1")))), d[0], symbol);
+        case TOK_COSH:
+            return chain(ast_MakeUnary(TOK_SINH,
+                ast_Copy(op)), d[0], symbol);
+        case TOK_COSH_INV:
+            return chain(ast_MakeBinary(TOK_FRACTION,
+                make_number("1"),
+                ast_MakeUnary(TOK_SQRT,
+                    ast_MakeBinary(TOK_SUBTRACT,
+                        ast_MakeUnary(TOK_SQUARE,
+                            ast_Copy(op)),
+                        make_number("1")))), d[0], symbol);
+        case TOK_TANH:
+            return chain(ast_MakeUnary(TOK_SQUARE,
+                ast_MakeBinary(TOK_FRACTION,
+                    make_number("1"),
+                    ast_MakeUnary(TOK_COSH,
+                        ast_Copy(op)))), d[0], symbol);
+        case TOK_TANH_INV:
+            return chain(ast_MakeBinary(TOK_FRACTION,
+                make_number("1"),
+                ast_MakeBinary(TOK_SUBTRACT,
+                    make_number("1"),
+                    ast_MakeUnary(TOK_SQUARE,
+                        ast_Copy(op)))), d[0], symbol);
+        }
+    }
 
-                ret = chain(ast_MakeBinary(TOK_FRACTION,
-                    ast_MakeNumber(n[0]),
-                    ast_MakeUnary(TOK_SQRT,
-                        ast_MakeBinary(TOK_ADD,
-                            ast_MakeUnary(TOK_SQUARE,
-                                ast_Copy(op)),
-                            ast_MakeNumber(n[1])))), op);
-                break;
-            case TOK_COSH:
-                ret = chain(ast_MakeUnary(TOK_SINH,
-                    ast_Copy(op)), op);
-                break;
-            case TOK_COSH_INV:
-                n[0] = num_Create("1");
-                n[1] = num_Create("1");
+    if (e->type == NODE_BINARY) {
+        ast_t *left = e->op.binary.left, *right = e->op.binary.right;
 
-                ret = chain(ast_MakeBinary(TOK_FRACTION,
-                    ast_MakeNumber(n[0]),
-                    ast_MakeUnary(TOK_SQRT,
+        //https://www.mathsisfun.com/calculus/derivatives-rules.html
+        switch (e->op.binary.operator) {
+        case TOK_ADD:
+        case TOK_SUBTRACT:
+            return ast_MakeBinary(e->op.binary.operator, d[0], d[1]);
+        case TOK_MULTIPLY:
+            return ast_MakeBinary(TOK_ADD,
+                ast_MakeBinary(TOK_MULTIPLY,
+                    ast_Copy(left),
+                    d[1]),
+                ast_MakeBinary(TOK_MULTIPLY,
+                    d[0],
+                    ast_Copy(right)));
+        case TOK_DIVIDE:
+        case TOK_FRACTION:
+            return ast_MakeBinary(TOK_FRACTION,
+                ast_MakeBinary(TOK_SUBTRACT,
+                    ast_MakeBinary(TOK_MULTIPLY,
+                        d[0],
+                        ast_Copy(right)),
+                    ast_MakeBinary(TOK_MULTIPLY,
+                        d[1],
+                        ast_Copy(left))),
+                ast_MakeUnary(TOK_SQUARE, ast_Copy(right)));
+        case TOK_POWER:
+            if (temp == NULL) {
+                return chain(ast_MakeBinary(TOK_MULTIPLY,
+                    ast_Copy(right),
+                    ast_MakeBinary(TOK_POWER,
+                        ast_Copy(left),
                         ast_MakeBinary(TOK_SUBTRACT,
-                            ast_MakeUnary(TOK_SQUARE,
-                                ast_Copy(op)),
-                            ast_MakeNumber(n[1])))), op);
-                break;
-            case TOK_TANH:
-                n[0] = num_Create("1");
-
-                ret = chain(ast_MakeUnary(TOK_SQUARE,
-                    ast_MakeBinary(TOK_FRACTION,
-                        ast_MakeNumber(n[0]),
-                        ast_MakeUnary(TOK_COSH,
-                            ast_Copy(op)))), op);
-                break;
-            case TOK_TANH_INV:
-                n[0] = num_Create("1");
-                n[1] = num_Create("1");
+                            ast_Copy(right),
+                            make_number("1")))), d[0], symbol);
+            }
 
-                ret = chain(ast_MakeBinary(TOK_FRACTION,
-                    ast_MakeNumber(n[0]),
-                    ast_MakeBinary(TOK_SUBTRACT,
-                        ast_MakeNumber(n[1]),
-                        ast_MakeUnary(TOK_SQUARE,
-                            ast_Copy(op)))), op);
-                break;
-            default:
-                *error = E_DERIV_UNIMPLEMENTED;
-                ret = NULL;
-                break;
+            return ast_MakeBinary(TOK_MULTIPLY,
+                ast_MakeUnary(TOK_E_TO_POWER,
+                    ast_Copy(temp)),
+                d[0]);
+        case TOK_SCIENTIFIC:
+            return d[0];
+        case TOK_ROOT:
+            if (temp == NULL) {
+                ast_t *exponent = ast_MakeBinary(TOK_FRACTION,
+                    make_number("1"),
+                    ast_Copy(left));
+
+                return chain(ast_MakeBinary(TOK_MULTIPLY,
+                    exponent,
+                    ast_MakeBinary(TOK_POWER,
+                        ast_Copy(right),
+                        ast_MakeBinary(TOK_SUBTRACT,
+                            ast_Copy(exponent),
+                            make_number("1")))), d[0], symbol);
             }
 
-        } case NODE_BINARY: {
-            ast_t *left, *right;
+            return ast_MakeBinary(TOK_MULTIPLY,
+                ast_Copy(e),
+                d[0]);
+        case TOK_LOG_BASE:
+            if (temp == NULL) {
+                return ast_MakeBinary(TOK_FRACTION,
+                    make_number("1"),
+                    ast_Copy(left));
+            }
 
-            left = e->op.binary.left;
-            right = e->op.binary.right;
+            return d[0];
+        }
+    }
 
-            //https://www.mathsisfun.com/calculus/derivatives-rules.html
-            switch (e->op.binary.operator) {
-            case TOK_ADD:
-                ret = ast_MakeBinary(TOK_ADD, derivative(left, symbol, error), derivative(right, symbol, error));
-                break;
-            case TOK_SUBTRACT:
-                ret = ast_MakeBinary(TOK_SUBTRACT, derivative(left, symbol, error), derivative(right, symbol, error));
-                break;
-            case TOK_MULTIPLY:
-                ret = ast_MakeBinary(TOK_ADD,
-                    ast_MakeBinary(TOK_MULTIPLY,
-                        ast_Copy(left),
-                        derivative(right, symbol, error)),
-                    ast_MakeBinary(TOK_MULTIPLY,
-                        derivative(left, symbol, error),
-                        ast_Copy(right)));
-                break;
-            case TOK_DIVIDE:
-            case TOK_FRACTION:
-                ret = ast_MakeBinary(TOK_FRACTION,
-                    ast_MakeBinary(TOK_SUBTRACT,
-                        ast_MakeBinary(TOK_MULTIPLY,
-                            derivative(left, symbol, error),
-                            ast_Copy(right)),
-                        ast_MakeBinary(TOK_MULTIPLY,
-                            derivative(right, symbol, error),
-                            ast_Copy(left))),
-                    ast_MakeUnary(TOK_SQUARE, ast_Copy(right)));
-                break;
-            case TOK_POWER: {
-                n[0] = num_Create("1");
+    return NULL;
+}
 
-                if (is_constant(right, symbol)) {
-                    ret = chain(ast_MakeBinary(TOK_MULTIPLY,
-                        ast_Copy(right),
-                        ast_MakeBinary(TOK_POWER,
-                            ast_Copy(left),
-                            ast_MakeBinary(TOK_SUBTRACT,
-                                ast_Copy(right),
-                                ast_MakeNumber(n[0])))), left);
-                }
-                else {
-                    temp = ast_MakeBinary(TOK_MULTIPLY,
-                        ast_MakeUnary(TOK_LN,
-                            ast_Copy(left)),
-                        ast_Copy(right));
-
-                    ret = ast_MakeBinary(TOK_MULTIPLY,
-                        ast_MakeUnary(TOK_E_TO_POWER,
-                            ast_Copy(temp)),
-                        derivative(temp, symbol, error));
-
-                    ast_Cleanup(temp);
-                }
+//Each step is a node whose derivative is needed. Its inputs are pushed as steps of their own on
+//top of it, and once their derivatives are waiting on the results stack the step is finished.
+typedef struct _Step {
+    ast_t *e;
+    ast_t *temp; //released with the step
+    uint8_t inputs; //STEP_NEW until they've been pushed
+} step_t;
 
-                break;
-            } case TOK_SCIENTIFIC:
-                //ti doesn't allow anything except a number on right,
-                //so we don't have to check for chaining right side
+#define STEP_NEW 0xFF
 
-                //instead, we're going to rewrite it as 10^() and find
-                //its derivative
+//errors are sticky so one from deep inside isn't overwritten by a sibling that succeeded
+ast_t *derivative(ast_t *e, uint8_t symbol, Error *error) {
+    stack_t steps, results;
+    step_t s;
+    step_t *top;
+    ast_t **result;
+    ast_t *ret = NULL;
 
-                n[0] = num_Create("10");
+    *error = E_SUCCESS;
 
-                temp = ast_MakeBinary(TOK_MULTIPLY,
-                    ast_Copy(left),
-                    ast_MakeBinary(TOK_POWER,
-                        ast_MakeNumber(n[0]),
-                        ast_Copy(right)));
+    stack_CreateOf(&steps, step_t);
+    stack_CreateOf(&results, ast_t*);
 
-                    ret = derivative(temp, symbol, error);
-                    
-                    ast_Cleanup(temp);
+    s.e = e;
+    s.temp = NULL;
+    s.inputs = STEP_NEW;
 
-                break;
-            case TOK_ROOT: {
+    if (!stack_PushOf(&steps, step_t, &s))
+        *error = E_MEMORY;
 
-                ast_t *rewritten_exponent;
+    while (*error == E_SUCCESS && (top = stack_PeekOf(&steps, step_t)) != NULL) {
+        ast_t *d[2];
+        uint8_t i;
 
-                n[0] = num_Create("1");
-                n[1] = num_Create("1");
+        if (top->inputs == STEP_NEW) {
+            ast_t *inputs[2];
+            uint8_t amount;
 
-                rewritten_exponent = ast_MakeBinary(TOK_FRACTION,
-                    ast_MakeNumber(n[0]),
-                    ast_Copy(left));
+            //out of memory building the tree we were given
+            if (top->e == NULL) {
+                *error = E_MEMORY;
+                break;
+            }
 
-                if (is_constant(left, symbol)) {
-                    ret = chain(ast_MakeBinary(TOK_MULTIPLY,
-                        ast_Copy(rewritten_exponent),
-                        ast_MakeBinary(TOK_POWER,
-                            ast_Copy(right),
-                            ast_MakeBinary(TOK_SUBTRACT,
-                                ast_Copy(rewritten_exponent),
-                                ast_MakeNumber(n[1])))), right);
-                }
-                else {
-                    temp = ast_MakeBinary(TOK_MULTIPLY,
-                        ast_MakeUnary(TOK_LN,
-                            ast_Copy(right)),
-                        ast_Copy(rewritten_exponent));
+            ret = NULL;
 
-                    ret = ast_MakeBinary(TOK_MULTIPLY,
-                        ast_Copy(e),
-                        derivative(temp, symbol, error));
+            //polynomials and quotients of them are differentiated straight from their coefficients
+            if (top->e->type != NODE_SYMBOL && !is_constant(top->e, symbol) && top->e->symbols == symbol_bit(symbol)
+                && top->e->arithmetic)
+                ret = poly_DerivativeAst(top->e, symbol);
 
-                    ast_Cleanup(temp);
-                }
+            if (ret == NULL && is_constant(top->e, symbol)) {
+                ret = make_number("0");
+                if (ret == NULL)
+                    *error = E_MEMORY;
+            }
 
-                ast_Cleanup(rewritten_exponent);
+            if (ret == NULL) {
+                amount = derivative_inputs(top->e, symbol, inputs, &top->temp, error);
+                top->inputs = amount;
 
-                break;
-            } case TOK_LOG_BASE: {
-
-                n[0] = num_Create("1");
-                
-                if (right->type == NODE_SYMBOL && right->op.symbol == SYMBOL_E) {
-                    ret = ast_MakeBinary(TOK_FRACTION,
-                        ast_MakeNumber(n[0]),
-                        ast_Copy(left));
-                }
-                else {
-                    
-                    temp = ast_MakeBinary(TOK_FRACTION,
-                        ast_MakeUnary(TOK_LN,
-                            ast_Copy(left)),
-                        ast_MakeUnary(TOK_LN,
-                            ast_Copy(right)));
+                if (*error != E_SUCCESS)
+                    break;
 
-                    ret = derivative(temp, symbol, error);
+                for (i = amount; i > 0; i--) {
+                    s.e = inputs[i - 1];
+                    s.temp = NULL;
+                    s.inputs = STEP_NEW;
 
-                    ast_Cleanup(temp);
+                    if (!stack_PushOf(&steps, step_t, &s)) {
+                        *error = E_MEMORY;
+                        break;
+                    }
                 }
 
-                break;
-
-            }
+                if (amount > 0)
+                    continue;
             }
+        }
+
+        //everything this step was waiting on is done
+        s = *stack_PopOf(&steps, step_t);
+
+        if (s.inputs != STEP_NEW) {
+            d[0] = d[1] = NULL;
+            for (i = s.inputs; i > 0; i--)
+                d[i - 1] = *stack_PopOf(&results, ast_t*);
 
+            ret = derivative_rule(s.e, symbol, s.temp, d);
+            ast_Cleanup(s.temp);
         }
+
+        if (ret == NULL) {
+            *error = E_MEMORY;
+            break;
+        }
+
+        if (!stack_PushOf(&results, ast_t*, &ret)) {
+            ast_Cleanup(ret);
+            *error = E_MEMORY;
         }
     }
-    
-    if (*error != E_SUCCESS)
-        return NULL;
+
+    ret = NULL;
+
+    if (*error == E_SUCCESS)
+        ret = *stack_PopOf(&results, ast_t*);
+
+    //whatever was left when it gave up
+    while ((top = stack_PopOf(&steps, step_t)) != NULL)
+        ast_Cleanup(top->temp);
+    while ((result = stack_PopOf(&results, ast_t*)) != NULL)
+        ast_Cleanup(*result);
+
+    stack_Cleanup(&steps);
+    stack_Cleanup(&results);
+
     return ret;
 }
 
@@ -660,92 +998,176 @@ double atanh(double x) {
 #endif
 
 bool can_evaluate(ast_t *e) {
-    switch(e->type) {
-        case NODE_NUMBER:
-            return e->op.number.length < 16;
-        case NODE_SYMBOL:
-            return is_constant(e, 0);
-        case NODE_UNARY:
-            return can_evaluate(e->op.unary.operand);
-        case NODE_BINARY:
-            return can_evaluate(e->op.binary.left) && can_evaluate(e->op.binary.right);
+    analyze(e);
+    return e->evaluable;
+}
+
+double evaluate_unary(TokenType operator, double x) {
+    switch (operator) {
+    case TOK_NEGATE: return -1 * x;
+    case TOK_RECRIPROCAL: return 1 / x;
+    case TOK_SQUARE: return pow(x, 2);
+    case TOK_CUBE: return pow(x, 3);
+
+    case TOK_INT: return (int)x;
+    case TOK_ABS: return fabs(x);
+
+    case TOK_SQRT: return sqrt(x);
+    case TOK_CUBED_ROOT: return x < 0 ? -pow(-x, 1.0 / 3) : pow(x, 1.0 / 3);
+
+    case TOK_LN: return log(x);
+    case TOK_E_TO_POWER: return pow(M_E, x);
+    case TOK_LOG: return log(x) / log(10);
+    case TOK_10_TO_POWER: return pow(10, x);
+
+    case TOK_SIN: return sin(x);
+    case TOK_SIN_INV: return asin(x);
+    case TOK_COS: return cos(x);
+    case TOK_COS_INV: return acos(x);
+    case TOK_TAN: return tan(x);
+    case TOK_TAN_INV: return atan(x);
+    case TOK_SINH: return sinh(x);
+    case TOK_SINH_INV: return asinh(x);
+    case TOK_COSH: return cosh(x);
+    case TOK_COSH_INV: return acosh(x);
+    case TOK_TANH: return tanh(x);
+    case TOK_TANH_INV: return atanh(x);
     }
-    return false;
+
+    return -1;
 }
 
-double evaluate(ast_t *e) {
-    switch (e->type) {
-    case NODE_NUMBER:
-        return num_ToDouble(e->op.number);
-        break;
-    case NODE_SYMBOL:
-        switch (e->op.symbol) {
-        case SYMBOL_E:
-            return M_E;
-            break;
-        case SYMBOL_PI:
-            return M_PI;
-            break;
-        default:
-            //TODO: Implement a map for variable values
-            //or throw some error here
-            return -1;
-        }
-        break;
-    case NODE_UNARY: {
-        double x = evaluate(e->op.unary.operand);
+double evaluate_binary(TokenType operator, double left, double right) {
+    switch (operator) {
+    case TOK_ADD: return left + right;
+    case TOK_SUBTRACT: return left - right;
+    case TOK_MULTIPLY: return left * right;
+    case TOK_DIVIDE: return left / right;
+    case TOK_FRACTION: return left / right;
+    case TOK_POWER: return pow(left, right);
+    case TOK_SCIENTIFIC: return left * pow(10, right);
+    case TOK_ROOT: return pow(right, 1 / left);
+
+    case TOK_LOG_BASE: return log(left) / log(right);
+    }
 
-        switch (e->op.unary.operator) {
-        case TOK_NEGATE: return -1 * x;
-        case TOK_RECRIPROCAL: return 1 / x;
-        case TOK_SQUARE: return pow(x, 2);
-        case TOK_CUBE: pow(x, 3);
-
-        case TOK_INT: return (int)x;
-        case TOK_ABS: return fabs(x);
-
-        case TOK_SQRT: return sqrt(x);
-        case TOK_CUBED_ROOT: pow(x, 1/3);
-
-        case TOK_LN: return log(x);
-        case TOK_E_TO_POWER: return pow(M_E, x);
-        case TOK_LOG: return log(x) / log(10);
-        case TOK_10_TO_POWER: return pow(10, x);
-
-        case TOK_SIN: return sin(x);
-        case TOK_SIN_INV: return asin(x);
-        case TOK_COS: return cos(x);
-        case TOK_COS_INV: return acos(x);
-        case TOK_TAN: return tan(x);
-        case TOK_TAN_INV: return atan(x);
-        case TOK_SINH: return sinh(x);
-        case TOK_SINH_INV: return asinh(x);
-        case TOK_COSH: return cosh(x);
-        case TOK_COSH_INV: return acosh(x);
-        case TOK_TANH: return tanh(x);
-        case TOK_TANH_INV: return atanh(x);
+    return -1;
+}
+
+void env_Create(env_t *env) {
+    env->bound = 0;
+}
+
+void env_Set(env_t *env, uint8_t symbol, double value) {
+    int slot = env_Slot(symbol);
+
+    if (slot < 0) return;
+
+    env->values[slot] = value;
+    env->bound |= (uint32_t)1 << slot;
+}
+
+void env_Unset(env_t *env, uint8_t symbol) {
+    int slot = env_Slot(symbol);
+
+    if (slot >= 0)
+        env->bound &= ~((uint32_t)1 << slot);
+}
+
+//the value of a node that has no operators left to apply. env NULL is evaluate() with every
+//variable as -1
+double leaf_value(ast_t *e, const env_t *env, Error *error) {
+    int slot;
+
+    //folded already
+    if (e->analyzed && e->evaluable)
+        return e->value;
+
+    if (e->type == NODE_NUMBER)
+        return e->op.number.value;
+
+    if (e->op.symbol == SYMBOL_E) return M_E;
+    if (e->op.symbol == SYMBOL_PI) return M_PI;
+
+    //TODO: evaluate() should report these too instead of using -1
+    if (env == NULL)
+        return -1;
+
+    slot = env_Slot(e->op.symbol);
+
+    if (slot < 0 || !(env->bound & ((uint32_t)1 << slot))) {
+        *error = E_EVAL_UNBOUND;
+        return 0;
+    }
+
+    return env->values[slot];
+}
+
+#define is_leaf(e) (((e)->analyzed && (e)->evaluable) || (e)->type == NODE_NUMBER || (e)->type == NODE_SYMBOL)
+
+//an operator waiting on the values of its operands
+typedef struct _Pending {
+    ast_t *e;
+    bool right; //the left value is in and the right side is being worked out
+    double left;
+} pending_t;
+
+double _evaluate(ast_t *e, const env_t *env, Error *error) {
+    stack_t pending;
+    pending_t p;
+    double x;
+
+    stack_CreateOf(&pending, pending_t);
+
+    for (;;) {
+        //down the left side to something with a value
+        while (!is_leaf(e)) {
+            p.e = e;
+            p.right = false;
+
+            if (!stack_PushOf(&pending, pending_t, &p))
+                break;
+
+            e = e->type == NODE_UNARY ? e->op.unary.operand : e->op.binary.left;
         }
-        break;
-    } case NODE_BINARY: {
-        double left, right;
-        left = evaluate(e->op.binary.left);
-        right = evaluate(e->op.binary.right);
 
-        switch (e->op.binary.operator) {
-        case TOK_ADD: return left + right;
-        case TOK_SUBTRACT: return left - right;
-        case TOK_MULTIPLY: return left * right;
-        case TOK_DIVIDE: return left / right;
-        case TOK_FRACTION: return left / right;
-        case TOK_POWER: return pow(left, right);
-        case TOK_SCIENTIFIC: return left * pow(10, right);
-        case TOK_ROOT: return pow(right, 1 / left);
-
-        case TOK_LOG_BASE: return log(left) / log(right);
+        //out of memory for the stack, use the call stack for this one
+        x = is_leaf(e) ? leaf_value(e, env, error) : _evaluate(e, env, error);
+
+        //back up through the operators that have all they need now
+        for (;;) {
+            pending_t *top = stack_PeekOf(&pending, pending_t);
+
+            if (top == NULL) {
+                stack_Cleanup(&pending);
+                return x;
+            }
+
+            if (top->e->type == NODE_UNARY) {
+                x = evaluate_unary(top->e->op.unary.operator, x);
+            } else if (top->right) {
+                x = evaluate_binary(top->e->op.binary.operator, top->left, x);
+            } else {
+                top->left = x;
+                top->right = true;
+                e = top->e->op.binary.right;
+                break;
+            }
+
+            stack_PopOf(&pending, pending_t);
         }
-        break;
-    }
     }
+}
 
-    return -1;
+double evaluate(ast_t *e) {
+    Error error;
+    return _evaluate(e, NULL, &error);
+}
+
+Error evaluate_env(ast_t *e, const env_t *env, double *result) {
+    Error error = E_SUCCESS;
+
+    *result = _evaluate(e, env, &error);
+
+    return error;
 }
@@ -3,10 +3,46 @@
 
 #include "ast.h"
 
+//one top down pass of the rules
 ast_t *simplify(ast_t *e);
+//applies the rules bottom up until none of them fire anymore. changed can be NULL
+ast_t *simplify_fixpoint(ast_t *e, bool *changed);
 ast_t *derivative(ast_t *e, uint8_t symbol, Error *error);
 
 //default variable = the number to plug in for any encountered variable
 double evaluate(ast_t *e);
 
+//Values for the variables, indexed by env_Slot of the symbol. A through Z then theta.
+#define ENV_SLOTS 27
+
+typedef struct _Env {
+    uint32_t bound; //bit per slot
+    double values[ENV_SLOTS];
+} env_t;
+
+//the slot for a variable, or -1 for anything else (including e and pi, which are constants)
+#define env_Slot(symbol) ((symbol) >= 'A' && (symbol) <= 'Z' ? (symbol) - 'A' : (symbol) == SYMBOL_THETA ? 26 : -1)
+
+//bit in ast_t.symbols for each symbol. variables use their env slot
+#define SYMBOL_BIT_E ((uint32_t)1 << 27)
+#define SYMBOL_BIT_PI ((uint32_t)1 << 28)
+#define SYMBOL_BIT_OTHER ((uint32_t)1 << 29)
+#define SYMBOL_BITS_VARIABLES (((uint32_t)1 << ENV_SLOTS) - 1)
+
+uint32_t symbol_bit(uint8_t symbol);
+
+//fills in the cached analysis of e and everything below it, only the first time
+void analyze(ast_t *e);
+
+void env_Create(env_t *env);
+void env_Set(env_t *env, uint8_t symbol, double value);
+void env_Unset(env_t *env, uint8_t symbol);
+
+//like evaluate, but takes variables from env. E_EVAL_UNBOUND if one isn't set
+Error evaluate_env(ast_t *e, const env_t *env, double *result);
+
+//what evaluate does at a single operator
+double evaluate_unary(TokenType operator, double x);
+double evaluate_binary(TokenType operator, double left, double right);
+
 #endif
@@ -0,0 +1,336 @@
+#include "cse.h"
+
+#include <string.h>
+
+#include "stack.h"
+
+typedef struct _Entry {
+    uint32_t hash;
+    ast_t *node;
+} entry_t;
+
+typedef struct _Table {
+    unsigned size, used; //size is a power of 2, at least twice used
+    entry_t *entries;
+
+    //nodes in the table may have been released when a node failed to allocate, so stop
+    bool failed;
+} table_t;
+
+//what a node of the input was turned into, so a node shared in a DAG is only worked out once
+typedef struct _MemoEntry {
+    ast_t *from, *to;
+    uint32_t hash;
+} memo_entry_t;
+
+typedef struct _Memo {
+    unsigned size, used; //same as table_t
+    memo_entry_t *entries;
+} memo_t;
+
+//both start small and double as they fill, so they're as big as the distinct nodes need
+#define TABLE_START_SIZE 16
+
+#define mix(hash, value) (((hash) ^ (uint32_t)(value)) * 16777619u)
+#define memo_slot(memo, e) ((unsigned)(((uintptr_t)(e) >> 3) * 2654435761u) & ((memo)->size - 1))
+
+//children are already shared by the time a node is looked up, so comparing their
+//pointers is enough to compare the whole subtree
+bool same_node(ast_t *a, ast_t *b) {
+    if (a->type != b->type)
+        return false;
+
+    switch (a->type) {
+    case NODE_NUMBER:
+        return !num_Compare(a->op.number, b->op.number);
+    case NODE_SYMBOL:
+        return a->op.symbol == b->op.symbol;
+    case NODE_UNARY:
+        return a->op.unary.operator == b->op.unary.operator
+            && a->op.unary.operand == b->op.unary.operand;
+    case NODE_BINARY:
+        return a->op.binary.operator == b->op.binary.operator
+            && a->op.binary.left == b->op.binary.left
+            && a->op.binary.right == b->op.binary.right;
+    }
+
+    return false;
+}
+
+//doubles the table once it's half full. false when out of memory
+bool table_Grow(table_t *t) {
+    entry_t *old = t->entries;
+    unsigned old_size = t->size, i, j;
+
+    if (t->used * 2 < t->size)
+        return true;
+
+    t->entries = ast_Alloc(old_size * 2 * sizeof(entry_t));
+    if (t->entries == NULL) {
+        t->entries = old;
+        return false;
+    }
+
+    t->size = old_size * 2;
+    memset(t->entries, 0, t->size * sizeof(entry_t));
+
+    for (i = 0; i < old_size; i++) {
+        if (old[i].node == NULL)
+            continue;
+
+        for (j = old[i].hash & (t->size - 1); t->entries[j].node != NULL; j = (j + 1) & (t->size - 1));
+        t->entries[j] = old[i];
+    }
+
+    ast_Free(old);
+    return true;
+}
+
+bool memo_Grow(memo_t *m) {
+    memo_entry_t *old = m->entries;
+    unsigned old_size = m->size, i, j;
+
+    if (m->used * 2 < m->size)
+        return true;
+
+    m->entries = ast_Alloc(old_size * 2 * sizeof(memo_entry_t));
+    if (m->entries == NULL) {
+        m->entries = old;
+        return false;
+    }
+
+    m->size = old_size * 2;
+    memset(m->entries, 0, m->size * sizeof(memo_entry_t));
+
+    for (i = 0; i < old_size; i++) {
+        if (old[i].from == NULL)
+            continue;
+
+        for (j = memo_slot(m, old[i].from); m->entries[j].from != NULL; j = (j + 1) & (m->size - 1));
+        m->entries[j] = old[i];
+    }
+
+    ast_Free(old);
+    return true;
+}
+
+//the node already in the table equal to e, or NULL after adding e
+ast_t *intern(table_t *t, ast_t *e, uint32_t hash) {
+    unsigned i = hash & (t->size - 1);
+
+    while (t->entries[i].node != NULL) {
+        if (t->entries[i].hash == hash && same_node(t->entries[i].node, e))
+            return t->entries[i].node;
+        i = (i + 1) & (t->size - 1);
+    }
+
+    t->entries[i].hash = hash;
+    t->entries[i].node = e;
+    t->used++;
+    return NULL;
+}
+
+memo_entry_t *memo_Find(memo_t *m, ast_t *e) {
+    unsigned i;
+
+    for (i = memo_slot(m, e); m->entries[i].from != NULL; i = (i + 1) & (m->size - 1)) {
+        if (m->entries[i].from == e)
+            return &m->entries[i];
+    }
+
+    return NULL;
+}
+
+void memo_Add(memo_t *m, ast_t *from, ast_t *to, uint32_t hash) {
+    unsigned i;
+
+    for (i = memo_slot(m, from); m->entries[i].from != NULL; i = (i + 1) & (m->size - 1));
+    m->entries[i].from = from;
+    m->entries[i].to = to;
+    m->entries[i].hash = hash;
+    m->used++;
+}
+
+//a node of the input waiting for its children to be shared
+typedef struct _Sharing {
+    ast_t *e;
+    bool expanded; //the children have been pushed
+} sharing_t;
+
+//a finished child and the hash of everything below it
+typedef struct _Shared {
+    ast_t *node;
+    uint32_t hash;
+} shared_t;
+
+//e rebuilt from its shared children, or e itself when they're the ones it already had
+ast_t *rebuild_shared(stack_t *results, ast_t *e, uint32_t *hash) {
+    uint32_t h = mix(2166136261u, e->type);
+    shared_t left, right;
+
+    switch (e->type) {
+    case NODE_NUMBER: {
+        uint16_t i;
+        for (i = 0; i < e->op.number.length; i++)
+            h = mix(h, num_Char(e->op.number, i));
+        *hash = h;
+        return ast_Copy(e);
+    } case NODE_SYMBOL:
+        *hash = mix(h, e->op.symbol);
+        return ast_Copy(e);
+    case NODE_UNARY:
+        left = *stack_PopOf(results, shared_t);
+        *hash = mix(mix(h, e->op.unary.operator), left.hash);
+
+        if (left.node == e->op.unary.operand) {
+            ast_Cleanup(left.node);
+            return ast_Copy(e);
+        }
+        return ast_MakeUnary(e->op.unary.operator, left.node);
+    case NODE_BINARY:
+        right = *stack_PopOf(results, shared_t);
+        left = *stack_PopOf(results, shared_t);
+        *hash = mix(mix(mix(h, e->op.binary.operator), left.hash), right.hash);
+
+        if (left.node == e->op.binary.left && right.node == e->op.binary.right) {
+            ast_Cleanup(left.node);
+            ast_Cleanup(right.node);
+            return ast_Copy(e);
+        }
+        return ast_MakeBinary(e->op.binary.operator, left.node, right.node);
+    }
+
+    return NULL;
+}
+
+ast_t *_cse(table_t *t, memo_t *m, ast_t *e, cse_stats_t *stats) {
+    stack_t visits, results;
+    sharing_t v;
+    shared_t result;
+    memo_entry_t *seen;
+    ast_t *existing;
+
+    stack_CreateOf(&visits, sharing_t);
+    stack_CreateOf(&results, shared_t);
+
+    v.e = e;
+    v.expanded = false;
+
+    if (!stack_PushOf(&visits, sharing_t, &v))
+        t->failed = true;
+
+    while (!t->failed && !stack_IsEmpty(&visits)) {
+        sharing_t *top = stack_PeekOf(&visits, sharing_t);
+
+        //a node seen before, through another parent, is already done
+        if (!top->expanded && (seen = memo_Find(m, top->e)) != NULL) {
+            stack_PopOf(&visits, sharing_t);
+
+            result.node = ast_Copy(seen->to);
+            result.hash = seen->hash;
+
+            if (!stack_PushOf(&results, shared_t, &result)) {
+                ast_Cleanup(result.node);
+                t->failed = true;
+            }
+            continue;
+        }
+
+        //the left child goes on top, so it's done first
+        if (!top->expanded && (top->e->type == NODE_UNARY || top->e->type == NODE_BINARY)) {
+            ast_t *parent = top->e;
+
+            top->expanded = true;
+            v.expanded = false;
+
+            if (parent->type == NODE_UNARY) {
+                v.e = parent->op.unary.operand;
+                t->failed = !stack_PushOf(&visits, sharing_t, &v);
+            } else {
+                v.e = parent->op.binary.right;
+                t->failed = !stack_PushOf(&visits, sharing_t, &v);
+                v.e = parent->op.binary.left;
+                t->failed = t->failed || !stack_PushOf(&visits, sharing_t, &v);
+            }
+            continue;
+        }
+
+        v = *stack_PopOf(&visits, sharing_t);
+        stats->nodes++;
+
+        result.node = rebuild_shared(&results, v.e, &result.hash);
+
+        if (result.node == NULL || !table_Grow(t) || !memo_Grow(m)) {
+            ast_Cleanup(result.node);
+            t->failed = true;
+            break;
+        }
+
+        existing = intern(t, result.node, result.hash);
+
+        if (existing == NULL) {
+            stats->unique++;
+        } else {
+            ast_Cleanup(result.node);
+            result.node = ast_Copy(existing);
+        }
+
+        memo_Add(m, v.e, result.node, result.hash);
+
+        if (!stack_PushOf(&results, shared_t, &result)) {
+            ast_Cleanup(result.node);
+            t->failed = true;
+        }
+    }
+
+    if (t->failed) {
+        shared_t *left;
+
+        while ((left = stack_PopOf(&results, shared_t)) != NULL)
+            ast_Cleanup(left->node);
+
+        stack_Cleanup(&visits);
+        stack_Cleanup(&results);
+        return NULL;
+    }
+
+    result = *stack_PopOf(&results, shared_t);
+
+    stack_Cleanup(&visits);
+    stack_Cleanup(&results);
+    return result.node;
+}
+
+ast_t *cse(ast_t *e, cse_stats_t *stats) {
+    table_t t;
+    memo_t m;
+    cse_stats_t dummy;
+    ast_t *ret;
+
+    if (stats == NULL)
+        stats = &dummy;
+
+    stats->nodes = stats->unique = 0;
+
+    t.size = m.size = TABLE_START_SIZE;
+    t.used = m.used = 0;
+    t.entries = ast_Alloc(t.size * sizeof(entry_t));
+    m.entries = ast_Alloc(m.size * sizeof(memo_entry_t));
+
+    if (t.entries == NULL || m.entries == NULL) {
+        ast_Free(t.entries);
+        ast_Free(m.entries);
+        return NULL;
+    }
+
+    memset(t.entries, 0, t.size * sizeof(entry_t));
+    memset(m.entries, 0, m.size * sizeof(memo_entry_t));
+    t.failed = false;
+
+    ret = _cse(&t, &m, e, stats);
+
+    ast_Free(t.entries);
+    ast_Free(m.entries);
+
+    return ret;
+}
@@ -0,0 +1,18 @@
+#ifndef _CSE_H_
+#define _CSE_H_
+
+#include "ast.h"
+
+//Common subexpression elimination. Rebuilds a tree so that structurally identical subtrees
+//are the same shared node, turning it into a DAG. ast_Compile then only computes each
+//shared node once.
+
+typedef struct _CseStats {
+    unsigned nodes; //distinct nodes in the tree it was given, a node shared in a DAG counts once
+    unsigned unique; //distinct nodes left after sharing
+} cse_stats_t;
+
+//returns NULL when out of memory. stats can be NULL
+ast_t *cse(ast_t *e, cse_stats_t *stats);
+
+#endif
@@ -0,0 +1,179 @@
+#ifdef _WIN32
+#define _USE_MATH_DEFINES
+#endif
+
+#include "dual.h"
+
+#include <math.h>
+
+#include "stack.h"
+
+#define depends_on(e, symbol) (analyze(e), (e)->symbols & symbol_bit(symbol))
+
+double dual_UnaryPartial(TokenType operator, double x, double result, Error *error) {
+    switch (operator) {
+    case TOK_NEGATE: return -1;
+    case TOK_RECRIPROCAL: return -1 / (x * x);
+    case TOK_SQUARE: return 2 * x;
+    case TOK_CUBE: return 3 * x * x;
+
+    case TOK_ABS: return x / fabs(x);
+
+    case TOK_SQRT: return 1 / (2 * result);
+    case TOK_CUBED_ROOT: return 1 / (3 * result * result);
+
+    case TOK_LN: return 1 / x;
+    case TOK_E_TO_POWER: return result;
+    case TOK_LOG: return 1 / (x * log(10));
+    case TOK_10_TO_POWER: return result * log(10);
+
+    case TOK_SIN: return cos(x);
+    case TOK_SIN_INV: return 1 / sqrt(1 - x * x);
+    case TOK_COS: return -sin(x);
+    case TOK_COS_INV: return -1 / sqrt(1 - x * x);
+    case TOK_TAN: return 1 / (cos(x) * cos(x));
+    case TOK_TAN_INV: return 1 / (1 + x * x);
+    case TOK_SINH: return cosh(x);
+    case TOK_SINH_INV: return 1 / sqrt(x * x + 1);
+    case TOK_COSH: return sinh(x);
+    case TOK_COSH_INV: return 1 / sqrt(x * x - 1);
+    case TOK_TANH: return 1 / (cosh(x) * cosh(x));
+    case TOK_TANH_INV: return 1 / (1 - x * x);
+
+    //int has no derivative where it depends on the symbol
+    case TOK_INT:
+        *error = E_DERIV_NOT_ALLOWED;
+        return 0;
+    }
+
+    *error = E_DERIV_UNIMPLEMENTED;
+    return 0;
+}
+
+void dual_BinaryPartials(TokenType operator, double left, double right, double result, double *d_left, double *d_right, Error *error) {
+    switch (operator) {
+    case TOK_ADD: *d_left = 1; *d_right = 1; return;
+    case TOK_SUBTRACT: *d_left = 1; *d_right = -1; return;
+    case TOK_MULTIPLY: *d_left = right; *d_right = left; return;
+    case TOK_DIVIDE:
+    case TOK_FRACTION:
+        *d_left = 1 / right;
+        *d_right = -left / (right * right);
+        return;
+    case TOK_POWER:
+        *d_left = right * pow(left, right - 1);
+        *d_right = result * log(left);
+        return;
+    case TOK_SCIENTIFIC:
+        *d_left = pow(10, right);
+        *d_right = result * log(10);
+        return;
+    case TOK_ROOT:
+        //left is the index, so this is right^(1/left)
+        *d_left = -result * log(right) / (left * left);
+        *d_right = pow(right, 1 / left - 1) / left;
+        return;
+    case TOK_LOG_BASE:
+        *d_left = 1 / (left * log(right));
+        *d_right = -result / (right * log(right));
+        return;
+    }
+
+    *d_left = *d_right = 0;
+    *error = E_DERIV_UNIMPLEMENTED;
+}
+
+#define is_leaf(e, symbol) (!depends_on(e, symbol) || (e)->type == NODE_SYMBOL)
+
+//same as derivative(), anything that doesn't depend on symbol has a derivative of 0. the only
+//symbol that does is symbol itself
+void leaf_dual(ast_t *e, const env_t *env, uint8_t symbol, dual_t *ret, Error *error) {
+    *error = evaluate_env(e, env, &ret->value);
+    ret->derivative = depends_on(e, symbol) ? 1 : 0;
+}
+
+//an operator waiting on the values and derivatives of its operands
+typedef struct _DualPending {
+    ast_t *e;
+    bool right; //the left side is in and the right side is being worked out
+    dual_t left;
+} dual_pending_t;
+
+void _evaluate_dual(ast_t *e, const env_t *env, uint8_t symbol, dual_t *ret, Error *error) {
+    stack_t pending;
+    dual_pending_t p;
+    dual_t x;
+
+    stack_CreateOf(&pending, dual_pending_t);
+
+    for (;;) {
+        //down the left side to something that can be worked out on its own
+        while (!is_leaf(e, symbol)) {
+            p.e = e;
+            p.right = false;
+
+            if (!stack_PushOf(&pending, dual_pending_t, &p)) {
+                *error = E_MEMORY;
+                stack_Cleanup(&pending);
+                return;
+            }
+
+            e = e->type == NODE_UNARY ? e->op.unary.operand : e->op.binary.left;
+        }
+
+        leaf_dual(e, env, symbol, &x, error);
+
+        //back up through the operators that have all they need now
+        for (;;) {
+            dual_pending_t *top = stack_PeekOf(&pending, dual_pending_t);
+            TokenType operator;
+
+            if (top == NULL || *error != E_SUCCESS) {
+                stack_Cleanup(&pending);
+                *ret = x;
+                return;
+            }
+
+            if (top->e->type == NODE_UNARY) {
+                double value;
+
+                operator = top->e->op.unary.operator;
+                value = evaluate_unary(operator, x.value);
+
+                x.derivative = dual_UnaryPartial(operator, x.value, value, error) * x.derivative;
+                x.value = value;
+            } else if (top->right) {
+                double value, d_left, d_right, derivative = 0;
+
+                operator = top->e->op.binary.operator;
+                value = evaluate_binary(operator, top->left.value, x.value);
+                dual_BinaryPartials(operator, top->left.value, x.value, value, &d_left, &d_right, error);
+
+                //a side that doesn't change is skipped, so x^2 still works for negative x when the
+                //partial for the exponent would need ln(x)
+                if (top->left.derivative != 0)
+                    derivative += d_left * top->left.derivative;
+                if (x.derivative != 0)
+                    derivative += d_right * x.derivative;
+
+                x.value = value;
+                x.derivative = derivative;
+            } else {
+                top->left = x;
+                top->right = true;
+                e = top->e->op.binary.right;
+                break;
+            }
+
+            stack_PopOf(&pending, dual_pending_t);
+        }
+    }
+}
+
+Error evaluate_dual(ast_t *e, const env_t *env, uint8_t symbol, dual_t *result) {
+    Error error = E_SUCCESS;
+
+    _evaluate_dual(e, env, symbol, result, &error);
+
+    return error;
+}
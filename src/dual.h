@@ -0,0 +1,25 @@
+#ifndef _DUAL_H_
+#define _DUAL_H_
+
+#include "ast.h"
+#include "cas.h"
+
+//Forward mode automatic differentiation. Instead of building the derivative tree, every node
+//evaluates to its value and its derivative with respect to one symbol at the same time, so
+//f'(x) costs about as much as f(x).
+
+typedef struct _Dual {
+    double value;
+    double derivative;
+} dual_t;
+
+//evaluates e and de/dsymbol with the variables from env, which must include symbol.
+//gives the same errors derivative() and evaluate_env() would
+Error evaluate_dual(ast_t *e, const env_t *env, uint8_t symbol, dual_t *result);
+
+//the derivative of one operator with respect to its operands, given the operands and the
+//result evaluate_unary/evaluate_binary gave. shared with the reverse mode tape
+double dual_UnaryPartial(TokenType operator, double x, double result, Error *error);
+void dual_BinaryPartials(TokenType operator, double left, double right, double result, double *d_left, double *d_right, Error *error);
+
+#endif
@@ -0,0 +1,69 @@
+#include "gradient.h"
+
+#include <string.h>
+
+#include "dual.h"
+
+Error tape_Record(ast_t *e, tape_t *t) {
+    Error error = ast_Compile(e, &t->program);
+
+    t->adjoints = NULL;
+
+    if (error != E_SUCCESS)
+        return error;
+
+    t->adjoints = ast_Alloc(t->program.amount_registers * sizeof(double));
+
+    if (t->adjoints == NULL) {
+        program_Cleanup(&t->program);
+        return E_MEMORY;
+    }
+
+    return E_SUCCESS;
+}
+
+void tape_Cleanup(tape_t *t) {
+    program_Cleanup(&t->program);
+    ast_Free(t->adjoints);
+    t->adjoints = NULL;
+}
+
+Error tape_Gradient(tape_t *t, const double *values, double *value, double *gradient) {
+    program_t *p = &t->program;
+    const double *r = p->registers;
+    double *adjoint = t->adjoints;
+    const instruction_t *i;
+    Error error = E_SUCCESS;
+
+    *value = program_Evaluate(p, values);
+
+    memset(adjoint, 0, p->amount_registers * sizeof(double));
+    adjoint[p->result] = 1;
+
+    //the program is in post order, so walking it backwards reaches every use of a register
+    //before the instruction that wrote it
+    for (i = p->instructions + p->amount_instructions; i-- > p->instructions;) {
+        double a = adjoint[i->dest];
+
+        //also keeps a NaN partial out of registers the result doesn't depend on
+        if (a == 0)
+            continue;
+
+        if (program_IsBinary(i->operator)) {
+            double d_left, d_right;
+
+            dual_BinaryPartials(i->operator, r[i->left], r[i->right], r[i->dest], &d_left, &d_right, &error);
+            adjoint[i->left] += a * d_left;
+            adjoint[i->right] += a * d_right;
+        } else {
+            adjoint[i->left] += a * dual_UnaryPartial(i->operator, r[i->left], r[i->dest], &error);
+        }
+
+        if (error != E_SUCCESS)
+            return error;
+    }
+
+    memcpy(gradient, adjoint, p->amount_symbols * sizeof(double));
+
+    return E_SUCCESS;
+}
@@ -0,0 +1,25 @@
+#ifndef _GRADIENT_H_
+#define _GRADIENT_H_
+
+#include "ast.h"
+#include "program.h"
+
+//Reverse mode automatic differentiation. The tree is recorded once onto a tape, which is the
+//compiled program plus an adjoint per register. Each point then takes one forward run of the
+//program and one backward sweep over it to get the partial derivative for every symbol.
+
+typedef struct _Tape {
+    program_t program;
+    double *adjoints; //one per register
+} tape_t;
+
+//values and gradient are indexed like program_Evaluate, the symbols are in t->program.symbols
+Error tape_Record(ast_t *e, tape_t *t);
+void tape_Cleanup(tape_t *t);
+
+//evaluates the tape at values, writing the result to value and d/dsymbols[i] to gradient[i].
+//E_DERIV_NOT_ALLOWED where the result depends on int(). like program_Evaluate, a tape can only
+//be used by one thread at a time
+Error tape_Gradient(tape_t *t, const double *values, double *value, double *gradient);
+
+#endif
@@ -0,0 +1,552 @@
+#include "nary.h"
+
+#include "cas.h"
+#include "rational.h"
+#include "stack.h"
+#include "system.h"
+
+//sums or products bigger than this are left alone
+#ifdef __TICE__
+#define NARY_MAX_FACTORS 24
+#define NARY_MAX_TERMS 12
+#else
+#define NARY_MAX_FACTORS 64
+#define NARY_MAX_TERMS 32
+#endif
+
+typedef struct _Factor {
+    ast_t *base; //borrowed from the tree being simplified
+    ratio_t exponent;
+} factor_t;
+
+typedef struct _Product {
+    ratio_t coefficient;
+    factor_t *factors;
+    uint8_t amount;
+} product_t;
+
+//all the terms share one pool of factors
+typedef struct _Sum {
+    factor_t pool[NARY_MAX_FACTORS];
+    uint8_t used;
+
+    product_t terms[NARY_MAX_TERMS];
+    uint8_t amount;
+} sum_t;
+
+#define is_sum(operator) ((operator) == TOK_ADD || (operator) == TOK_SUBTRACT)
+#define is_product(operator) ((operator) == TOK_MULTIPLY || (operator) == TOK_DIVIDE || (operator) == TOK_FRACTION)
+
+bool add_factor(product_t *p, unsigned capacity, ast_t *base, ratio_t exponent) {
+    uint8_t i;
+
+    for (i = 0; i < p->amount; i++) {
+        if (!ast_Compare(p->factors[i].base, base))
+            return ratio_Add(&p->factors[i].exponent, p->factors[i].exponent, exponent);
+    }
+
+    if (p->amount == capacity)
+        return false;
+
+    p->factors[p->amount].base = base;
+    p->factors[p->amount].exponent = exponent;
+    p->amount++;
+
+    return true;
+}
+
+//a part of a sum or product still to be collected, flipped when it's subtracted or divided by
+typedef struct _Part {
+    ast_t *e;
+    bool flip;
+} part_t;
+
+//multiplies e, or 1/e when inverse is set, into p, for anything that isn't a constant or
+//itself a product. powers of powers are taken apart all the way down, so ((X+1)^5)^2 is
+//grouped with (X+1)^4 as (X+1)^10
+bool collect_factor(product_t *p, unsigned capacity, ast_t *e, bool inverse) {
+    ratio_t exponent, c;
+
+    exponent.num = inverse ? -1 : 1;
+    exponent.den = 1;
+    exponent.decimal = false;
+
+    //once the exponent would get too big, what's left is the base
+    for (;;) {
+        ast_t *base;
+
+        if (e->type == NODE_UNARY && (e->op.unary.operator == TOK_SQUARE || e->op.unary.operator == TOK_CUBE)) {
+            ratio_Make(&c, e->op.unary.operator == TOK_SQUARE ? 2 : 3, 1);
+            base = e->op.unary.operand;
+        } else if (e->type == NODE_BINARY && e->op.binary.operator == TOK_POWER && ratio_FromAst(e->op.binary.right, &c)) {
+            base = e->op.binary.left;
+        } else {
+            break;
+        }
+
+        if (!ratio_Mul(&c, exponent, c))
+            break;
+
+        exponent = c;
+        e = base;
+    }
+
+    return add_factor(p, capacity, e, exponent);
+}
+
+//multiplies e, or 1/e when inverse is set, into p. walks the products left to right so the
+//factors come in the same order they're written in
+bool collect_factors(product_t *p, unsigned capacity, ast_t *e, bool inverse) {
+    stack_t parts;
+    part_t part;
+    ratio_t c;
+    bool ok;
+
+    stack_CreateOf(&parts, part_t);
+
+    part.e = e;
+    part.flip = inverse;
+
+    for (;;) {
+        e = part.e;
+
+        if (ratio_FromAst(e, &c)) {
+            ok = part.flip ? ratio_Div(&p->coefficient, p->coefficient, c) : ratio_Mul(&p->coefficient, p->coefficient, c);
+        } else if (e->type == NODE_UNARY && e->op.unary.operator == TOK_NEGATE) {
+            p->coefficient.num = -p->coefficient.num;
+            part.e = e->op.unary.operand;
+            continue;
+        } else if (e->type == NODE_UNARY && e->op.unary.operator == TOK_RECRIPROCAL) {
+            part.e = e->op.unary.operand;
+            part.flip = !part.flip;
+            continue;
+        } else if (e->type == NODE_BINARY && is_product(e->op.binary.operator)) {
+            part_t right;
+
+            right.e = e->op.binary.right;
+            right.flip = e->op.binary.operator == TOK_MULTIPLY ? part.flip : !part.flip;
+
+            ok = stack_PushOf(&parts, part_t, &right);
+            if (!ok)
+                break;
+
+            part.e = e->op.binary.left;
+            continue;
+        } else {
+            ok = collect_factor(p, capacity, e, part.flip);
+        }
+
+        if (!ok || stack_IsEmpty(&parts))
+            break;
+
+        part = *stack_PopOf(&parts, part_t);
+    }
+
+    stack_Cleanup(&parts);
+    return ok;
+}
+
+//higher powers of the same base first, so polynomials come out in the usual order
+int compare_factors(const factor_t *a, const factor_t *b) {
+    int order = ast_Compare(a->base, b->base);
+    return order != 0 ? order : ratio_Compare(b->exponent, a->exponent);
+}
+
+//drops x^0 and sorts what's left by base
+void normalize_product(product_t *p) {
+    uint8_t i, j, kept = 0;
+
+    for (i = 0; i < p->amount; i++) {
+        if (p->factors[i].exponent.num != 0)
+            p->factors[kept++] = p->factors[i];
+    }
+    p->amount = kept;
+
+    for (i = 1; i < p->amount; i++) {
+        factor_t f = p->factors[i];
+
+        for (j = i; j > 0 && compare_factors(&p->factors[j - 1], &f) > 0; j--)
+            p->factors[j] = p->factors[j - 1];
+        p->factors[j] = f;
+    }
+}
+
+//orders terms by their factors, with the constant term last
+int compare_terms(const product_t *a, const product_t *b) {
+    uint8_t i;
+
+    if (a->amount == 0 || b->amount == 0)
+        return (a->amount == 0) - (b->amount == 0);
+
+    for (i = 0; i < a->amount && i < b->amount; i++) {
+        int order = compare_factors(&a->factors[i], &b->factors[i]);
+        if (order != 0)
+            return order;
+    }
+
+    return (int)a->amount - b->amount;
+}
+
+//adds e, or -e when negative is set, to s, for anything that isn't itself a sum
+bool collect_term(sum_t *s, ast_t *e, bool negative) {
+    product_t *term;
+    uint8_t i;
+
+    if (s->amount == NARY_MAX_TERMS)
+        return false;
+
+    term = &s->terms[s->amount];
+    term->coefficient.num = negative ? -1 : 1;
+    term->coefficient.den = 1;
+    term->coefficient.decimal = false;
+    term->factors = &s->pool[s->used];
+    term->amount = 0;
+
+    if (!collect_factors(term, NARY_MAX_FACTORS - s->used, e, false))
+        return false;
+
+    normalize_product(term);
+
+    //like terms only differ in their coefficient
+    for (i = 0; i < s->amount; i++) {
+        if (s->terms[i].amount == term->amount && !compare_terms(&s->terms[i], term))
+            return ratio_Add(&s->terms[i].coefficient, s->terms[i].coefficient, term->coefficient);
+    }
+
+    s->used += term->amount;
+    s->amount++;
+
+    return true;
+}
+
+//adds e, or -e when negative is set, to s, left to right like collect_factors
+bool collect_terms(sum_t *s, ast_t *e, bool negative) {
+    stack_t parts;
+    part_t part;
+    bool ok;
+
+    stack_CreateOf(&parts, part_t);
+
+    part.e = e;
+    part.flip = negative;
+
+    for (;;) {
+        e = part.e;
+
+        if (e->type == NODE_UNARY && e->op.unary.operator == TOK_NEGATE) {
+            part.e = e->op.unary.operand;
+            part.flip = !part.flip;
+            continue;
+        }
+
+        if (e->type == NODE_BINARY && is_sum(e->op.binary.operator)) {
+            part_t right;
+
+            right.e = e->op.binary.right;
+            right.flip = e->op.binary.operator == TOK_ADD ? part.flip : !part.flip;
+
+            ok = stack_PushOf(&parts, part_t, &right);
+            if (!ok)
+                break;
+
+            part.e = e->op.binary.left;
+            continue;
+        }
+
+        ok = collect_term(s, e, part.flip);
+        if (!ok || stack_IsEmpty(&parts))
+            break;
+
+        part = *stack_PopOf(&parts, part_t);
+    }
+
+    stack_Cleanup(&parts);
+    return ok;
+}
+
+//The rebuilt form is checked against the tree before anything is allocated, so that an
+//already canonical sum or product doesn't cost a throwaway copy of itself.
+
+//a factor with a positive exponent, or a whole number when base is NULL
+typedef factor_t item_t;
+
+//the calculator has its own tokens for squares and cubes
+ast_t *make_item(const item_t *item) {
+    if (item->base == NULL)
+        return ratio_ToAst(item->exponent);
+
+    if (item->exponent.den == 1) {
+        switch (item->exponent.num) {
+        case 1: return ast_Copy(item->base);
+        case 2: return ast_MakeUnary(TOK_SQUARE, ast_Copy(item->base));
+        case 3: return ast_MakeUnary(TOK_CUBE, ast_Copy(item->base));
+        }
+    }
+
+    return ast_MakeBinary(TOK_POWER, ast_Copy(item->base), ratio_ToAst(item->exponent));
+}
+
+bool is_ratio(ast_t *e, ratio_t r) {
+    rational_t value;
+
+    rational_FromInt32(&value, r.num, r.den);
+    value.decimal = r.decimal;
+    return rational_IsCanonical(e, &value);
+}
+
+bool match_item(ast_t *e, const item_t *item) {
+    if (item->base == NULL)
+        return is_ratio(e, item->exponent);
+
+    if (item->exponent.den == 1) {
+        switch (item->exponent.num) {
+        case 1:
+            return !ast_Compare(e, item->base);
+        case 2:
+        case 3:
+            return e->type == NODE_UNARY
+                && e->op.unary.operator == (item->exponent.num == 2 ? TOK_SQUARE : TOK_CUBE)
+                && !ast_Compare(e->op.unary.operand, item->base);
+        }
+    }
+
+    return e->type == NODE_BINARY && e->op.binary.operator == TOK_POWER
+        && !ast_Compare(e->op.binary.left, item->base)
+        && is_ratio(e->op.binary.right, item->exponent);
+}
+
+//items multiplied left to right, 1 when there aren't any
+ast_t *make_chain(const item_t *items, uint8_t amount) {
+    ast_t *ret;
+    uint8_t i;
+
+    if (amount == 0) {
+        ratio_t one = { 1, 1, false };
+        return ratio_ToAst(one);
+    }
+
+    ret = make_item(&items[0]);
+    for (i = 1; i < amount; i++)
+        ret = ast_MakeBinary(TOK_MULTIPLY, ret, make_item(&items[i]));
+
+    return ret;
+}
+
+bool match_chain(ast_t *e, const item_t *items, uint8_t amount) {
+    if (amount == 0) {
+        ratio_t one = { 1, 1, false };
+        return is_ratio(e, one);
+    }
+
+    if (amount == 1)
+        return match_item(e, &items[0]);
+
+    return e->type == NODE_BINARY && e->op.binary.operator == TOK_MULTIPLY
+        && match_chain(e->op.binary.left, items, amount - 1)
+        && match_item(e->op.binary.right, &items[amount - 1]);
+}
+
+//coefficient first, then the factors. anything with a negative exponent goes under a fraction
+typedef struct _Layout {
+    item_t numerator[NARY_MAX_FACTORS + 1];
+    uint8_t amount_numerator;
+    item_t denominator[NARY_MAX_FACTORS + 1];
+    uint8_t amount_denominator;
+} layout_t;
+
+//these are too big for the calculator's stack, so they live here instead. nary_Simplify
+//never runs inside itself, and only one product is laid out at a time
+typedef struct _Scratch {
+    sum_t sum;
+    factor_t factors[NARY_MAX_FACTORS];
+    layout_t layout;
+} scratch_t;
+
+static THREAD_LOCAL scratch_t scratch;
+
+void layout_product(const product_t *p, layout_t *l) {
+    ratio_t c = p->coefficient;
+    uint8_t i;
+
+    l->amount_numerator = l->amount_denominator = 0;
+
+    if (c.num < 0)
+        c.num = -c.num;
+
+    //a decimal stays one number in front, 0.25X rather than X/4
+    if (c.decimal && c.den != 1) {
+        item_t *item = &l->numerator[l->amount_numerator++];
+        item->base = NULL;
+        item->exponent = c;
+        c.num = c.den = 1;
+    }
+
+    if (c.num != 1) {
+        item_t *item = &l->numerator[l->amount_numerator++];
+        item->base = NULL;
+        item->exponent.num = c.num;
+        item->exponent.den = 1;
+        item->exponent.decimal = false;
+    }
+
+    if (c.den != 1) {
+        item_t *item = &l->denominator[l->amount_denominator++];
+        item->base = NULL;
+        item->exponent.num = c.den;
+        item->exponent.den = 1;
+        item->exponent.decimal = false;
+    }
+
+    for (i = 0; i < p->amount; i++) {
+        if (p->factors[i].exponent.num > 0) {
+            l->numerator[l->amount_numerator++] = p->factors[i];
+        } else {
+            item_t *item = &l->denominator[l->amount_denominator++];
+            *item = p->factors[i];
+            item->exponent.num = -item->exponent.num;
+        }
+    }
+}
+
+ast_t *make_product(const product_t *p) {
+    layout_t *l = &scratch.layout;
+    ast_t *ret;
+
+    if (p->coefficient.num == 0 || p->amount == 0)
+        return ratio_ToAst(p->coefficient);
+
+    layout_product(p, l);
+
+    ret = make_chain(l->numerator, l->amount_numerator);
+    if (l->amount_denominator > 0)
+        ret = ast_MakeBinary(TOK_FRACTION, ret, make_chain(l->denominator, l->amount_denominator));
+
+    return p->coefficient.num < 0 ? ast_MakeUnary(TOK_NEGATE, ret) : ret;
+}
+
+bool match_product(ast_t *e, const product_t *p) {
+    layout_t *l = &scratch.layout;
+
+    if (p->coefficient.num == 0 || p->amount == 0)
+        return is_ratio(e, p->coefficient);
+
+    if (p->coefficient.num < 0) {
+        if (e->type != NODE_UNARY || e->op.unary.operator != TOK_NEGATE)
+            return false;
+        e = e->op.unary.operand;
+    }
+
+    layout_product(p, l);
+
+    if (l->amount_denominator == 0)
+        return match_chain(e, l->numerator, l->amount_numerator);
+
+    return e->type == NODE_BINARY && e->op.binary.operator == TOK_FRACTION
+        && match_chain(e->op.binary.left, l->numerator, l->amount_numerator)
+        && match_chain(e->op.binary.right, l->denominator, l->amount_denominator);
+}
+
+//sorts the terms and drops the ones that cancelled out
+void layout_sum(sum_t *s) {
+    uint8_t i, j, kept = 0;
+
+    for (i = 0; i < s->amount; i++) {
+        if (s->terms[i].coefficient.num != 0)
+            s->terms[kept++] = s->terms[i];
+    }
+    s->amount = kept;
+
+    for (i = 1; i < s->amount; i++) {
+        product_t term = s->terms[i];
+
+        for (j = i; j > 0 && compare_terms(&s->terms[j - 1], &term) > 0; j--)
+            s->terms[j] = s->terms[j - 1];
+        s->terms[j] = term;
+    }
+}
+
+//terms after the first carry their sign on the + or - instead
+product_t unsigned_term(const product_t *term) {
+    product_t ret = *term;
+
+    if (ret.coefficient.num < 0)
+        ret.coefficient.num = -ret.coefficient.num;
+
+    return ret;
+}
+
+ast_t *make_sum(const sum_t *s) {
+    ast_t *ret;
+    uint8_t i;
+
+    if (s->amount == 0) {
+        ratio_t zero = { 0, 1, false };
+        return ratio_ToAst(zero);
+    }
+
+    ret = make_product(&s->terms[0]);
+
+    for (i = 1; i < s->amount; i++) {
+        product_t term = unsigned_term(&s->terms[i]);
+        ret = ast_MakeBinary(s->terms[i].coefficient.num < 0 ? TOK_SUBTRACT : TOK_ADD, ret, make_product(&term));
+    }
+
+    return ret;
+}
+
+//walks down the left side of the sum from the last term, the way make_sum built it up
+bool match_sum(ast_t *e, const sum_t *s) {
+    uint8_t amount = s->amount;
+
+    if (amount == 0) {
+        ratio_t zero = { 0, 1, false };
+        return is_ratio(e, zero);
+    }
+
+    for (; amount > 1; amount--) {
+        product_t term = unsigned_term(&s->terms[amount - 1]);
+
+        if (e->type != NODE_BINARY
+            || e->op.binary.operator != (s->terms[amount - 1].coefficient.num < 0 ? TOK_SUBTRACT : TOK_ADD)
+            || !match_product(e->op.binary.right, &term))
+            return false;
+
+        e = e->op.binary.left;
+    }
+
+    return match_product(e, &s->terms[0]);
+}
+
+ast_t *nary_Simplify(ast_t *e) {
+    if (e->type != NODE_BINARY)
+        return NULL;
+
+    if (is_sum(e->op.binary.operator)) {
+        sum_t *s = &scratch.sum;
+
+        s->used = s->amount = 0;
+
+        if (!collect_terms(s, e, false))
+            return NULL;
+
+        layout_sum(s);
+        return match_sum(e, s) ? NULL : make_sum(s);
+    }
+
+    if (is_product(e->op.binary.operator)) {
+        product_t p;
+
+        p.coefficient.num = p.coefficient.den = 1;
+        p.coefficient.decimal = false;
+        p.factors = scratch.factors;
+        p.amount = 0;
+
+        if (!collect_factors(&p, NARY_MAX_FACTORS, e, false))
+            return NULL;
+
+        normalize_product(&p);
+        return match_product(e, &p) ? NULL : make_product(&p);
+    }
+
+    return NULL;
+}
@@ -0,0 +1,16 @@
+#ifndef _NARY_H_
+#define _NARY_H_
+
+#include "ast.h"
+
+//Sums and products looked at as a whole instead of one binary node at a time. A chain of
+//+ and - is flattened into terms, and a chain of *, / and fractions into a coefficient and
+//factors raised to exact powers. Like terms and like factors are merged, constants are
+//multiplied out, identities are dropped, and the result is rebuilt as binary nodes in a
+//canonical order so the same sum or product always comes out the same way.
+
+//NULL when e isn't a sum or product, is already canonical, or has too many operands or
+//constants too large to handle here
+ast_t *nary_Simplify(ast_t *e);
+
+#endif
@@ -1,6 +1,7 @@
 #include "parser.h"
 
 #include <stdlib.h>
+#include <string.h>
 
 #include "stack.h"
 
@@ -56,10 +57,11 @@ void tokenizer_Cleanup(tokenizer_t *t) {
         if(t->tokens[i].type == TOK_NUMBER)
             num_Cleanup(t->tokens[i].op.number);
     }
-}
 
-#define is_num(byte) ((byte >= 0x30 && byte <= 0x39) || byte == CHAR_PERIOD) /*'0' through '.'*/
-#define is_one_byte_symbol(byte) ((byte >= 'A' && byte <= 'Z') || byte == SYMBOL_THETA || byte ==  SYMBOL_PI) /*A through Z, theta, pi. does not include 'e'*/
+    ast_Free(t->tokens);
+    t->tokens = NULL;
+    t->amount = 0;
+}
 
 #define is_tok_binary_operator(tok) (tok >= TOK_ADD && tok <= TOK_ROOT)
 #define is_tok_unary_operator(tok) (tok >= TOK_NEGATE && tok <= TOK_CUBE)
@@ -86,147 +88,228 @@ bool is_ast_function(ast_t *e) {
     return false;
 }
 
-//algorithm that returns a token by using the identifiers array
-TokenType read_identifier(const uint8_t *equation, unsigned index, unsigned length) {
-    unsigned identifier_index;
-    //skip tok_number and tok_symbol
-    for(identifier_index = TOK_ADD; identifier_index < AMOUNT_TOKENS; identifier_index++) {
+//What each byte can start, so a token is found with one or two table lookups instead of a search
+//through identifiers. These have to agree with the bytes in identifiers.
+enum {
+    BYTE_INVALID, //0 so every byte that isn't listed is invalid
+    BYTE_NUMBER,
+    BYTE_SYMBOL,
 
-        identifier_t current = identifiers[identifier_index];
-        bool equal = true;
-        unsigned i;
-
-        //if there's not enough characters left for this token
-        //ex. there is only 1 byte left, but it's a 2 byte token
-        if(length - index < current.length)
-            continue;
+    //the first byte of a 2 byte token, the second byte is looked up in second_byte
+    BYTE_PREFIX_EF,
+    BYTE_PREFIX_BB,
 
-        //check if all the bytes match
-        for (i = index; i < index + current.length; i++) {
-            equal &= equation[i] == current.bytes[i - index];
+    //single byte tokens are stored as BYTE_TOKEN + their TokenType
+    BYTE_TOKEN
+};
 
-            if (!equal) break;
-        }
+#define as_token(type) (BYTE_TOKEN + (type))
+
+static const uint8_t first_byte[256] = {
+    ['0'] = BYTE_NUMBER,
+    ['1'] = BYTE_NUMBER,
+    ['2'] = BYTE_NUMBER,
+    ['3'] = BYTE_NUMBER,
+    ['4'] = BYTE_NUMBER,
+    ['5'] = BYTE_NUMBER,
+    ['6'] = BYTE_NUMBER,
+    ['7'] = BYTE_NUMBER,
+    ['8'] = BYTE_NUMBER,
+    ['9'] = BYTE_NUMBER,
+    [CHAR_PERIOD] = BYTE_NUMBER,
+
+    ['A'] = BYTE_SYMBOL,
+    ['B'] = BYTE_SYMBOL,
+    ['C'] = BYTE_SYMBOL,
+    ['D'] = BYTE_SYMBOL,
+    ['E'] = BYTE_SYMBOL,
+    ['F'] = BYTE_SYMBOL,
+    ['G'] = BYTE_SYMBOL,
+    ['H'] = BYTE_SYMBOL,
+    ['I'] = BYTE_SYMBOL,
+    ['J'] = BYTE_SYMBOL,
+    ['K'] = BYTE_SYMBOL,
+    ['L'] = BYTE_SYMBOL,
+    ['M'] = BYTE_SYMBOL,
+    ['N'] = BYTE_SYMBOL,
+    ['O'] = BYTE_SYMBOL,
+    ['P'] = BYTE_SYMBOL,
+    ['Q'] = BYTE_SYMBOL,
+    ['R'] = BYTE_SYMBOL,
+    ['S'] = BYTE_SYMBOL,
+    ['T'] = BYTE_SYMBOL,
+    ['U'] = BYTE_SYMBOL,
+    ['V'] = BYTE_SYMBOL,
+    ['W'] = BYTE_SYMBOL,
+    ['X'] = BYTE_SYMBOL,
+    ['Y'] = BYTE_SYMBOL,
+    ['Z'] = BYTE_SYMBOL,
+    [SYMBOL_THETA] = BYTE_SYMBOL,
+    [SYMBOL_PI] = BYTE_SYMBOL,
+
+    [0xEF] = BYTE_PREFIX_EF,
+    [0xBB] = BYTE_PREFIX_BB,
+
+    [0x70] = as_token(TOK_ADD),
+    [0x71] = as_token(TOK_SUBTRACT),
+    [0x82] = as_token(TOK_MULTIPLY),
+    [0x83] = as_token(TOK_DIVIDE),
+    [0xF0] = as_token(TOK_POWER),
+    [0x3B] = as_token(TOK_SCIENTIFIC),
+    [0xF1] = as_token(TOK_ROOT),
+
+    [0xB0] = as_token(TOK_NEGATE),
+    [0x0C] = as_token(TOK_RECRIPROCAL),
+    [0x0D] = as_token(TOK_SQUARE),
+    [0x0F] = as_token(TOK_CUBE),
+
+    [0xB1] = as_token(TOK_INT),
+    [0xB2] = as_token(TOK_ABS),
+    [0xBC] = as_token(TOK_SQRT),
+    [0xBD] = as_token(TOK_CUBED_ROOT),
+    [0xBE] = as_token(TOK_LN),
+    [0xBF] = as_token(TOK_E_TO_POWER),
+    [0xC0] = as_token(TOK_LOG),
+    [0xC1] = as_token(TOK_10_TO_POWER),
+    [0xC2] = as_token(TOK_SIN),
+    [0xC3] = as_token(TOK_SIN_INV),
+    [0xC4] = as_token(TOK_COS),
+    [0xC5] = as_token(TOK_COS_INV),
+    [0xC6] = as_token(TOK_TAN),
+    [0xC7] = as_token(TOK_TAN_INV),
+    [0xC8] = as_token(TOK_SINH),
+    [0xC9] = as_token(TOK_SINH_INV),
+    [0xCA] = as_token(TOK_COSH),
+    [0xCB] = as_token(TOK_COSH_INV),
+    [0xCC] = as_token(TOK_TANH),
+    [0xCD] = as_token(TOK_TANH_INV),
+
+    [0x10] = as_token(TOK_OPEN_PAR),
+    [0x11] = as_token(TOK_CLOSE_PAR),
+    [0x2B] = as_token(TOK_COMMA)
+};
 
-        if(equal)
-            return current.token_type;
+//indexed by the prefix's BYTE_PREFIX_ value, then the second byte
+static const uint8_t second_byte[2][256] = {
+    //0xEF
+    {
+        [0x2E] = as_token(TOK_FRACTION),
+        [0x34] = as_token(TOK_LOG_BASE)
+    },
+    //0xBB
+    {
+        [0x31] = BYTE_SYMBOL //e
     }
+};
 
-    return TOK_ERROR;
-}
-
+//numbers are read in place. the token and the node parsed from it only borrow the equation
 num_t read_num(const uint8_t *equation, unsigned index, unsigned length) {
-    num_t num;
-
-    unsigned size = 0;
     unsigned i;
 
-    for (i = index; i < length; i++) {
-        if (is_num(equation[i])) size++;
-        else break;
-    }
+    for (i = index; i < length && first_byte[equation[i]] == BYTE_NUMBER; i++);
 
-    num.length = size;
-    num.number = malloc(size);
-    
-    for (i = 0; i < size; i++) {
-        num.number[i] = equation[i + index] == CHAR_PERIOD ? '.' : equation[i + index];
-    }
-
-    return num;
+    return num_Borrow(&equation[index], (uint16_t)(i - index));
 }
 
-uint8_t read_symbol(const uint8_t *equation, unsigned index, unsigned length, unsigned *symbol_length) {
-    
-    if (is_one_byte_symbol(equation[index])) {
-        if(symbol_length != NULL)
-            *symbol_length = 1;
-        return equation[index];
-    }
-    else if (equation[index] == 0xBB //extension code for 'e'
-        && index + 1 < length && equation[index + 1] == 0x31) {  //code for 'e'
-        if(symbol_length != NULL)
-            *symbol_length = 2;
-        return SYMBOL_E;
+//Every token is at least one byte, so the tokens array starts out as big as the equation up to
+//this many tokens, which covers any normal equation in one allocation. Past that it doubles
+//whenever it fills up, never going past the length of the equation.
+#define TOKENS_START_MAX 256
+
+bool add_token_to(tokenizer_t *t, unsigned *capacity, unsigned length, token_t *tok) {
+    if (t->amount >= *capacity) {
+        unsigned grown_capacity = *capacity * 2 < length ? *capacity * 2 : length;
+        token_t *grown = ast_Alloc(grown_capacity * sizeof(token_t));
+
+        if (grown == NULL)
+            return false;
+
+        memcpy(grown, t->tokens, t->amount * sizeof(token_t));
+        ast_Free(t->tokens);
+
+        t->tokens = grown;
+        *capacity = grown_capacity;
     }
 
-    return SYMBOL_ERROR;
+    t->tokens[t->amount++] = *tok;
+    return true;
 }
 
-token_t read_token(const uint8_t *equation, unsigned index, unsigned length, unsigned *consumed) {
-    token_t tok;
-    char c = equation[index];
+//reads the token starting at *index and moves *index past it
+Error read_token(const uint8_t *equation, unsigned length, unsigned *index, token_t *tok) {
+    unsigned i = *index;
+    uint8_t byte = first_byte[equation[i]];
 
-    *consumed = 0;
+    if (byte == BYTE_PREFIX_EF || byte == BYTE_PREFIX_BB) {
+        byte = i + 1 < length ? second_byte[byte - BYTE_PREFIX_EF][equation[i + 1]] : BYTE_INVALID;
 
-    if (is_num(c)) {
-        tok.type = TOK_NUMBER;
-        tok.op.number = read_num(equation, index, length);
+        //the only 2 byte symbol is e
+        if (byte == BYTE_SYMBOL) {
+            tok->type = TOK_SYMBOL;
+            tok->op.symbol = SYMBOL_E;
+        }
+        else {
+            tok->type = (TokenType)(byte - BYTE_TOKEN);
+        }
 
-        *consumed = tok.op.number.length;
+        i += 2;
     }
-    else if (read_symbol(equation, index, length, NULL) != SYMBOL_ERROR) {
-        uint8_t symbol;
-        unsigned symbol_length;
-
-        symbol = read_symbol(equation, index, length, &symbol_length);
+    else if (byte == BYTE_NUMBER) {
+        //have to separate these lines due to a compiler error lol
+        num_t num = read_num(equation, i, length);
 
-        tok.type = TOK_SYMBOL;
-        tok.op.symbol = symbol;
+        tok->type = TOK_NUMBER;
+        tok->op.number = num;
 
-        *consumed = symbol_length;
+        i += num.length;
+    }
+    else if (byte == BYTE_SYMBOL) {
+        tok->type = TOK_SYMBOL;
+        tok->op.symbol = equation[i];
+        i++;
     }
     else {
-        tok.type = read_identifier(equation, index, length);
-
-        *consumed = tok.type == TOK_ERROR ? 1 : identifiers[tok.type].length;
+        tok->type = (TokenType)(byte - BYTE_TOKEN);
+        i++;
     }
 
-    return tok;
-}
+    //at index *index
+    if (byte == BYTE_INVALID)
+        return E_TOK_UNIDENTIFIED;
 
-unsigned _tokenize(token_t *tokens, const uint8_t *equation, unsigned length, Error *error) {
-    unsigned token_index = 0;
-    unsigned i;
+    *index = i;
+    return E_SUCCESS;
+}
 
-    for(i = 0; i < length; i++) {
-        unsigned consumed;
-        
-        //have to separate these lines due to a compiler error lol
-        token_t tok;
-        tok = read_token(equation, i, length, &consumed);
-
-        if(tok.type == TOK_NUMBER) {
-            if (tokens == NULL)
-                num_Cleanup(tok.op.number);
-        } else if(tok.type == TOK_ERROR) {
-            *error = E_TOK_UNIDENTIFIED;
-            //at index i.
-            return 0;
-        }
+Error tokenize(tokenizer_t *t, const uint8_t *equation, unsigned length) {
+    unsigned capacity = length < TOKENS_START_MAX ? length : TOKENS_START_MAX;
+    unsigned i = 0;
 
-        if(tokens != NULL)
-            tokens[token_index] = tok;
-        token_index++;
+    if (capacity == 0)
+        capacity = 1;
 
-        i += consumed - 1;
-    }
+    t->amount = 0;
+    t->tokens = ast_Alloc(capacity * sizeof(token_t));
 
-    return token_index;
-}
+    if (t->tokens == NULL)
+        return E_MEMORY;
 
-Error tokenize(tokenizer_t *t, const uint8_t *equation, unsigned length) {
-    Error error = E_SUCCESS;
+    while (i < length) {
+        token_t tok;
+        Error error = read_token(equation, length, &i, &tok);
 
-    t->amount = _tokenize(NULL, equation, length, &error);
-    
-    if(error != E_SUCCESS)
-        return error;
+        if (error != E_SUCCESS) {
+            tokenizer_Cleanup(t);
+            return error;
+        }
 
-    t->tokens = malloc(t->amount * sizeof(token_t));
-    _tokenize(t->tokens, equation, length, &error);
+        if (!add_token_to(t, &capacity, length, &tok)) {
+            tokenizer_Cleanup(t);
+            return E_MEMORY;
+        }
+    }
 
-    return error;
+    return E_SUCCESS;
 }
 
 uint8_t precedence(TokenType type) {
@@ -263,144 +346,347 @@ uint8_t precedence_node(ast_t *e) {
     }
 }
 
-bool collapse_precedence(stack_t *operators, stack_t *expressions, TokenType type) {
-    while(operators->top > 0
-        && ((type == TOK_CLOSE_PAR && ((token_t*)stack_Peek(operators))->type != TOK_OPEN_PAR)
-        || (type == TOK_COMMA && !is_tok_binary_function(((token_t*)stack_Peek(operators))->type))
-        || (type != TOK_CLOSE_PAR && type != TOK_COMMA && precedence(((token_t*)stack_Peek(operators))->type) >= precedence(type)))) {
+//Whether or not we should insert a multiply operator for a symbol/number with the next token. For example: 5(2 + 3) and 5x
+bool should_multiply_by_next_token(token_t *next) {
+    return !is_tok_binary_operator(next->type)
+        && (!is_tok_unary_operator(next->type) || (is_tok_unary_operator(next->type) && identifiers[next->type].direction == LEFT))
+        && next->type != TOK_CLOSE_PAR && next->type != TOK_COMMA;
+}
+
+//Hands the parser one token at a time, either read straight from the equation or from tokens
+//made earlier by tokenize, so parsing never needs the whole token array.
+typedef struct _Lexer {
+    const uint8_t *equation;
+    unsigned length;
 
-        token_t *op = stack_Pop(operators);
+    const token_t *tokens; //NULL when reading the equation
+    unsigned amount;
 
-        if(identifiers[op->type].node_type == NODE_BINARY) {
-            ast_t *e2 = stack_Pop(expressions);
-            ast_t *e1 = stack_Pop(expressions);
+    unsigned index; //into equation or tokens, past the peeked token
 
-            if (e1 == NULL || e1 == NULL)
-                return false;
+    bool peeked;
+    token_t next;
 
-            stack_Push(expressions, ast_MakeBinary(op->type, e1, e2));
-        } else if(identifiers[op->type].node_type == NODE_UNARY) {
-            ast_t *e = stack_Pop(expressions);
+    Error *error;
+} lexer_t;
 
-            if (e == NULL)
-                return false;
+//the next token without using it up. NULL at the end of the equation or when it can't be read
+token_t *lexer_Peek(lexer_t *l) {
+    if (l->peeked)
+        return &l->next;
 
-            stack_Push(expressions, ast_MakeUnary(op->type, e));
+    if (l->tokens != NULL) {
+        if (l->index >= l->amount)
+            return NULL;
+        l->next = l->tokens[l->index++];
+    }
+    else {
+        Error error;
+
+        if (l->index >= l->length)
+            return NULL;
+
+        error = read_token(l->equation, l->length, &l->index, &l->next);
+
+        if (error != E_SUCCESS) {
+            *l->error = error;
+            return NULL;
         }
     }
 
-    return true;
+    l->peeked = true;
+    return &l->next;
 }
 
-bool collapse(stack_t *operators, stack_t *expressions) {
-    return collapse_precedence(operators, expressions, 0);
+void lexer_Next(lexer_t *l) {
+    l->peeked = false;
 }
 
-//Whether or not we should insert a multiply operator for a symbol/number with the next token. For example: 5(2 + 3) and 5x
-bool should_multiply_by_next_token(token_t *next) {
-    return !is_tok_binary_operator(next->type)
-        && (!is_tok_unary_operator(next->type) || (is_tok_unary_operator(next->type) && identifiers[next->type].direction == LEFT))
-        && next->type != TOK_CLOSE_PAR && next->type != TOK_COMMA;
+/*
+Precedence climbing. An operand is parsed first, then binary operators are taken for as long as
+they bind at least as tightly as the minimum precedence, each parsing its right side with a
+higher minimum so equal precedence groups to the left like on the calculator. Operators coming
+after their operand (^2, ^3 and ^-1) bind tighter than everything, so 2^X^2 is 2^(X^2). A
+missing ) is closed by the end of the equation.
+
+Instead of recursing for every right side, group, negation and function, whatever is waiting
+on the expression being parsed goes on a stack, so nesting is only limited by memory.
+*/
+
+//what an expression being parsed will be put into once it's done
+typedef enum _Waiting {
+    WAITING_RIGHT, //of a binary operator
+    WAITING_GROUP,
+    WAITING_NEGATE,
+    WAITING_FUNCTION,
+    WAITING_LOG_VALUE, //logBASE(value, base)
+    WAITING_LOG_BASE
+} Waiting;
+
+typedef struct _Unfinished {
+    Waiting waiting;
+    TokenType type; //the operator or function
+    ast_t *left; //the left side of the operator, or logBASE's value
+    uint8_t min_precedence; //of the expression the waiting one is part of
+} unfinished_t;
+
+//the ) after a group or a function's arguments, which the end of the equation also counts as
+bool parse_close(lexer_t *l, Error *error) {
+    token_t *tok = lexer_Peek(l);
+
+    if (tok == NULL)
+        return *error == E_SUCCESS;
+
+    if (tok->type == TOK_CLOSE_PAR) {
+        lexer_Next(l);
+        return true;
+    }
+
+    *error = tok->type == TOK_COMMA ? E_PARSE_BAD_COMMA : E_PARSE_BAD_OPERATOR;
+    return false;
 }
 
-#define parse_assert(expression, e) if(!(expression)) {stack_Cleanup(&operators); stack_Cleanup(&expressions); *error = e; return NULL;}
+//the binary operator after an operand if it binds at least as tightly as min_precedence, or
+//TOK_ERROR. 5(2 + 3) and 5X multiply without the *
+TokenType parse_operator(lexer_t *l, uint8_t min_precedence) {
+    token_t *tok = lexer_Peek(l);
+    TokenType operator;
 
-ast_t *parse(tokenizer_t *t, Error *error) {
-    stack_t operators, expressions;
-    ast_t *root;
+    if (tok == NULL)
+        return TOK_ERROR;
 
-    unsigned i;
-    token_t mult = { TOK_MULTIPLY }, open_par = { TOK_OPEN_PAR };
+    if (is_tok_binary_operator(tok->type))
+        operator = tok->type;
+    else if (should_multiply_by_next_token(tok))
+        operator = TOK_MULTIPLY;
+    else
+        return TOK_ERROR;
+
+    if (precedence(operator) < min_precedence)
+        return TOK_ERROR;
+
+    if (operator == tok->type)
+        lexer_Next(l);
+
+    return operator;
+}
+
+//^2, ^3 and ^-1 after an operand
+ast_t *parse_postfix(lexer_t *l, ast_t *operand) {
+    token_t *peeked;
+
+    while (operand != NULL && (peeked = lexer_Peek(l)) != NULL
+        && is_tok_unary_operator(peeked->type) && identifiers[peeked->type].direction == RIGHT) {
+        operand = ast_MakeUnary(peeked->type, operand);
+        lexer_Next(l);
+    }
+
+    return operand;
+}
+
+ast_t *parse_expression(lexer_t *l, Error *error) {
+    stack_t pending;
+    unfinished_t p;
+    uint8_t min_precedence = 0;
+    ast_t *operand = NULL;
 
-    stack_Create(&operators);
-    stack_Create(&expressions);
+    stack_CreateOf(&pending, unfinished_t);
 
-    for (i = 0; i < t->amount; i++) {
-        token_t *tok = &t->tokens[i];
+    while (*error == E_SUCCESS) {
+        token_t *peeked = lexer_Peek(l), tok;
+        TokenType operator;
 
-        if (tok->type == TOK_OPEN_PAR) {
-            stack_Push(&operators, tok);
+        //the start of an operand: a number or symbol, or something that waits for one
+        if (peeked == NULL) {
+            if (*error == E_SUCCESS)
+                *error = E_PARSE_BAD_OPERATOR;
+            break;
         }
-        else if (tok->type == TOK_NUMBER || tok->type == TOK_SYMBOL) {
-            //Due to a CRITICAL compiler bug, we have to create an instance
-            //of this variable because it cannot handle these sorts of nested
-            //functions apparently. rip my time spent debugging
-            if (tok->type == TOK_NUMBER) {
-                num_t num = num_Copy(tok->op.number);
-                stack_Push(&expressions, ast_MakeNumber(num));
+
+        tok = *peeked;
+        lexer_Next(l);
+
+        p.type = tok.type;
+        p.left = NULL;
+        p.min_precedence = min_precedence;
+
+        if (tok.type == TOK_NUMBER || tok.type == TOK_SYMBOL) {
+            operand = tok.type == TOK_NUMBER ? ast_MakeNumber(tok.op.number) : ast_MakeSymbol(tok.op.symbol);
+            operand = parse_postfix(l, operand);
+        } else {
+            if (tok.type == TOK_OPEN_PAR) {
+                p.waiting = WAITING_GROUP;
+                min_precedence = 0;
+            } else if (tok.type == TOK_NEGATE) {
+                p.waiting = WAITING_NEGATE;
+                min_precedence = precedence(TOK_NEGATE) + 1;
+            } else if (is_tok_unary_function(tok.type)) {
+                p.waiting = WAITING_FUNCTION;
+                min_precedence = 0;
+            } else if (is_tok_binary_function(tok.type)) {
+                p.waiting = WAITING_LOG_VALUE;
+                min_precedence = 0;
+            } else {
+                *error = E_PARSE_BAD_OPERATOR;
+                break;
             }
-            else {
-                stack_Push(&expressions, ast_MakeSymbol(tok->op.symbol));
+
+            if (!stack_PushOf(&pending, unfinished_t, &p))
+                *error = E_MEMORY;
+            continue;
+        }
+
+        //the operand is done, so finish everything that was waiting on it, until an operator
+        //needs another operand or the whole equation is done
+        for (;;) {
+            unfinished_t *top;
+            bool operand_needed = false;
+
+            if (*error != E_SUCCESS)
+                break;
+
+            if (operand == NULL) {
+                if (*error == E_SUCCESS)
+                    *error = E_MEMORY;
+                break;
             }
 
-            //detect if we are multiplying without the *
-            if (i + 1 < t->amount) {
-                token_t *next = &t->tokens[i + 1];
+            if ((operator = parse_operator(l, min_precedence)) != TOK_ERROR) {
+                p.waiting = WAITING_RIGHT;
+                p.type = operator;
+                p.left = operand;
+                p.min_precedence = min_precedence;
+
+                operand = NULL;
+                min_precedence = precedence(operator) + 1;
 
-                if (should_multiply_by_next_token(next)) {
-                    parse_assert(collapse_precedence(&operators, &expressions, TOK_MULTIPLY), E_PARSE_BAD_OPERATOR);
-                    stack_Push(&operators, &mult);
+                if (!stack_PushOf(&pending, unfinished_t, &p)) {
+                    ast_Cleanup(p.left);
+                    *error = E_MEMORY;
                 }
+                break;
             }
 
-        }
-        else if (is_tok_unary_operator(tok->type)) {
-            stack_Push(&operators, tok);
-
-            //detect if we are multiplying without the *
-            if (identifiers[tok->type].direction == RIGHT) {
-                if (i + 1 < t->amount) {
-                    token_t *next = &t->tokens[i + 1];
-
-                    if (should_multiply_by_next_token(next)) {
-                        parse_assert(collapse_precedence(&operators, &expressions, TOK_MULTIPLY), E_PARSE_BAD_OPERATOR);
-                        stack_Push(&operators, &mult);
-                    }
-                }
+            if (*error != E_SUCCESS)
+                break;
+
+            if ((top = stack_PopOf(&pending, unfinished_t)) == NULL) {
+                stack_Cleanup(&pending);
+                return operand;
             }
-        }
-        else if (is_tok_binary_operator(tok->type)) {
-            parse_assert(collapse_precedence(&operators, &expressions, tok->type), E_PARSE_BAD_OPERATOR);
-            stack_Push(&operators, tok);
-        }
-        else if (is_tok_function(tok->type)) {
-            //insert a ( to correspond with the other closing ) following the parameters
-            stack_Push(&operators, &open_par);
-            stack_Push(&operators, tok);
-        }
-        else if (tok->type == TOK_CLOSE_PAR) {
-            parse_assert(collapse_precedence(&operators, &expressions, TOK_CLOSE_PAR), E_PARSE_BAD_OPERATOR);
-            parse_assert(operators.top > 0 && ((token_t*)stack_Peek(&operators))->type == TOK_OPEN_PAR, E_PARSE_UNMATCHED_CLOSE_PAR);
 
-            stack_Pop(&operators);
+            p = *top;
+            min_precedence = p.min_precedence;
+
+            switch (p.waiting) {
+            case WAITING_RIGHT:
+                operand = ast_MakeBinary(p.type, p.left, operand);
+                break;
+            case WAITING_GROUP:
+                if (!parse_close(l, error))
+                    break;
+                operand = parse_postfix(l, operand);
+                break;
+            case WAITING_NEGATE:
+                operand = parse_postfix(l, ast_MakeUnary(TOK_NEGATE, operand));
+                break;
+            case WAITING_FUNCTION:
+                operand = ast_MakeUnary(p.type, operand);
+                if (operand != NULL && parse_close(l, error))
+                    operand = parse_postfix(l, operand);
+                break;
+            case WAITING_LOG_VALUE:
+                peeked = lexer_Peek(l);
+
+                if (peeked == NULL || peeked->type != TOK_COMMA) {
+                    if (*error == E_SUCCESS)
+                        *error = E_PARSE_BAD_OPERATOR;
+                    break;
+                }
+
+                lexer_Next(l);
 
-            //detect if we are multiplying without the *
-            if (i + 1 < t->amount) {
-                token_t *next = &t->tokens[i + 1];
+                p.waiting = WAITING_LOG_BASE;
+                p.left = operand;
+                operand = NULL;
+                min_precedence = 0;
+                operand_needed = true;
 
-                if (should_multiply_by_next_token(next)) {
-                    parse_assert(collapse_precedence(&operators, &expressions, TOK_MULTIPLY), E_PARSE_BAD_OPERATOR);
-                    stack_Push(&operators, &mult);
+                if (!stack_PushOf(&pending, unfinished_t, &p)) {
+                    ast_Cleanup(p.left);
+                    *error = E_MEMORY;
                 }
+                break;
+            case WAITING_LOG_BASE:
+                operand = ast_MakeBinary(p.type, p.left, operand);
+                if (operand != NULL && parse_close(l, error))
+                    operand = parse_postfix(l, operand);
+                break;
             }
 
-        }
-        else if (tok->type == TOK_COMMA) {
-            parse_assert(collapse_precedence(&operators, &expressions, TOK_COMMA), E_PARSE_BAD_OPERATOR);
-            parse_assert(operators.top > 0 && is_tok_function(((token_t*)stack_Peek(&operators))->type), E_PARSE_BAD_COMMA);
+            if (operand_needed)
+                break;
         }
     }
 
-    parse_assert(collapse(&operators, &expressions), E_PARSE_BAD_OPERATOR);
+    //nothing more can be parsed, so release whatever was waiting
+    ast_Cleanup(operand);
+
+    while (!stack_IsEmpty(&pending))
+        ast_Cleanup(stack_PopOf(&pending, unfinished_t)->left);
+
+    stack_Cleanup(&pending);
+    return NULL;
+}
+
+ast_t *parse_lexer(lexer_t *l, Error *error) {
+    ast_t *root;
+    token_t *tok;
+
+    *error = E_SUCCESS;
+    l->index = 0;
+    l->peeked = false;
+    l->error = error;
+
+    //nothing to parse
+    if (lexer_Peek(l) == NULL)
+        return NULL;
 
-    root = stack_Pop(&expressions);
+    root = parse_expression(l, error);
 
-    stack_Cleanup(&operators);
-    stack_Cleanup(&expressions);
+    //everything that could be parsed was, so what's left is a ) or , without its (
+    if (root != NULL && (tok = lexer_Peek(l)) != NULL) {
+        *error = tok->type == TOK_CLOSE_PAR ? E_PARSE_UNMATCHED_CLOSE_PAR
+            : tok->type == TOK_COMMA ? E_PARSE_BAD_COMMA : E_PARSE_BAD_OPERATOR;
+    }
+
+    if (*error != E_SUCCESS) {
+        ast_Cleanup(root);
+        return NULL;
+    }
 
     return root;
 }
 
+ast_t *parse(tokenizer_t *t, Error *error) {
+    lexer_t l;
+
+    l.tokens = t->tokens;
+    l.amount = t->amount;
+
+    return parse_lexer(&l, error);
+}
+
+ast_t *parse_equation(const uint8_t *equation, unsigned length, Error *error) {
+    lexer_t l;
+
+    l.equation = equation;
+    l.length = length;
+    l.tokens = NULL;
+
+    return parse_lexer(&l, error);
+}
+
 bool is_ast_of_token(ast_t *e, TokenType tok) {
     if(e == NULL)
         return false;
@@ -409,170 +695,323 @@ bool is_ast_of_token(ast_t *e, TokenType tok) {
     case NODE_SYMBOL:
         return e->type == identifiers[tok].node_type;
     case NODE_UNARY:
-        return e->op.unary.operator == tok;
+        return e->type == NODE_UNARY && e->op.unary.operator == tok;
     case NODE_BINARY:
-        return e->op.binary.operator == tok;
+        return e->type == NODE_BINARY && e->op.binary.operator == tok;
     }
 
     return false;
 }
 
-#define add_byte(byte) {if(data != NULL) data[index] = byte; index++;}
-#define add_num(num) {unsigned i; for(i = 0; i < num.length; i++) add_byte(num.number[i] == '.' ? CHAR_PERIOD : num.number[i] == '-' ? identifiers[TOK_NEGATE].bytes[0] : num.number[i]);}
-#define add_token(tok) {unsigned i; for(i = 0; i < identifiers[tok].length; i++) add_byte(identifiers[tok].bytes[i]);}
+//bytes written so far, growing as needed so the tree is only walked once
+typedef struct _Output {
+    uint8_t *data;
+    unsigned size, capacity;
+    Error *error;
+} output_t;
+
+//what an operand starts with when written out, which decides if a * before it can be left out
+typedef enum _Leftmost {
+    LEFTMOST_NUMBER,
+    LEFTMOST_SYMBOL,
+    LEFTMOST_FRACTION,
+    LEFTMOST_FUNCTION,
+    LEFTMOST_PREFIX, //-
+    LEFTMOST_POSTFIX //^2, ^3, ^-1
+} Leftmost;
+
+//how one node is written, worked out once from it and its children before anything is written
+typedef struct _Layout {
+    bool paren_left, paren_right; //paren_left is also used for the operand of a unary operator
+    bool show_operator; //a * can be left out like in 2X
+} layout_t;
+
+#define OUTPUT_START 64
+
+void add_byte(output_t *out, uint8_t byte) {
+    if (out->size >= out->capacity) {
+        uint8_t *grown;
+
+        if (*out->error != E_SUCCESS)
+            return;
+
+        //the capacity would wrap around instead of doubling
+        if (out->capacity > (unsigned)-1 / 2) {
+            *out->error = E_MEMORY;
+            return;
+        }
 
-ast_t *leftmost(ast_t *e) {
-    switch(e->type) {
+        grown = ast_Alloc(out->capacity * 2);
+
+        if (grown == NULL) {
+            *out->error = E_MEMORY;
+            return;
+        }
+
+        memcpy(grown, out->data, out->size);
+        ast_Free(out->data);
+
+        out->data = grown;
+        out->capacity *= 2;
+    }
+
+    out->data[out->size++] = byte;
+}
+
+void add_num(output_t *out, num_t num) {
+    unsigned i;
+    for (i = 0; i < num.length; i++)
+        add_byte(out, num.number[i] == '.' ? CHAR_PERIOD : num.number[i] == '-' ? identifiers[TOK_NEGATE].bytes[0] : num.number[i]);
+}
+
+void add_token(output_t *out, TokenType tok) {
+    unsigned i;
+    for (i = 0; i < identifiers[tok].length; i++)
+        add_byte(out, identifiers[tok].bytes[i]);
+}
+
+//follows the left side down to what is written first
+Leftmost leftmost(ast_t *e) {
+    while (e->type == NODE_BINARY && e->op.binary.operator != TOK_FRACTION && !is_tok_binary_function(e->op.binary.operator))
+        e = e->op.binary.left;
+
+    switch (e->type) {
     case NODE_NUMBER:
+        return LEFTMOST_NUMBER;
     case NODE_SYMBOL:
-    case NODE_UNARY:
-        return e;
+        return LEFTMOST_SYMBOL;
     case NODE_BINARY:
-        if(e->op.binary.operator == TOK_FRACTION || is_tok_binary_function(e->op.binary.operator))
-            return e;
-        return leftmost(e->op.binary.left);
+        return e->op.binary.operator == TOK_FRACTION ? LEFTMOST_FRACTION : LEFTMOST_FUNCTION;
+    default:
+        if (is_tok_unary_function(e->op.unary.operator))
+            return LEFTMOST_FUNCTION;
+        return identifiers[e->op.unary.operator].direction == LEFT ? LEFTMOST_PREFIX : LEFTMOST_POSTFIX;
     }
-
-    return NULL;
 }
 
-#define is_node_function(node) (node->type == NODE_BINARY ? is_tok_function(node->op.binary.operator) : node->type == NODE_UNARY ? is_tok_function(node->op.unary.operator) : false)
+#define is_atom(e) ((e)->type == NODE_NUMBER || (e)->type == NODE_SYMBOL)
+#define is_node_operator(e) ((e)->type == NODE_BINARY ? is_tok_binary_operator((e)->op.binary.operator) \
+    : (e)->type == NODE_UNARY && is_tok_unary_operator((e)->op.unary.operator))
 
-//Sorry, this function and the methods created for it are very messy.
-unsigned _to_binary(ast_t *e, uint8_t *data, unsigned index, Error *error) {
-	
-    switch (e->type) {
+void layout(ast_t *e, layout_t *l) {
+    l->paren_left = l->paren_right = false;
+    l->show_operator = true;
+
+    if (e->type == NODE_UNARY) {
+        ast_t *operand = e->op.unary.operand;
 
-    case NODE_NUMBER: {
-        add_num(e->op.number);
+        //-(-X) and (X+1)^2, but not -X^2
+        l->paren_left = !is_atom(operand) && !is_ast_function(operand) && precedence_node(operand) <= precedence_node(e);
+    }
+    else if (e->type == NODE_BINARY && !is_tok_binary_function(e->op.binary.operator)) {
+        TokenType type = e->op.binary.operator;
+        ast_t *left = e->op.binary.left, *right = e->op.binary.right;
+
+        l->paren_left = is_node_operator(left) && precedence_node(left) < precedence_node(e);
+
+        if (right->type == NODE_BINARY)
+            l->paren_right = is_node_operator(right) && precedence_node(right) <= precedence_node(e)
+                && !(type == TOK_MULTIPLY && right->op.binary.operator == TOK_MULTIPLY);
+        else
+            l->paren_right = is_node_operator(right) && precedence_node(right) < precedence_node(e);
+
+        //We always need parentheses around fractions
+        l->paren_left |= type == TOK_FRACTION;
+        l->paren_right |= type == TOK_FRACTION;
+
+        //We need parentheses if the token is power and the exponent is
+        //something other than a number or symbol
+        l->paren_right |= type == TOK_POWER && !is_atom(right);
+
+        if (type == TOK_MULTIPLY && !is_ast_of_token(right, TOK_NEGATE)) {
+            Leftmost first = leftmost(right);
+
+            //2X, 2sin(X) and 2X*3 can leave out the *, but not 2*3 or 2*-X
+            l->show_operator = !((is_ast_of_token(right, TOK_MULTIPLY) && first != LEFTMOST_NUMBER)
+                || first == LEFTMOST_FRACTION
+                || first == LEFTMOST_SYMBOL
+                || first == LEFTMOST_FUNCTION
+                || first == LEFTMOST_PREFIX);
+        }
+    }
+}
+
+//writes what comes before the first child of e, or all of it when it has none
+void write_open(ast_t *e, const layout_t *l, output_t *out) {
+    switch (e->type) {
+    case NODE_NUMBER:
+        add_num(out, e->op.number);
         break;
-    } case NODE_SYMBOL:
+    case NODE_SYMBOL:
         if(e->op.symbol == SYMBOL_E) {
             //the extended code for e
-            add_byte(0xBB);
-            add_byte(0x31);
+            add_byte(out, 0xBB);
+            add_byte(out, 0x31);
         }
         else {
-            add_byte(e->op.symbol);
+            add_byte(out, e->op.symbol);
         }
-        
+
         break;
     case NODE_UNARY: {
         TokenType type = e->op.unary.operator;
 
         if (is_tok_unary_function(type)) {
-            add_token(type);
-            index = _to_binary(e->op.unary.operand, data, index, error);
-            add_token(TOK_CLOSE_PAR);
+            add_token(out, type);
         }
         else {
-            //if we need parentheses around operand
-            bool paren = is_tok_unary_operator(e->op.unary.operand->type) && 
-                (identifiers[type].direction == RIGHT && precedence_node(e->op.unary.operand) < precedence_node(e)
-                    || (identifiers[type].direction == LEFT && precedence_node(e->op.unary.operand) <= precedence_node(e)));
+            if (identifiers[type].direction == LEFT)
+                add_token(out, type);
+            if (l->paren_left)
+                add_token(out, TOK_OPEN_PAR);
+        }
 
-            paren |= is_tok_binary_operator(e->op.unary.operand->type) && precedence_node(e->op.unary.operand) <= precedence_node(e);
-            paren &= !is_node_function(e->op.unary.operand);
+        break;
+    } case NODE_BINARY: {
+        TokenType type = e->op.binary.operator;
 
-            if (identifiers[type].direction == LEFT)
-                add_token(type);
+        if (is_tok_binary_function(type)) {
+            add_token(out, type);
+        }
+        else {
+            if (type == TOK_FRACTION)
+                add_token(out, TOK_OPEN_PAR);
+            if (l->paren_left)
+                add_token(out, TOK_OPEN_PAR);
+        }
+
+        break;
+    }
+    }
+}
+
+//writes what goes between the two children of a binary node
+void write_middle(ast_t *e, const layout_t *l, output_t *out) {
+    TokenType type = e->op.binary.operator;
+
+    if (is_tok_binary_function(type)) {
+        add_token(out, TOK_COMMA);
+        return;
+    }
 
-            if (paren)
-                add_token(TOK_OPEN_PAR);
+    if (l->paren_left)
+        add_token(out, TOK_CLOSE_PAR);
 
-            index = _to_binary(e->op.unary.operand, data, index, error);
+    if (l->show_operator)
+        add_token(out, type);
 
-            if (paren)
-                add_token(TOK_CLOSE_PAR);
-            
+    if (l->paren_right)
+        add_token(out, TOK_OPEN_PAR);
+}
+
+//writes what comes after the last child of e
+void write_close(ast_t *e, const layout_t *l, output_t *out) {
+    if (e->type == NODE_UNARY) {
+        TokenType type = e->op.unary.operator;
+
+        if (is_tok_unary_function(type)) {
+            add_token(out, TOK_CLOSE_PAR);
+        }
+        else {
+            if (l->paren_left)
+                add_token(out, TOK_CLOSE_PAR);
             if (identifiers[type].direction == RIGHT)
-                add_token(type);
+                add_token(out, type);
+        }
+    }
+    else if (e->type == NODE_BINARY) {
+        TokenType type = e->op.binary.operator;
 
+        if (is_tok_binary_function(type)) {
+            add_token(out, TOK_CLOSE_PAR);
         }
+        else {
+            if (l->paren_right)
+                add_token(out, TOK_CLOSE_PAR);
+            if (type == TOK_FRACTION)
+                add_token(out, TOK_CLOSE_PAR);
+        }
+    }
+}
 
-        break;
-    } case NODE_BINARY: {
-            TokenType type = e->op.binary.operator;
-
-            if (is_tok_binary_function(type)) {
-                add_token(type);
-                index = _to_binary(e->op.binary.left, data, index, error);
-                add_token(TOK_COMMA);
-                index = _to_binary(e->op.binary.right, data, index, error);
-                add_token(TOK_CLOSE_PAR);
-            }
-            else {
-                //if we need parentheses around operands
-                bool paren_left, paren_right;
-
-                paren_left = e->op.binary.left->type == NODE_BINARY && is_tok_binary_operator(e->op.binary.left->op.binary.operator) && precedence_node(e->op.binary.left) < precedence_node(e);
-                paren_left |= e->op.binary.left->type == NODE_UNARY && is_tok_unary_operator(e->op.binary.left->op.unary.operator) && precedence_node(e->op.binary.left) < precedence_node(e);
-                paren_left &= !is_node_function(e->op.binary.left);
-
-                paren_right = e->op.binary.right->type == NODE_BINARY && is_tok_binary_operator(e->op.binary.right->op.binary.operator) 
-                && (precedence_node(e->op.binary.right) <= precedence_node(e) && !(type == TOK_MULTIPLY && is_ast_of_token(e->op.binary.right, TOK_MULTIPLY)));
-                paren_right |= e->op.binary.right->type == NODE_UNARY && is_tok_unary_operator(e->op.binary.right->op.unary.operator) && precedence_node(e->op.binary.right) < precedence_node(e);
-                paren_right &= !is_node_function(e->op.binary.right);
-
-                //We always need parentheses around fractions
-                paren_left |= type == TOK_FRACTION;
-                paren_right |= type == TOK_FRACTION;
-
-                //We need parentheses if the token is power and the exponent is
-                //something other than a number or symbol
-                paren_right |= type == TOK_POWER
-                                && ast_CountNodes(e->op.binary.right) > 1;
-
-                if(type == TOK_FRACTION)
-                    add_token(TOK_OPEN_PAR);
-                if (paren_left)
-                    add_token(TOK_OPEN_PAR);
-                index = _to_binary(e->op.binary.left, data, index, error);
-                if (paren_left)
-                    add_token(TOK_CLOSE_PAR);
-
-                if(type != TOK_MULTIPLY || (type == TOK_MULTIPLY && !(
-                    (is_ast_of_token(e->op.binary.right, TOK_MULTIPLY) && leftmost(e->op.binary.right)->type != NODE_NUMBER)
-                    || is_ast_of_token(leftmost(e->op.binary.right), TOK_FRACTION)
-                    || leftmost(e->op.binary.right)->type == NODE_SYMBOL
-                    || (leftmost(e->op.binary.right)->type == NODE_BINARY && is_tok_binary_function(leftmost(e->op.binary.right)->op.binary.operator))
-                    || (leftmost(e->op.binary.right)->type == NODE_UNARY && (is_tok_unary_function(leftmost(e->op.binary.right)->op.unary.operator) || identifiers[leftmost(e->op.binary.right)->op.unary.operator].direction == LEFT))
-                    )
-                    || e->op.binary.right->type == NODE_UNARY && e->op.binary.right->op.unary.operator == TOK_NEGATE
-                    ))
-                    add_token(type);
-
-                if (paren_right)
-                    add_token(TOK_OPEN_PAR);
-                index = _to_binary(e->op.binary.right, data, index, error);
-                if (paren_right)
-                    add_token(TOK_CLOSE_PAR);
-                if(type == TOK_FRACTION)
-                    add_token(TOK_CLOSE_PAR);
+//a node that is partway written, waiting on one of its children
+typedef struct _Pending {
+    ast_t *e;
+    layout_t l;
+    bool right; //the left child is written and the right one is being written
+} pending_t;
+
+void _to_binary(ast_t *e, output_t *out) {
+    stack_t pending;
+    pending_t p;
+
+    stack_CreateOf(&pending, pending_t);
+
+    while (e != NULL) {
+        pending_t *top;
+
+        //down the left side, writing everything up to each first child
+        for (;;) {
+            layout(e, &p.l);
+            write_open(e, &p.l, out);
+
+            if (e->type != NODE_UNARY && e->type != NODE_BINARY)
+                break;
+
+            p.e = e;
+            p.right = false;
+
+            if (!stack_PushOf(&pending, pending_t, &p)) {
+                *out->error = E_MEMORY;
+                stack_Cleanup(&pending);
+                return;
             }
 
+            e = e->type == NODE_UNARY ? e->op.unary.operand : e->op.binary.left;
+        }
+
+        //back up, closing everything whose children are all written
+        e = NULL;
 
-            break;
+        while ((top = stack_PeekOf(&pending, pending_t)) != NULL) {
+            if (top->e->type == NODE_BINARY && !top->right) {
+                write_middle(top->e, &top->l, out);
+                top->right = true;
+                e = top->e->op.binary.right;
+                break;
+            }
+
+            write_close(top->e, &top->l, out);
+            stack_PopOf(&pending, pending_t);
         }
     }
 
-	return index;
+    stack_Cleanup(&pending);
 }
 
 uint8_t *to_binary(ast_t *e, unsigned *size, Error *error) {
-	
-	uint8_t *data;
-	
-	*error = E_SUCCESS;
-	
-	*size = _to_binary(e, NULL, 0, error);
-	
-	if(*error == E_SUCCESS) {
-		data = malloc(*size);
-	    _to_binary(e, data, 0, error);
-        return data;
-	}
-	
-	*size = 0;
-	return NULL;
+    output_t out;
+
+    *error = E_SUCCESS;
+    *size = 0;
+
+    out.size = 0;
+    out.capacity = OUTPUT_START;
+    out.error = error;
+    out.data = ast_Alloc(out.capacity);
+
+    if (out.data == NULL) {
+        *error = E_MEMORY;
+        return NULL;
+    }
+
+    _to_binary(e, &out);
+
+    if (*error != E_SUCCESS) {
+        ast_Free(out.data);
+        return NULL;
+    }
+
+    *size = out.size;
+    return out.data;
 }
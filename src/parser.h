@@ -8,7 +8,7 @@ typedef struct _Token {
     TokenType type;
 
     union {
-        num_t number; //for TOK_NUMBER
+        num_t number; //for TOK_NUMBER, borrowed from the equation that was tokenized
         uint8_t symbol; //for TOK_SYMBOL
     } op;
 
@@ -21,8 +21,14 @@ typedef struct _Tokenizer {
 
 void tokenizer_Cleanup(tokenizer_t *t);
 
+//number tokens, and the number nodes parse makes from them, point into equation instead of
+//copying it, so equation has to stay where it is until they are cleaned up
 Error tokenize(tokenizer_t *t, const uint8_t *equation, unsigned length);
 ast_t *parse(tokenizer_t *t, Error *error);
+
+//tokenizes and parses in one go, reading each token from equation as the parser needs it
+//instead of tokenizing all of it first. the numbers borrow equation the same way
+ast_t *parse_equation(const uint8_t *equation, unsigned length, Error *error);
 uint8_t *to_binary(ast_t *e, unsigned *size, Error *error);
 
 //there can be only 2 bytes, one is extended byte
@@ -48,7 +54,4 @@ typedef struct _Identifier {
 
 extern identifier_t identifiers[AMOUNT_TOKENS];
 
-//the char code for . on calculators
-#define CHAR_PERIOD 0x3A
-
 #endif
\ No newline at end of file
@@ -0,0 +1,310 @@
+#ifdef COMPILE_PC
+
+#include "cache.h"
+
+#include <string.h>
+#include <stdlib.h>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
+
+#define CACHE_MAGIC "DERIVCCH"
+#define CACHE_MIN_SIZE (64ul * 1024)
+
+//how many slots a key can be in, starting from the one its hash picks
+#define CACHE_PROBES 8
+
+//about how many bytes of the ring each slot is there for
+#define CACHE_BYTES_PER_SLOT 128
+
+typedef struct _CacheHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t amount_slots; //a power of 2
+
+    uint64_t ring_size;
+    //where the next result goes, counting every byte ever written to the ring. it starts at
+    //ring_size, so an offset of 0 is never in the ring
+    uint64_t head;
+
+    uint64_t reserved[4];
+} cache_header_t;
+
+//the key is the symbol, the options and the tokens. the result is the error as one byte and
+//then the output, right after the key in the ring
+typedef struct _CacheSlot {
+    uint64_t hash;
+    uint64_t offset; //of the key, counted like head
+    uint32_t key_length;
+    uint32_t result_length;
+} cache_slot_t;
+
+#define header(c) ((cache_header_t*)(c)->start)
+#define slots(c) ((cache_slot_t*)((c)->start + sizeof(cache_header_t)))
+#define ring(c) ((c)->start + sizeof(cache_header_t) + header(c)->amount_slots * sizeof(cache_slot_t))
+
+//anything written before head last came around to where it is has been overwritten since
+#define is_live(h, slot) ((slot)->offset != 0 && (slot)->offset >= (h)->head - (h)->ring_size)
+
+#ifdef _WIN32
+void lock_file(cache_t *c, bool exclusive) {
+    OVERLAPPED at = { 0 };
+    LockFileEx(c->file, exclusive ? LOCKFILE_EXCLUSIVE_LOCK : 0, 0, MAXDWORD, MAXDWORD, &at);
+}
+
+void unlock_file(cache_t *c) {
+    OVERLAPPED at = { 0 };
+    UnlockFileEx(c->file, 0, MAXDWORD, MAXDWORD, &at);
+}
+#else
+#define lock_file(c, exclusive) flock((c)->file, (exclusive) ? LOCK_EX : LOCK_SH)
+#define unlock_file(c) flock((c)->file, LOCK_UN)
+#endif
+
+//FNV-1a. keys are always compared in full, this only has to spread them out
+uint64_t key_hash(uint8_t symbol, uint8_t options, const uint8_t *tokens, unsigned length) {
+    uint64_t hash = 14695981039346656037ull;
+    unsigned i;
+
+    hash = (hash ^ symbol) * 1099511628211ull;
+    hash = (hash ^ options) * 1099511628211ull;
+
+    for (i = 0; i < length; i++)
+        hash = (hash ^ tokens[i]) * 1099511628211ull;
+
+    return hash;
+}
+
+bool key_matches(cache_t *c, const cache_slot_t *slot, uint64_t hash, uint8_t symbol, uint8_t options,
+    const uint8_t *tokens, unsigned length) {
+    const uint8_t *key = ring(c) + slot->offset % header(c)->ring_size;
+
+    return slot->hash == hash && slot->key_length == length + 2 && is_live(header(c), slot)
+        && key[0] == symbol && key[1] == options && !memcmp(key + 2, tokens, length);
+}
+
+bool is_valid(cache_t *c) {
+    cache_header_t *h = header(c);
+
+    return !memcmp(h->magic, CACHE_MAGIC, sizeof(h->magic)) && h->version == CACHE_VERSION
+        && h->amount_slots > 0 && (h->amount_slots & (h->amount_slots - 1)) == 0
+        && sizeof(cache_header_t) + (uint64_t)h->amount_slots * sizeof(cache_slot_t) + h->ring_size == c->size;
+}
+
+//empties the whole file and lays it out for its size
+void reset(cache_t *c) {
+    cache_header_t *h = header(c);
+    unsigned long space = c->size - sizeof(cache_header_t);
+    uint32_t slots = 1;
+
+    while ((unsigned long)slots * 2 * (sizeof(cache_slot_t) + CACHE_BYTES_PER_SLOT) <= space)
+        slots *= 2;
+
+    memset(c->start, 0, sizeof(cache_header_t) + slots * sizeof(cache_slot_t));
+    memcpy(h->magic, CACHE_MAGIC, sizeof(h->magic));
+    h->version = CACHE_VERSION;
+    h->amount_slots = slots;
+    h->ring_size = space - slots * sizeof(cache_slot_t);
+    h->head = h->ring_size;
+}
+
+bool cache_Open(cache_t *c, const char *path, unsigned long size) {
+    c->start = NULL;
+    c->size = 0;
+
+    if (size < CACHE_MIN_SIZE)
+        size = CACHE_MIN_SIZE;
+
+#ifdef _WIN32
+    LARGE_INTEGER existing;
+
+    c->mapping = NULL;
+    c->file = CreateFileA(path, GENERIC_READ | GENERIC_WRITE, FILE_SHARE_READ | FILE_SHARE_WRITE, NULL,
+        OPEN_ALWAYS, FILE_ATTRIBUTE_NORMAL, NULL);
+
+    if (c->file == INVALID_HANDLE_VALUE)
+        return false;
+
+    //nobody else can be halfway through creating or emptying it
+    lock_file(c, true);
+
+    if (!GetFileSizeEx(c->file, &existing)) {
+        cache_Close(c);
+        return false;
+    }
+
+    if ((unsigned long long)existing.QuadPart < CACHE_MIN_SIZE) {
+        existing.QuadPart = size;
+        if (!SetFilePointerEx(c->file, existing, NULL, FILE_BEGIN) || !SetEndOfFile(c->file)) {
+            cache_Close(c);
+            return false;
+        }
+    }
+
+    c->mapping = CreateFileMappingA(c->file, NULL, PAGE_READWRITE, 0, 0, NULL);
+    if (c->mapping != NULL)
+        c->start = MapViewOfFile(c->mapping, FILE_MAP_ALL_ACCESS, 0, 0, 0);
+
+    if (c->start == NULL) {
+        cache_Close(c);
+        return false;
+    }
+
+    c->size = (unsigned long)existing.QuadPart;
+#else
+    struct stat info;
+    void *start;
+
+    c->file = open(path, O_RDWR | O_CREAT, 0644);
+
+    if (c->file < 0)
+        return false;
+
+    //nobody else can be halfway through creating or emptying it
+    lock_file(c, true);
+
+    if (fstat(c->file, &info) != 0) {
+        cache_Close(c);
+        return false;
+    }
+
+    if ((unsigned long)info.st_size < CACHE_MIN_SIZE) {
+        if (ftruncate(c->file, (off_t)size) != 0) {
+            cache_Close(c);
+            return false;
+        }
+        info.st_size = (off_t)size;
+    }
+
+    start = mmap(NULL, (size_t)info.st_size, PROT_READ | PROT_WRITE, MAP_SHARED, c->file, 0);
+
+    if (start == MAP_FAILED) {
+        cache_Close(c);
+        return false;
+    }
+
+    c->start = start;
+    c->size = (unsigned long)info.st_size;
+#endif
+
+    if (!is_valid(c))
+        reset(c);
+
+    unlock_file(c);
+    return true;
+}
+
+void cache_Close(cache_t *c) {
+#ifdef _WIN32
+    if (c->start != NULL)
+        UnmapViewOfFile(c->start);
+    if (c->mapping != NULL)
+        CloseHandle(c->mapping);
+    if (c->file != INVALID_HANDLE_VALUE)
+        CloseHandle(c->file);
+    c->mapping = NULL;
+    c->file = INVALID_HANDLE_VALUE;
+#else
+    if (c->start != NULL)
+        munmap(c->start, c->size);
+    if (c->file >= 0)
+        close(c->file);
+    c->file = -1;
+#endif
+
+    c->start = NULL;
+    c->size = 0;
+}
+
+bool cache_Get(cache_t *c, uint8_t symbol, uint8_t options, const uint8_t *tokens, unsigned length,
+    int *error, uint8_t **result, unsigned *result_length) {
+    uint64_t hash = key_hash(symbol, options, tokens, length);
+    bool found = false;
+    unsigned i;
+
+    lock_file(c, false);
+
+    for (i = 0; i < CACHE_PROBES; i++) {
+        cache_slot_t *slot = &slots(c)[(hash + i) & (header(c)->amount_slots - 1)];
+        const uint8_t *stored;
+
+        if (!key_matches(c, slot, hash, symbol, options, tokens, length))
+            continue;
+
+        stored = ring(c) + slot->offset % header(c)->ring_size + slot->key_length;
+
+        //copied out while the lock is held, someone could overwrite it right after
+        *result_length = slot->result_length - 1;
+        *result = malloc(*result_length + 1);
+
+        if (*result != NULL) {
+            *error = (int8_t)stored[0];
+            memcpy(*result, stored + 1, *result_length);
+            found = true;
+        }
+
+        break;
+    }
+
+    unlock_file(c);
+    return found;
+}
+
+void cache_Put(cache_t *c, uint8_t symbol, uint8_t options, const uint8_t *tokens, unsigned length,
+    int error, const uint8_t *result, unsigned result_length) {
+    cache_header_t *h = header(c);
+    uint64_t hash = key_hash(symbol, options, tokens, length);
+    uint64_t size = 2 + length + 1 + (uint64_t)result_length, offset;
+    cache_slot_t *same = NULL, *unused = NULL, *oldest = NULL, *slot;
+    uint8_t *at;
+    unsigned i;
+
+    //the ring size never changes once the file is open
+    if (error != (int8_t)error || size > h->ring_size / CACHE_MAX_SHARE)
+        return;
+
+    lock_file(c, true);
+
+    for (i = 0; i < CACHE_PROBES && same == NULL; i++) {
+        slot = &slots(c)[(hash + i) & (h->amount_slots - 1)];
+
+        if (key_matches(c, slot, hash, symbol, options, tokens, length))
+            same = slot;
+        else if (!is_live(h, slot) && unused == NULL)
+            unused = slot;
+        else if (oldest == NULL || slot->offset < oldest->offset)
+            oldest = slot;
+    }
+
+    slot = same != NULL ? same : unused != NULL ? unused : oldest;
+
+    //results never wrap around the end of the ring
+    offset = h->head;
+    if (offset % h->ring_size + size > h->ring_size)
+        offset += h->ring_size - offset % h->ring_size;
+
+    at = ring(c) + offset % h->ring_size;
+    at[0] = symbol;
+    at[1] = options;
+    memcpy(at + 2, tokens, length);
+    at[2 + length] = (uint8_t)error;
+    memcpy(at + 3 + length, result, result_length);
+
+    h->head = offset + size;
+
+    slot->hash = hash;
+    slot->offset = offset;
+    slot->key_length = 2 + length;
+    slot->result_length = 1 + result_length;
+
+    unlock_file(c);
+}
+
+#endif
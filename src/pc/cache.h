@@ -0,0 +1,53 @@
+#ifdef COMPILE_PC
+
+#ifndef _CACHE_H_
+#define _CACHE_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+
+//Persistent cache from an equation's tokens to what the pipeline made of them, so an input
+//that was seen before costs a lookup instead of a parse, simplify, derivative and to_binary.
+//It lives in one memory mapped file of fixed size that any number of processes can have
+//open. Lookups take a shared lock on the file and stores an exclusive one.
+//
+//New results are appended to a ring in the file, so once it's full the oldest are the first
+//to go. Keys are compared in full, the hash only decides where to look.
+
+//bump whenever a change to the engine changes what it outputs. a file with any other version
+//is emptied when it's opened
+#define CACHE_VERSION 1
+
+#define CACHE_DEFAULT_SIZE (64ul * 1024 * 1024)
+
+//a result bigger than this fraction of the ring isn't kept
+#define CACHE_MAX_SHARE 16
+
+typedef struct _Cache {
+    uint8_t *start;
+    unsigned long size;
+
+#ifdef _WIN32
+    void *file, *mapping;
+#else
+    int file;
+#endif
+} cache_t;
+
+//opens or creates the cache at path. size is only used when the file is created or has to be
+//emptied, otherwise the size it already has is kept. returns false if it can't be mapped
+bool cache_Open(cache_t *c, const char *path, unsigned long size);
+void cache_Close(cache_t *c);
+
+//looks up the result of the equation's tokens for this symbol and options. on a hit error is
+//what the pipeline returned and *result is a malloced copy of its output, which the caller frees
+bool cache_Get(cache_t *c, uint8_t symbol, uint8_t options, const uint8_t *tokens, unsigned length,
+    int *error, uint8_t **result, unsigned *result_length);
+
+//keeps a result for later, replacing any that was there for the same key
+void cache_Put(cache_t *c, uint8_t symbol, uint8_t options, const uint8_t *tokens, unsigned length,
+    int error, const uint8_t *result, unsigned result_length);
+
+#endif
+
+#endif
@@ -0,0 +1,506 @@
+#ifdef COMPILE_PC
+
+#include "jobs.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <dirent.h>
+#endif
+
+#include "../parser.h"
+#include "../cas.h"
+#include "../arena.h"
+
+#include "pool.h"
+#include "yvar.h"
+#include "cache.h"
+
+//longest line read from a manifest
+#define JOBS_MAX_PATH 4096
+
+//what the results are cached under. there's only the calculator's pipeline so far
+#define JOBS_SYMBOL 'X'
+#define JOBS_OPTIONS 0
+
+typedef struct _Job {
+    unsigned input; //which of the chunk's inputs it came from
+    unsigned index; //which equation in that input
+
+    //pointing into the input's mapping, NULL when there's nothing to run
+    const uint8_t *equation;
+    uint16_t length;
+
+    int error;
+
+    //where the derivative's tokens ended up
+    unsigned worker;
+    size_t offset;
+    unsigned size;
+} job_t;
+
+typedef struct _Input {
+    char *path;
+    yvar_file_t file;
+    bool open;
+} input_t;
+
+//everything a worker allocates from, kept from one chunk to the next
+typedef struct _JobWorker {
+    arena_t arena;
+
+    //the tokens of every derivative this worker made in the current chunk
+    uint8_t *out;
+    size_t used, capacity;
+} job_worker_t;
+
+//grows past JOBS_CHUNK when a single input has more equations than that
+typedef struct _Jobs {
+    job_t *jobs;
+    unsigned amount, capacity;
+
+    //mapped until the chunk's results are written
+    input_t *inputs;
+    unsigned amount_inputs, capacity_inputs;
+
+    //one more than there are threads, the last one keeps what was found in the cache
+    job_worker_t *workers;
+    unsigned hits;
+
+    cache_t *cache;
+} jobs_t;
+
+//where the paths come from
+typedef struct _Source {
+    FILE *list; //a manifest or stdin, NULL for a directory
+
+    char **names; //directory entries, sorted
+    unsigned amount, next;
+} source_t;
+
+//.8xy and .8xg, or any other variable file the equations could be in
+bool is_variable_name(const char *name) {
+    size_t length = strlen(name);
+
+    return length > 4 && name[length - 4] == '.' && name[length - 3] == '8'
+        && tolower((unsigned char)name[length - 2]) == 'x';
+}
+
+int compare_names(const void *a, const void *b) {
+    return strcmp(*(char* const*)a, *(char* const*)b);
+}
+
+bool add_name(source_t *s, const char *directory, const char *name) {
+    char *path;
+
+    if (!is_variable_name(name))
+        return true;
+
+    if (s->amount % 1024 == 0) {
+        char **names = realloc(s->names, (s->amount + 1024) * sizeof(char*));
+        if (names == NULL)
+            return false;
+        s->names = names;
+    }
+
+    path = malloc(strlen(directory) + strlen(name) + 2);
+    if (path == NULL)
+        return false;
+
+    sprintf(path, "%s/%s", directory, name);
+    s->names[s->amount++] = path;
+    return true;
+}
+
+//every variable file directly inside directory, false if it isn't one
+bool list_directory(source_t *s, const char *directory) {
+    bool ok = true;
+#ifdef _WIN32
+    WIN32_FIND_DATAA found;
+    HANDLE find;
+    char *pattern;
+    DWORD attributes = GetFileAttributesA(directory);
+
+    if (attributes == INVALID_FILE_ATTRIBUTES || !(attributes & FILE_ATTRIBUTE_DIRECTORY))
+        return false;
+
+    pattern = malloc(strlen(directory) + 3);
+    if (pattern == NULL)
+        return false;
+    sprintf(pattern, "%s/*", directory);
+
+    find = FindFirstFileA(pattern, &found);
+    free(pattern);
+
+    if (find != INVALID_HANDLE_VALUE) {
+        do {
+            if (!(found.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY))
+                ok = add_name(s, directory, found.cFileName);
+        } while (ok && FindNextFileA(find, &found));
+
+        FindClose(find);
+    }
+#else
+    DIR *dir = opendir(directory);
+    struct dirent *entry;
+
+    if (dir == NULL)
+        return false;
+
+    while (ok && (entry = readdir(dir)) != NULL)
+        ok = add_name(s, directory, entry->d_name);
+
+    closedir(dir);
+#endif
+
+    //the listing order depends on the file system
+    if (s->amount > 0)
+        qsort(s->names, s->amount, sizeof(char*), compare_names);
+
+    return ok;
+}
+
+void source_Cleanup(source_t *s) {
+    if (s->list != NULL && s->list != stdin)
+        fclose(s->list);
+
+    //the ones already handed out belong to their jobs
+    for (; s->next < s->amount; s->next++)
+        free(s->names[s->next]);
+    free(s->names);
+}
+
+bool source_Open(source_t *s, const char *input) {
+    s->list = NULL;
+    s->names = NULL;
+    s->amount = s->next = 0;
+
+    if (!strcmp(input, "-")) {
+        s->list = stdin;
+        return true;
+    }
+
+    if (list_directory(s, input))
+        return true;
+
+    //a directory that couldn't be listed in full
+    if (s->amount > 0) {
+        source_Cleanup(s);
+        return false;
+    }
+
+#ifdef _MSC_VER
+    fopen_s(&s->list, input, "r");
+#else
+    s->list = fopen(input, "r");
+#endif
+    return s->list != NULL;
+}
+
+//the next path, which the caller frees, or NULL once there are no more
+char *source_Next(source_t *s) {
+    char line[JOBS_MAX_PATH];
+
+    if (s->list == NULL)
+        return s->next < s->amount ? s->names[s->next++] : NULL;
+
+    while (fgets(line, sizeof(line), s->list) != NULL) {
+        size_t length = strcspn(line, "\r\n");
+        char *path;
+
+        if (length == 0)
+            continue;
+
+        path = malloc(length + 1);
+        if (path != NULL) {
+            memcpy(path, line, length);
+            path[length] = 0;
+        }
+
+        return path;
+    }
+
+    return NULL;
+}
+
+//the tokens have to outlive the arena, which is reset for the next job
+bool keep_tokens(job_worker_t *w, job_t *job, const uint8_t *tokens, unsigned size) {
+    if (w->used + size > w->capacity) {
+        size_t capacity = w->capacity * 2 > w->used + size ? w->capacity * 2 : w->used + size;
+        uint8_t *out = realloc(w->out, capacity);
+
+        if (out == NULL)
+            return false;
+
+        w->out = out;
+        w->capacity = capacity;
+    }
+
+    memcpy(w->out + w->used, tokens, size);
+    job->offset = w->used;
+    job->size = size;
+    w->used += size;
+    return true;
+}
+
+//amount more items of size bytes fit in *array, growing it if they don't
+bool make_room(void **array, unsigned *capacity, unsigned amount, size_t size) {
+    unsigned grown = *capacity > 0 ? *capacity : 64;
+    void *bigger;
+
+    if (amount < *capacity)
+        return true;
+
+    while (grown <= amount)
+        grown *= 2;
+
+    bigger = realloc(*array, grown * size);
+    if (bigger == NULL)
+        return false;
+
+    *array = bigger;
+    *capacity = grown;
+    return true;
+}
+
+bool add_job(jobs_t *j, unsigned index, const yvar_t *var, int error) {
+    job_t *job;
+
+    if (!make_room((void**)&j->jobs, &j->capacity, j->amount, sizeof(job_t)))
+        return false;
+
+    job = &j->jobs[j->amount++];
+    job->input = j->amount_inputs - 1;
+    job->index = index;
+    job->equation = var != NULL ? var->tokens : NULL;
+    job->length = var != NULL ? var->tokens_length : 0;
+    job->error = error;
+    job->worker = 0;
+    job->offset = 0;
+    job->size = 0;
+
+    //a job that's in the cache doesn't have to be run
+    if (job->equation != NULL && j->cache != NULL) {
+        uint8_t *result;
+        unsigned size;
+
+        if (cache_Get(j->cache, JOBS_SYMBOL, JOBS_OPTIONS, job->equation, job->length, &error, &result, &size)) {
+            if (keep_tokens(&j->workers[j->hits], job, result, size)) {
+                job->equation = NULL;
+                job->worker = j->hits;
+                job->error = error;
+            }
+
+            free(result);
+        }
+    }
+
+    return true;
+}
+
+//maps path and adds a job for every equation in it. false when out of memory
+bool add_input(jobs_t *j, char *path) {
+    input_t *input;
+    yvar_t var;
+    unsigned index = 0;
+    int found;
+
+    if (!make_room((void**)&j->inputs, &j->capacity_inputs, j->amount_inputs, sizeof(input_t))) {
+        free(path);
+        return false;
+    }
+
+    input = &j->inputs[j->amount_inputs++];
+    input->path = path;
+    input->open = yvar_Open(&input->file, path);
+
+    if (!input->open)
+        return add_job(j, 0, NULL, JOB_UNREADABLE);
+
+    while ((found = yvar_NextEquation(&input->file, &var)) == 1) {
+        if (!add_job(j, index++, &var, E_SUCCESS))
+            return false;
+    }
+
+    //whatever came before a bad section was still fine
+    if (found < 0 || index == 0)
+        return add_job(j, index, NULL, JOB_UNREADABLE);
+
+    return true;
+}
+
+void close_inputs(jobs_t *j) {
+    unsigned i;
+
+    for (i = 0; i < j->amount_inputs; i++) {
+        if (j->inputs[i].open)
+            yvar_Close(&j->inputs[i].file);
+        free(j->inputs[i].path);
+    }
+
+    j->amount_inputs = 0;
+    j->amount = 0;
+}
+
+//what the calculator does with Y1. the tokens are left in the current arena
+int derive_equation(const uint8_t *equation, unsigned length, uint8_t **tokens, unsigned *size) {
+    Error error;
+    ast_t *e, *simplified, *deriv;
+
+    e = parse_equation(equation, length, &error);
+
+    if (error != E_SUCCESS)
+        return error;
+    if (e == NULL)
+        return JOB_EMPTY;
+
+    simplified = simplify_fixpoint(e, NULL);
+    if (simplified == NULL)
+        return E_MEMORY;
+
+    deriv = derivative(simplified, 'X', &error);
+    if (error != E_SUCCESS)
+        return error;
+
+    simplified = simplify_fixpoint(deriv, NULL);
+    if (simplified == NULL)
+        return E_MEMORY;
+
+    *tokens = to_binary(simplified, size, &error);
+    return error;
+}
+
+void run_job(void *context, unsigned worker, unsigned item) {
+    jobs_t *j = context;
+    job_t *job = &j->jobs[item];
+    job_worker_t *w = &j->workers[worker];
+    uint8_t *tokens;
+    unsigned size;
+
+    if (job->equation == NULL)
+        return;
+
+    //nothing from the last job is still needed
+    arena_Reset(&w->arena);
+    ast_UseArena(&w->arena);
+
+    job->worker = worker;
+    job->error = derive_equation(job->equation, job->length, &tokens, &size);
+
+    if (job->error == E_SUCCESS && !keep_tokens(w, job, tokens, size))
+        job->error = E_MEMORY;
+
+    ast_UseArena(NULL);
+}
+
+void write_job(FILE *out, const jobs_t *j, const job_t *job) {
+    static const char hex[] = "0123456789ABCDEF";
+    const uint8_t *tokens = j->workers[job->worker].out + job->offset;
+    char line[256];
+    unsigned i, length = 0;
+
+    fprintf(out, "%s\t%u\t%d\t", j->inputs[job->input].path, job->index, job->error);
+
+    //in pieces, so one fprintf per byte doesn't dominate the output
+    for (i = 0; i < job->size; i++) {
+        line[length++] = hex[tokens[i] >> 4];
+        line[length++] = hex[tokens[i] & 0xF];
+
+        if (length == sizeof(line)) {
+            fwrite(line, 1, length, out);
+            length = 0;
+        }
+    }
+
+    line[length++] = '\n';
+    fwrite(line, 1, length, out);
+}
+
+bool jobs_Run(const char *input, unsigned threads, cache_t *cache, FILE *out) {
+    source_t source;
+    pool_t pool;
+    jobs_t *j;
+    unsigned i;
+    bool ok = true, more = true;
+
+    if (!source_Open(&source, input))
+        return false;
+
+    j = calloc(1, sizeof(jobs_t));
+
+    if (j == NULL || !pool_Create(&pool, threads)) {
+        free(j);
+        source_Cleanup(&source);
+        return false;
+    }
+
+    j->workers = calloc(pool.amount_workers + 1, sizeof(job_worker_t));
+    j->hits = pool.amount_workers;
+    j->cache = cache;
+
+    if (j->workers == NULL) {
+        pool_Cleanup(&pool);
+        free(j);
+        source_Cleanup(&source);
+        return false;
+    }
+
+    for (i = 0; i <= j->hits; i++)
+        arena_Create(&j->workers[i].arena, ARENA_BLOCK_SIZE);
+
+    while (more) {
+        //whole inputs at a time, so an input is never split over two chunks
+        while (j->amount < JOBS_CHUNK) {
+            char *path = source_Next(&source);
+
+            if (path == NULL) {
+                more = false;
+                break;
+            }
+
+            if (!add_input(j, path)) {
+                ok = more = false;
+                break;
+            }
+        }
+
+        pool_Run(&pool, j->amount, run_job, j);
+
+        for (i = 0; i < j->amount; i++) {
+            job_t *job = &j->jobs[i];
+
+            write_job(out, j, job);
+
+            //running out of memory says nothing about the equation
+            if (j->cache != NULL && job->equation != NULL && job->error != E_MEMORY) {
+                cache_Put(j->cache, JOBS_SYMBOL, JOBS_OPTIONS, job->equation, job->length, job->error,
+                    j->workers[job->worker].out + job->offset, job->size);
+            }
+        }
+
+        close_inputs(j);
+
+        for (i = 0; i <= j->hits; i++)
+            j->workers[i].used = 0;
+    }
+
+    for (i = 0; i <= j->hits; i++) {
+        arena_Cleanup(&j->workers[i].arena);
+        free(j->workers[i].out);
+    }
+
+    pool_Cleanup(&pool);
+    free(j->workers);
+    free(j->jobs);
+    free(j->inputs);
+    free(j);
+    source_Cleanup(&source);
+
+    return ok;
+}
+
+#endif
@@ -0,0 +1,38 @@
+#ifdef COMPILE_PC
+
+#ifndef _JOBS_H_
+#define _JOBS_H_
+
+#include <stdio.h>
+#include <stdbool.h>
+
+#include "cache.h"
+
+//Differentiates many Y-vars at once, spread over a pool of worker threads that each have
+//their own arena. The inputs are variable files (.8xy, .8xg or archives of them) taken from a
+//directory, from a manifest with one path per line, or from standard input when the name is
+//"-". Every equation in them goes through what the calculator does with Y1: simplify,
+//derivative with respect to X, simplify, to_binary. The equations are read straight out of
+//the mapped files.
+//
+//One line is written per equation, in input order, however the work was spread out:
+//    path <tab> which equation in the file, from 0 <tab> error <tab> the derivative's tokens in hex
+//error is the Error the pipeline stopped with, 0 on success, or one of the codes below.
+
+//the file couldn't be opened, isn't a variable file, fails its checksum or has no equations
+#define JOB_UNREADABLE -1
+//the equation has nothing in it
+#define JOB_EMPTY -2
+
+//about how many equations are read in and run at once. results are written out after each
+//chunk, which only goes over this for an input with more equations than that
+#define JOBS_CHUNK 4096
+
+//threads is 0 for one per core. equations found in cache aren't run again and new results are
+//added to it, NULL to run everything. returns false if the input couldn't be opened or memory
+//ran out, anything that was done before that is still written
+bool jobs_Run(const char *input, unsigned threads, cache_t *cache, FILE *out);
+
+#endif
+
+#endif
@@ -1,50 +1,269 @@
 #ifdef COMPILE_PC
 
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <math.h>
 
 #include "../parser.h"
 #include "../cas.h"
+#include "../program.h"
+#include "../batch.h"
+#include "../cse.h"
+#include "../dual.h"
+#include "../gradient.h"
+#include "../taylor.h"
 
 #include "yvar.h"
+#include "jobs.h"
+
+#define BENCH_ITERATIONS 200000
+
+//simplifying reorders sums and products, so results only agree up to rounding
+#define same_value(a, b) ((a) == (b) || fabs((a) - (b)) <= 1e-9 * fabs(b) || ((a) != (a) && (b) != (b)))
+
+//times evaluate() against the compiled program on the same expression
+void bench_evaluate(const char *name, ast_t *e) {
+    program_t p;
+    double values[PROGRAM_MAX_SYMBOLS];
+    volatile double sink;
+    clock_t start;
+    double tree_ns, program_ns;
+    unsigned i;
+
+    if (ast_Compile(e, &p) != E_SUCCESS) {
+        printf("%s: unable to compile.\n", name);
+        return;
+    }
+
+    //evaluate() uses -1 for every variable
+    for (i = 0; i < p.amount_symbols; i++)
+        values[i] = -1;
+
+    start = clock();
+    for (i = 0; i < BENCH_ITERATIONS; i++)
+        sink = evaluate(e);
+    tree_ns = (double)(clock() - start) / CLOCKS_PER_SEC * 1e9 / BENCH_ITERATIONS;
+
+    start = clock();
+    for (i = 0; i < BENCH_ITERATIONS; i++)
+        sink = program_Evaluate(&p, values);
+    program_ns = (double)(clock() - start) / CLOCKS_PER_SEC * 1e9 / BENCH_ITERATIONS;
+
+    //only there so the loops aren't optimized out
+    (void)sink;
+
+    printf("%-12s %5u nodes %4u instructions  evaluate %9.1f ns  compiled %9.1f ns  %5.1fx\n",
+        name, ast_CountNodes(e), p.amount_instructions, tree_ns, program_ns, tree_ns / program_ns);
+
+    //polynomials are compiled in Horner form, which rounds a little differently
+    if (!same_value(program_Evaluate(&p, values), evaluate(e)))
+        printf("WARNING: compiled %s does not equal evaluate()\n", name);
+
+    //tabulating over a range of X, one point at a time and then batched
+    if (program_SymbolIndex(&p, 'X') >= 0) {
+        static double xs[BENCH_ITERATIONS], out[BENCH_ITERATIONS];
+        int x = program_SymbolIndex(&p, 'X');
+        double batch_ns;
+
+        for (i = 0; i < BENCH_ITERATIONS; i++)
+            xs[i] = -10 + 20.0 * i / BENCH_ITERATIONS;
+
+        start = clock();
+        for (i = 0; i < BENCH_ITERATIONS; i++) {
+            values[x] = xs[i];
+            out[i] = program_Evaluate(&p, values);
+        }
+        program_ns = (double)(clock() - start) / CLOCKS_PER_SEC * 1e9 / BENCH_ITERATIONS;
+
+        start = clock();
+        program_EvaluateBatch(&p, values, 'X', xs, out, BENCH_ITERATIONS);
+        batch_ns = (double)(clock() - start) / CLOCKS_PER_SEC * 1e9 / BENCH_ITERATIONS;
+
+        printf("%-12s over X: compiled %9.1f ns/point  batch (%s) %9.1f ns/point  %5.1fx vs evaluate\n",
+            name, program_ns, batch_Kernels(), batch_ns, tree_ns / batch_ns);
+    }
+
+    program_Cleanup(&p);
+}
+
+//f'(x) through dual numbers on f against evaluating the simplified derivative tree
+void bench_dual(ast_t *e, ast_t *simplified_derivative, const env_t *env) {
+    volatile double sink;
+    dual_t dual;
+    double result;
+    clock_t start;
+    double dual_ns, tree_ns;
+    unsigned i;
+
+    start = clock();
+    for (i = 0; i < BENCH_ITERATIONS; i++) {
+        evaluate_dual(e, env, 'X', &dual);
+        sink = dual.derivative;
+    }
+    dual_ns = (double)(clock() - start) / CLOCKS_PER_SEC * 1e9 / BENCH_ITERATIONS;
+
+    start = clock();
+    for (i = 0; i < BENCH_ITERATIONS; i++) {
+        evaluate_env(simplified_derivative, env, &result);
+        sink = result;
+    }
+    tree_ns = (double)(clock() - start) / CLOCKS_PER_SEC * 1e9 / BENCH_ITERATIONS;
+
+    (void)sink;
+
+    printf("f'(x) dual   %9.1f ns  f'_simp(x) tree %9.1f ns  %5.1fx\n", dual_ns, tree_ns, tree_ns / dual_ns);
+}
+
+//every partial derivative from one tape sweep against one dual number pass per symbol
+void bench_gradient(ast_t *e) {
+    tape_t t;
+    env_t env;
+    dual_t dual;
+    double values[PROGRAM_MAX_SYMBOLS], gradient[PROGRAM_MAX_SYMBOLS];
+    double value;
+    clock_t start;
+    double tape_ns, dual_ns;
+    unsigned i, j;
+
+    if (tape_Record(e, &t) != E_SUCCESS) {
+        printf("gradient: unable to record.\n");
+        return;
+    }
+
+    env_Create(&env);
+    for (i = 0; i < t.program.amount_symbols; i++) {
+        values[i] = -1;
+        env_Set(&env, t.program.symbols[i], -1);
+    }
+
+    start = clock();
+    for (i = 0; i < BENCH_ITERATIONS; i++)
+        tape_Gradient(&t, values, &value, gradient);
+    tape_ns = (double)(clock() - start) / CLOCKS_PER_SEC * 1e9 / BENCH_ITERATIONS;
+
+    start = clock();
+    for (i = 0; i < BENCH_ITERATIONS; i++) {
+        for (j = 0; j < t.program.amount_symbols; j++)
+            evaluate_dual(e, &env, t.program.symbols[j], &dual);
+    }
+    dual_ns = (double)(clock() - start) / CLOCKS_PER_SEC * 1e9 / BENCH_ITERATIONS;
+
+    printf("gradient of %u symbols  tape %9.1f ns  dual per symbol %9.1f ns  %5.1fx\n",
+        t.program.amount_symbols, tape_ns, dual_ns, dual_ns / tape_ns);
+
+    tape_Cleanup(&t);
+}
+
+//how the cost of taylor_Derivatives grows with the order
+void bench_taylor(ast_t *e) {
+    unsigned orders[] = { 1, 2, 4, 8, 16 };
+    double values[PROGRAM_MAX_SYMBOLS], derivatives[17];
+    clock_t start;
+    unsigned i, j;
+
+    for (j = 0; j < sizeof(orders) / sizeof(orders[0]); j++) {
+        taylor_t t;
+
+        if (taylor_Record(e, 'X', orders[j], &t) != E_SUCCESS) {
+            printf("taylor: unable to record.\n");
+            return;
+        }
+
+        for (i = 0; i < t.program.amount_symbols; i++)
+            values[i] = -1;
+
+        start = clock();
+        for (i = 0; i < BENCH_ITERATIONS / 10; i++)
+            taylor_Derivatives(&t, values, derivatives);
+
+        printf("taylor order %2u %9.1f ns\n", orders[j], (double)(clock() - start) / CLOCKS_PER_SEC * 1e9 / (BENCH_ITERATIONS / 10));
+
+        taylor_Cleanup(&t);
+    }
+}
 
 int main(int argc, const char **argv) {
     Error error;
+    arena_t arena;
 
     if (argc <= 1) {
-        printf("Usage: derivative.exe C:\\path\\to\\yvar.8xy\n");
+        printf("Usage: derivative.exe C:\\path\\to\\yvar.8xy [--x value] [--y2 out.8xy] [--bench]\n");
+        printf("       derivative.exe --batch directory|manifest|- [--threads n] [--cache file [--cache-mb n]]\n");
         return -1;
     }
 
-    FILE *file;
-    fopen_s(&file, argv[1], "rb");
+    //many Y-vars on every core, see jobs.h for the output
+    if (!strcmp(argv[1], "--batch") && argc > 2) {
+        unsigned threads = 0;
+        const char *cache_path = NULL;
+        unsigned long cache_size = CACHE_DEFAULT_SIZE;
+        cache_t cache;
+        bool ok;
+
+        for (int i = 3; i < argc; i++) {
+            if (!strcmp(argv[i], "--threads") && i + 1 < argc)
+                threads = atoi(argv[++i]);
+            else if (!strcmp(argv[i], "--cache") && i + 1 < argc)
+                cache_path = argv[++i];
+            else if (!strcmp(argv[i], "--cache-mb") && i + 1 < argc)
+                cache_size = strtoul(argv[++i], NULL, 10) * 1024 * 1024;
+        }
+
+        if (cache_path != NULL && !cache_Open(&cache, cache_path, cache_size)) {
+            printf("Unable to open cache %s.\n", cache_path);
+            return -1;
+        }
+
+        ok = jobs_Run(argv[2], threads, cache_path != NULL ? &cache : NULL, stdout);
+
+        if (cache_path != NULL)
+            cache_Close(&cache);
+
+        if (!ok) {
+            printf("Unable to process %s.\n", argv[2]);
+            return -1;
+        }
 
-    if (!file) {
+        return 0;
+    }
+
+    yvar_file_t file;
+    if (!yvar_Open(&file, argv[1])) {
         printf("File not found.\n");
         return -1;
     }
 
+    //the first equation in the file, its tokens are read straight out of the mapping
     yvar_t yvar;
-    if (yvar_Read(&yvar, file) != 0) {
+    if (yvar_NextEquation(&file, &yvar) != 1) {
         printf("Corrupt or invalid 8xy file.\n");
         return -1;
     }
 
-    tokenizer_t t;
-    error = tokenize(&t, yvar.data, yvar.yvar_data_len);
+    //everything from tokenizing on is released at once at the end
+    arena_Create(&arena, ARENA_BLOCK_SIZE);
+    ast_UseArena(&arena);
+
+    ast_t *e = parse_equation(yvar.tokens, yvar.tokens_length, &error);
 
-    if (error != E_SUCCESS) {
+    if (error == E_TOK_UNIDENTIFIED) {
         printf("Syntax error: unable to tokenize yvar.\n");
         return -1;
     }
 
-    ast_t *e = parse(&t, &error);
+    if (error == E_MEMORY) {
+        printf("Out of memory.\n");
+        return -1;
+    }
 
     if (e == NULL) {
         printf("Syntax error: unable to parse ast.\n");
         return -1;
     }
 
-    ast_t *simplified = simplify(e);
+    ast_t *simplified = simplify_fixpoint(e, NULL);
 
     if (simplified == NULL) {
         printf("Simplify error: unable to simplify ast.\n");
@@ -53,53 +272,171 @@ int main(int argc, const char **argv) {
 
     ast_t *deriv = derivative(e, 'X', &error);
 
+    if (error == E_MEMORY) {
+        printf("Out of memory.\n");
+        return -1;
+    }
+
     if (deriv == NULL) {
         printf("Derivative error: unable to find derivative of ast.\n");
         return -1;
     }
 
-    ast_t *simplified_derivative = simplify(deriv);
+    ast_t *simplified_derivative = simplify_fixpoint(deriv, NULL);
 
     if (simplified_derivative == NULL) {
         printf("Simplify error: unable to simplify derivative.\n");
         return -1;
     }
 
+    cse_stats_t stats;
+    ast_t *shared_derivative = cse(simplified_derivative, &stats);
+
+    if (shared_derivative == NULL) {
+        printf("Out of memory.\n");
+        return -1;
+    }
+
     unsigned size = 0;
     to_binary(deriv, &size, &error);
     
-    //hacky because the default undefined behavior when evaluate() encounters
-    //an unknown variable is to return -1 as its value
+    env_t env;
     double x = -1;
-    printf("f(%g) =       %.17g\n", x, evaluate(e));
-    printf("f_simp(%g) =  %.17g\n", x, evaluate(simplified));
-    printf("f'(%g) =      %.17g\n", x, evaluate(deriv));
-    printf("f'_simp(%g) = %.17g\n", x, evaluate(simplified_derivative));
+    double values[4];
+    Error errors[4];
+    ast_t *trees[4] = { e, simplified, deriv, simplified_derivative };
+    const char *labels[4] = { "f(%g) =       ", "f_simp(%g) =  ", "f'(%g) =      ", "f'_simp(%g) = " };
+
+    const char *y2 = NULL;
+    bool bench = false;
+
+    for (int i = 2; i < argc; i++) {
+        if (!strcmp(argv[i], "--x") && i + 1 < argc)
+            x = atof(argv[++i]);
+        else if (!strcmp(argv[i], "--y2") && i + 1 < argc)
+            y2 = argv[++i];
+        else if (!strcmp(argv[i], "--bench"))
+            bench = true;
+    }
+
+    env_Create(&env);
+    env_Set(&env, 'X', x);
+
+    for (int i = 0; i < 4; i++) {
+        errors[i] = evaluate_env(trees[i], &env, &values[i]);
+
+        printf(labels[i], x);
+        if (errors[i] == E_EVAL_UNBOUND)
+            printf("unbound variable\n");
+        else
+            printf("%.17g\n", values[i]);
+    }
+
+    //the same derivative without building a tree, as a cross check
+    dual_t dual;
+    Error dual_error = evaluate_dual(e, &env, 'X', &dual);
+
+    printf("f'(%g) dual =  ", x);
+    if (dual_error == E_SUCCESS)
+        printf("%.17g\n", dual.derivative);
+    else
+        printf("error %i\n", dual_error);
+
+    //every partial at once, only when all the symbols are bound
+    tape_t tape;
+    if (tape_Record(e, &tape) == E_SUCCESS) {
+        double tape_values[PROGRAM_MAX_SYMBOLS], gradient[PROGRAM_MAX_SYMBOLS], value;
+
+        if (program_Bind(&tape.program, &env, tape_values) == E_SUCCESS
+            && tape_Gradient(&tape, tape_values, &value, gradient) == E_SUCCESS) {
+            for (unsigned i = 0; i < tape.program.amount_symbols; i++)
+                printf("df/d%c tape =   %.17g\n", tape.program.symbols[i], gradient[i]);
+        }
+
+        tape_Cleanup(&tape);
+    }
+
+    //higher derivatives without taking the derivative of the derivative
+    taylor_t taylor;
+    if (taylor_Record(e, 'X', 3, &taylor) == E_SUCCESS) {
+        double taylor_values[PROGRAM_MAX_SYMBOLS], derivatives[4];
+
+        if (program_Bind(&taylor.program, &env, taylor_values) == E_SUCCESS
+            && taylor_Derivatives(&taylor, taylor_values, derivatives) == E_SUCCESS) {
+            printf("f''(%g) taylor = %.17g\n", x, derivatives[2]);
+            printf("f'''(%g) taylor = %.17g\n", x, derivatives[3]);
+        }
+
+        taylor_Cleanup(&taylor);
+    }
 
     printf("\nsize of f(x):       %i\n", ast_CountNodes(e));
     printf("size of f_simp(x):  %i\n", ast_CountNodes(simplified));
     printf("size of f'(x):      %i\n", ast_CountNodes(deriv));
     printf("size of f'_simp(x): %i\n", ast_CountNodes(simplified_derivative));
 
+    printf("\nCSE of f'_simp(x): %u nodes -> %u unique (saved %u evaluations)\n",
+        stats.nodes, stats.unique, stats.nodes - stats.unique);
+
     printf("\nBinary size: %i", size);
+    printf("\nMemory used: %lu bytes", arena_Used(&arena));
 
-    if (evaluate(e) != evaluate(simplified))
+    if (!same_value(values[0], values[1]) && !errors[0])
         printf("\nWARNING: Simplified expression does not equal the original at %g\n", x);
 
-    if (evaluate(deriv) != evaluate(simplified_derivative))
+    if (!same_value(values[2], values[3]) && !errors[2])
         printf("\nWARNING: Simplified derivative does not equal the original derivative at %g\n", x);
 
+    if (!dual_error && !errors[2] && !same_value(dual.derivative, values[2]))
+        printf("\nWARNING: Dual number derivative does not equal the symbolic derivative at %g\n", x);
+
     printf("\n");
 
+    //what the calculator would put in Y2
+    if (y2 != NULL) {
+        unsigned y2_size;
+        uint8_t *tokens = to_binary(simplified_derivative, &y2_size, &error);
+        FILE *out = NULL;
+        yvar_t var;
+
+        if (tokens != NULL) {
+#ifdef _MSC_VER
+            fopen_s(&out, y2, "wb");
+#else
+            out = fopen(y2, "wb");
+#endif
+            yvar_Equation(&var, YVAR_Y2, tokens, (uint16_t)y2_size);
+        }
+
+        if (tokens == NULL || !out || !yvar_Write(out, "Derivative", &var, 1))
+            printf("Unable to write %s.\n", y2);
+
+        if (out)
+            fclose(out);
+    }
+
+    if (bench) {
+        printf("\n");
+        bench_evaluate("f(x)", e);
+        bench_evaluate("f_simp(x)", simplified);
+        bench_evaluate("f'(x)", deriv);
+        bench_evaluate("f'_simp(x)", simplified_derivative);
+        bench_evaluate("f'_cse(x)", shared_derivative);
+        bench_dual(e, simplified_derivative, &env);
+        bench_gradient(e);
+        bench_taylor(e);
+    }
+
     ast_Cleanup(e);
     ast_Cleanup(simplified);
     ast_Cleanup(deriv);
     ast_Cleanup(simplified_derivative);
+    ast_Cleanup(shared_derivative);
 
-    tokenizer_Cleanup(&t);
+    ast_UseArena(NULL);
+    arena_Cleanup(&arena);
 
-    yvar_Cleanup(&yvar);
-    fclose(file);
+    yvar_Close(&file);
 
     return 0;
 }
@@ -0,0 +1,225 @@
+#ifdef COMPILE_PC
+
+#include "pool.h"
+
+#include <stdlib.h>
+
+#ifdef _WIN32
+#define THREAD_MAIN DWORD WINAPI
+#define THREAD_DONE 0
+#define thread_Start(t, main, arg) ((*(t) = CreateThread(NULL, 0, main, arg, 0, NULL)) != NULL)
+#define thread_Join(t) (WaitForSingleObject(t, INFINITE), CloseHandle(t))
+
+#define lock_Create(l) InitializeSRWLock(l)
+#define lock_Cleanup(l)
+#define lock(l) AcquireSRWLockExclusive(l)
+#define unlock(l) ReleaseSRWLockExclusive(l)
+
+#define cond_Create(c) InitializeConditionVariable(c)
+#define cond_Cleanup(c)
+#define cond_Wait(c, l) SleepConditionVariableSRW(c, l, INFINITE, 0)
+#define cond_WakeAll(c) WakeAllConditionVariable(c)
+#else
+#include <unistd.h>
+
+#define THREAD_MAIN void *
+#define THREAD_DONE NULL
+#define thread_Start(t, main, arg) (pthread_create(t, NULL, main, arg) == 0)
+#define thread_Join(t) pthread_join(t, NULL)
+
+#define lock_Create(l) pthread_mutex_init(l, NULL)
+#define lock_Cleanup(l) pthread_mutex_destroy(l)
+#define lock(l) pthread_mutex_lock(l)
+#define unlock(l) pthread_mutex_unlock(l)
+
+#define cond_Create(c) pthread_cond_init(c, NULL)
+#define cond_Cleanup(c) pthread_cond_destroy(c)
+#define cond_Wait(c, l) pthread_cond_wait(c, l)
+#define cond_WakeAll(c) pthread_cond_broadcast(c)
+#endif
+
+unsigned pool_Cores(void) {
+#ifdef _WIN32
+    SYSTEM_INFO info;
+    GetSystemInfo(&info);
+    return info.dwNumberOfProcessors;
+#else
+    long cores = sysconf(_SC_NPROCESSORS_ONLN);
+    return cores > 0 ? (unsigned)cores : 1;
+#endif
+}
+
+//the front of this worker's own share
+bool take_item(pool_worker_t *w, unsigned *item) {
+    bool found;
+
+    lock(&w->lock);
+    found = w->next < w->end;
+    if (found)
+        *item = w->next++;
+    unlock(&w->lock);
+
+    return found;
+}
+
+//the back half of the first share that isn't empty, starting with the next worker along.
+//the first of the stolen items is returned and the rest become this worker's share
+bool steal_item(pool_worker_t *thief, unsigned *item) {
+    pool_t *p = thief->pool;
+    unsigned self = (unsigned)(thief - p->workers);
+    unsigned i, end = 0;
+    bool found = false;
+
+    for (i = 1; i < p->amount_workers && !found; i++) {
+        pool_worker_t *victim = &p->workers[(self + i) % p->amount_workers];
+
+        lock(&victim->lock);
+        found = victim->next < victim->end;
+        if (found) {
+            end = victim->end;
+            victim->end -= (victim->end - victim->next + 1) / 2;
+            *item = victim->end;
+        }
+        unlock(&victim->lock);
+    }
+
+    if (found) {
+        lock(&thief->lock);
+        thief->next = *item + 1;
+        thief->end = end;
+        unlock(&thief->lock);
+    }
+
+    return found;
+}
+
+THREAD_MAIN worker_Main(void *arg) {
+    pool_worker_t *w = arg;
+    pool_t *p = w->pool;
+    unsigned self = (unsigned)(w - p->workers);
+    unsigned generation = 0;
+
+    for (;;) {
+        unsigned item;
+
+        lock(&p->lock);
+        while (!p->quit && p->generation == generation)
+            cond_Wait(&p->start, &p->lock);
+
+        if (p->quit) {
+            unlock(&p->lock);
+            return THREAD_DONE;
+        }
+
+        generation = p->generation;
+        unlock(&p->lock);
+
+        while (take_item(w, &item) || steal_item(w, &item))
+            p->work(p->context, self, item);
+
+        lock(&p->lock);
+        if (--p->busy == 0)
+            cond_WakeAll(&p->finished);
+        unlock(&p->lock);
+    }
+}
+
+bool pool_Create(pool_t *p, unsigned workers) {
+    unsigned i;
+
+    if (workers == 0)
+        workers = pool_Cores();
+    if (workers > POOL_MAX_WORKERS)
+        workers = POOL_MAX_WORKERS;
+
+    p->amount_workers = 0;
+    p->generation = 0;
+    p->busy = 0;
+    p->quit = false;
+
+    lock_Create(&p->lock);
+    cond_Create(&p->start);
+    cond_Create(&p->finished);
+
+    p->workers = malloc(workers * sizeof(pool_worker_t));
+
+    if (p->workers == NULL) {
+        pool_Cleanup(p);
+        return false;
+    }
+
+    //the ones that did start are enough to get the work done
+    for (i = 0; i < workers; i++) {
+        pool_worker_t *w = &p->workers[i];
+
+        w->pool = p;
+        w->next = w->end = 0;
+        lock_Create(&w->lock);
+
+        if (!thread_Start(&w->thread, worker_Main, w)) {
+            lock_Cleanup(&w->lock);
+            break;
+        }
+
+        p->amount_workers++;
+    }
+
+    if (p->amount_workers == 0) {
+        pool_Cleanup(p);
+        return false;
+    }
+
+    return true;
+}
+
+void pool_Cleanup(pool_t *p) {
+    unsigned i;
+
+    lock(&p->lock);
+    p->quit = true;
+    cond_WakeAll(&p->start);
+    unlock(&p->lock);
+
+    for (i = 0; i < p->amount_workers; i++) {
+        thread_Join(p->workers[i].thread);
+        lock_Cleanup(&p->workers[i].lock);
+    }
+
+    free(p->workers);
+    p->workers = NULL;
+    p->amount_workers = 0;
+
+    cond_Cleanup(&p->start);
+    cond_Cleanup(&p->finished);
+    lock_Cleanup(&p->lock);
+}
+
+void pool_Run(pool_t *p, unsigned amount, pool_work_t work, void *context) {
+    unsigned i;
+
+    lock(&p->lock);
+
+    p->work = work;
+    p->context = context;
+
+    //even shares to start with, the stealing evens out the rest
+    for (i = 0; i < p->amount_workers; i++) {
+        pool_worker_t *w = &p->workers[i];
+
+        lock(&w->lock);
+        w->next = (unsigned)((unsigned long long)amount * i / p->amount_workers);
+        w->end = (unsigned)((unsigned long long)amount * (i + 1) / p->amount_workers);
+        unlock(&w->lock);
+    }
+
+    p->busy = p->amount_workers;
+    p->generation++;
+    cond_WakeAll(&p->start);
+
+    while (p->busy > 0)
+        cond_Wait(&p->finished, &p->lock);
+
+    unlock(&p->lock);
+}
+
+#endif
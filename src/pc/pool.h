@@ -0,0 +1,68 @@
+#ifdef COMPILE_PC
+
+#ifndef _POOL_H_
+#define _POOL_H_
+
+#include <stdbool.h>
+
+#ifdef _WIN32
+#include <windows.h>
+typedef HANDLE pool_thread_t;
+typedef SRWLOCK pool_lock_t;
+typedef CONDITION_VARIABLE pool_cond_t;
+#else
+#include <pthread.h>
+typedef pthread_t pool_thread_t;
+typedef pthread_mutex_t pool_lock_t;
+typedef pthread_cond_t pool_cond_t;
+#endif
+
+//Fixed set of worker threads that run one batch of numbered items at a time. Each worker
+//starts with an even share of the items and takes them from the front of its share. A worker
+//that runs out steals the back half of someone else's, so a few slow items don't hold up
+//everyone else.
+
+#define POOL_MAX_WORKERS 256
+
+//called once per item, worker is which thread it's running on, 0 to workers - 1
+typedef void (*pool_work_t)(void *context, unsigned worker, unsigned item);
+
+typedef struct _PoolWorker {
+    struct _Pool *pool;
+    pool_thread_t thread;
+
+    //items next to end - 1 haven't been started yet. thieves take from the end
+    pool_lock_t lock;
+    unsigned next, end;
+} pool_worker_t;
+
+typedef struct _Pool {
+    pool_worker_t *workers;
+    unsigned amount_workers;
+
+    //guards everything below
+    pool_lock_t lock;
+    pool_cond_t start, finished;
+
+    //bumped for every batch so sleeping workers can tell a new one has started
+    unsigned generation;
+    unsigned busy;
+    bool quit;
+
+    pool_work_t work;
+    void *context;
+} pool_t;
+
+//how many threads the machine can run at once
+unsigned pool_Cores(void);
+
+//starts the workers, 0 for one per core. returns false if none could be started
+bool pool_Create(pool_t *p, unsigned workers);
+void pool_Cleanup(pool_t *p);
+
+//runs work on items 0 to amount - 1 and returns once they're all done
+void pool_Run(pool_t *p, unsigned amount, pool_work_t work, void *context);
+
+#endif
+
+#endif
@@ -3,68 +3,270 @@
 #include "yvar.h"
 
 #include <string.h>
-#include <malloc.h>
+#include <stdlib.h>
 
-int read_header(header_t *header, FILE *file) {
-    char buffer[9] = { 0 };
-    fread(buffer, 1, 8, file);
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
 
-    if (strcmp(buffer, "**TI83F*"))
-        return -1;
+#define SIGNATURE "**TI83F*\x1A\x0A"
+#define SIGNATURE_LENGTH 10
 
-    fread(buffer, 1, 3, file);
+//signature, a byte that's 0 on newer calculators, the comment and the length of the data
+#define HEADER_LENGTH 55
+#define COMMENT_LENGTH 42
+#define CHECKSUM_LENGTH 2
 
-    if (buffer[0] != 26 || buffer[1] != 10 || buffer[2] != 0)
-        return -1;
+//each variable starts with the length of the rest of its header: the length of the data, the
+//type, the name, and then the version and flag, which the short form leaves out. the length of
+//the data is given again right before it
+#define ENTRY_SHORT 11
+#define ENTRY_LONG 13
+#define NAME_LENGTH 8
+#define entry_size(header_length) ((size_t)(2 + (header_length) + 2))
+
+#define read16(p) ((uint16_t)((p)[0] | (p)[1] << 8))
+#define write16(p, n) ((p)[0] = (uint8_t)(n), (p)[1] = (uint8_t)((n) >> 8))
+
+bool yvar_Open(yvar_file_t *f, const char *path) {
+    f->start = NULL;
+    f->size = 0;
+    f->next = f->section_end = 0;
+    f->in_section = false;
+
+#ifdef _WIN32
+    LARGE_INTEGER size;
+
+    f->mapping = NULL;
+    f->file = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+
+    if (f->file == INVALID_HANDLE_VALUE)
+        return false;
+
+    if (GetFileSizeEx(f->file, &size) && size.QuadPart > 0)
+        f->mapping = CreateFileMappingA(f->file, NULL, PAGE_READONLY, 0, 0, NULL);
+
+    if (f->mapping != NULL)
+        f->start = MapViewOfFile(f->mapping, FILE_MAP_READ, 0, 0, 0);
+
+    if (f->start == NULL) {
+        yvar_Close(f);
+        return false;
+    }
+
+    f->size = (size_t)size.QuadPart;
+#else
+    struct stat info;
+    int file = open(path, O_RDONLY);
+    void *start;
+
+    if (file < 0)
+        return false;
 
-    fread(header->comment, 42, 1, file);
+    if (fstat(file, &info) != 0 || info.st_size <= 0) {
+        close(file);
+        return false;
+    }
 
-    fread(&header->var_len, 2, 1, file);
+    //the mapping stays valid after the file is closed
+    start = mmap(NULL, (size_t)info.st_size, PROT_READ, MAP_PRIVATE, file, 0);
+    close(file);
 
-    return 0;
+    if (start == MAP_FAILED)
+        return false;
+
+    f->start = start;
+    f->size = (size_t)info.st_size;
+#endif
+
+    return true;
+}
+
+void yvar_Close(yvar_file_t *f) {
+#ifdef _WIN32
+    if (f->start != NULL)
+        UnmapViewOfFile(f->start);
+    if (f->mapping != NULL)
+        CloseHandle(f->mapping);
+    if (f->file != INVALID_HANDLE_VALUE)
+        CloseHandle(f->file);
+    f->mapping = NULL;
+    f->file = INVALID_HANDLE_VALUE;
+#else
+    if (f->start != NULL)
+        munmap((void*)f->start, f->size);
+#endif
+
+    f->start = NULL;
+    f->size = 0;
 }
 
-//todo: more error handling?
-int yvar_Read(yvar_t *yvar, FILE *file) {
-    int error = 0;
-    uint16_t magic;
-    uint8_t var_id;
+uint16_t checksum(const uint8_t *data, size_t length) {
+    uint16_t sum = 0;
+    size_t i;
+
+    for (i = 0; i < length; i++)
+        sum += data[i];
+
+    return sum;
+}
+
+//checks the header and checksum of the file section at f->next and moves into its data
+bool enter_section(yvar_file_t *f) {
+    const uint8_t *header = f->start + f->next;
+    size_t length;
+
+    if (f->size - f->next < HEADER_LENGTH || memcmp(header, SIGNATURE, SIGNATURE_LENGTH))
+        return false;
+
+    length = read16(header + HEADER_LENGTH - 2);
 
-    if (error = read_header(&yvar->header, file) != 0)
-        return error;
+    if (f->size - f->next - HEADER_LENGTH < length + CHECKSUM_LENGTH)
+        return false;
 
-    fread(&magic, 2, 1, file);
+    if (checksum(header + HEADER_LENGTH, length) != read16(header + HEADER_LENGTH + length))
+        return false;
 
-    if (magic != 11 && magic != 13)
+    f->next += HEADER_LENGTH;
+    f->section_end = f->next + length;
+    f->in_section = true;
+    return true;
+}
+
+int yvar_Next(yvar_file_t *f, yvar_t *var) {
+    const uint8_t *entry;
+    uint16_t header_length;
+    size_t left;
+
+    //past the checksum of the last section, and into the next one if there is one
+    while (!f->in_section || f->next == f->section_end) {
+        if (f->in_section) {
+            f->next = f->section_end + CHECKSUM_LENGTH;
+            f->in_section = false;
+        }
+
+        if (f->next == f->size)
+            return 0;
+
+        if (!enter_section(f))
+            return -1;
+    }
+
+    entry = f->start + f->next;
+    left = f->section_end - f->next;
+
+    if (left < entry_size(ENTRY_SHORT))
         return -1;
 
-    fread(&yvar->len, 2, 1, file);
+    header_length = read16(entry);
+    if ((header_length != ENTRY_SHORT && header_length != ENTRY_LONG) || left < entry_size(header_length))
+        return -1;
 
-    fread(&var_id, 1, 1, file);
+    var->length = read16(entry + 2);
+    var->type = entry[4];
+    memcpy(var->name, entry + 5, NAME_LENGTH);
+    var->name[NAME_LENGTH] = 0;
+    var->version = header_length == ENTRY_LONG ? entry[13] : 0;
+    var->flag = header_length == ENTRY_LONG ? entry[14] : 0;
 
-    if (var_id != 3)
+    if (read16(entry + 2 + header_length) != var->length || left - entry_size(header_length) < var->length)
         return -1;
 
-    fread(yvar->name, 1, 8, file);
+    var->data = entry + entry_size(header_length);
+    var->tokens = NULL;
+    var->tokens_length = 0;
 
-    fread(&yvar->version, 1, 1, file);
+    if (yvar_IsEquation(var)) {
+        if (var->length < 2 || read16(var->data) > var->length - 2)
+            return -1;
 
-    fread(&yvar->flag, 1, 1, file);
+        var->tokens = var->data + 2;
+        var->tokens_length = read16(var->data);
+    }
 
-    fread(&yvar->len, 2, 1, file);
+    f->next += entry_size(header_length) + var->length;
+    return 1;
+}
 
-    fread(&yvar->yvar_data_len, 2, 1, file);
+int yvar_NextEquation(yvar_file_t *f, yvar_t *var) {
+    int found;
 
-    yvar->data = malloc(yvar->len);
-    fread(yvar->data, yvar->len, 1, file);
+    while ((found = yvar_Next(f, var)) == 1 && !yvar_IsEquation(var))
+        ;
+
+    return found;
+}
 
-    fread(&yvar->header.checksum, 2, 1, file);
+void yvar_Equation(yvar_t *var, const char *name, const uint8_t *tokens, uint16_t length) {
+    var->type = YVAR_EQUATION;
+    memset(var->name, 0, sizeof(var->name));
+    strncpy(var->name, name, NAME_LENGTH);
+    var->version = 0;
+    var->flag = 0;
 
-    return error;
+    var->data = NULL;
+    var->length = length + 2;
+    var->tokens = tokens;
+    var->tokens_length = length;
 }
 
-void yvar_Cleanup(yvar_t *yvar) {
-    free(yvar->data);
+bool yvar_Write(FILE *file, const char *comment, const yvar_t *vars, unsigned amount) {
+    unsigned long length = 0;
+    uint8_t *buffer, *at;
+    unsigned i;
+    bool ok;
+
+    for (i = 0; i < amount; i++)
+        length += entry_size(ENTRY_LONG) + (yvar_IsEquation(&vars[i]) ? vars[i].tokens_length + 2u : vars[i].length);
+
+    if (length > 0xFFFF)
+        return false;
+
+    buffer = malloc(HEADER_LENGTH + length + CHECKSUM_LENGTH);
+    if (buffer == NULL)
+        return false;
+
+    memcpy(buffer, SIGNATURE, SIGNATURE_LENGTH);
+    buffer[SIGNATURE_LENGTH] = 0;
+    memset(buffer + SIGNATURE_LENGTH + 1, 0, COMMENT_LENGTH);
+    strncpy((char*)buffer + SIGNATURE_LENGTH + 1, comment, COMMENT_LENGTH);
+    write16(buffer + HEADER_LENGTH - 2, length);
+
+    at = buffer + HEADER_LENGTH;
+
+    for (i = 0; i < amount; i++) {
+        const yvar_t *var = &vars[i];
+        uint16_t data_length = yvar_IsEquation(var) ? var->tokens_length + 2 : var->length;
+
+        write16(at, ENTRY_LONG);
+        write16(at + 2, data_length);
+        at[4] = var->type;
+        memcpy(at + 5, var->name, NAME_LENGTH);
+        at[13] = var->version;
+        at[14] = var->flag;
+        write16(at + 2 + ENTRY_LONG, data_length);
+        at += entry_size(ENTRY_LONG);
+
+        if (yvar_IsEquation(var)) {
+            write16(at, var->tokens_length);
+            memcpy(at + 2, var->tokens, var->tokens_length);
+        } else {
+            memcpy(at, var->data, var->length);
+        }
+
+        at += data_length;
+    }
+
+    write16(at, checksum(buffer + HEADER_LENGTH, length));
+
+    ok = fwrite(buffer, 1, HEADER_LENGTH + length + CHECKSUM_LENGTH, file) == HEADER_LENGTH + length + CHECKSUM_LENGTH;
+    free(buffer);
+    return ok;
 }
 
-#endif
\ No newline at end of file
+#endif
@@ -5,32 +5,67 @@
 
 #include <stdio.h>
 #include <stdint.h>
+#include <stdbool.h>
 
-typedef struct {
-    char comment[42];
-    uint16_t var_len;
-    uint16_t checksum;
-} header_t;
+//Reads and writes TI-83+/84+ variable files: .8xy, .8xg groups with several variables, and
+//any number of those concatenated into one archive. Files are memory mapped and read in
+//place, so a variable's tokens point straight into the mapping and are only valid until the
+//file is closed. Every length is read byte by byte, so this works on any endianness.
 
-typedef struct {
-    header_t header;
+//the type of an equation, the upper bits only say whether it's selected to be graphed
+#define YVAR_EQUATION 0x03
+#define yvar_IsEquation(var) (((var)->type & 0x1F) == YVAR_EQUATION)
 
-    uint16_t len;
+//names of the first few equations, as the calculator tokenizes them
+#define YVAR_Y1 "\x5E\x10"
+#define YVAR_Y2 "\x5E\x11"
 
-    char name[8];
+typedef struct _YVar {
+    uint8_t type;
+    char name[9]; //up to 8 bytes, zero terminated
     uint8_t version;
     uint8_t flag;
 
-    uint16_t yvar_data_len;
-    uint8_t *data;
+    //everything the variable holds. for an equation that's the length of the tokens first
+    const uint8_t *data;
+    uint16_t length;
+
+    //only for equations
+    const uint8_t *tokens;
+    uint16_t tokens_length;
 } yvar_t;
 
-//only works on little endian systems right now.
+typedef struct _YVarFile {
+    const uint8_t *start;
+    size_t size;
+
+    //the variable after the last one read and the end of the data section it's in
+    size_t next, section_end;
+    bool in_section;
+
+#ifdef _WIN32
+    void *file, *mapping;
+#endif
+} yvar_file_t;
+
+//returns false if the file can't be opened or is empty
+bool yvar_Open(yvar_file_t *f, const char *path);
+void yvar_Close(yvar_file_t *f);
+
+//the next variable in the file, in any section. returns 1 for a variable, 0 at the end of the
+//file and -1 if the file is cut short, isn't a variable file or fails its checksum
+int yvar_Next(yvar_file_t *f, yvar_t *var);
 
-int yvar_Read(yvar_t *yvar, FILE *file);
+//the next equation, skipping anything else, with the same return values as yvar_Next
+int yvar_NextEquation(yvar_file_t *f, yvar_t *var);
 
-void yvar_Cleanup(yvar_t *yvar);
+//makes var the equation called name with these tokens, which aren't copied
+void yvar_Equation(yvar_t *var, const char *name, const uint8_t *tokens, uint16_t length);
+
+//writes the variables to file as one .8xy or .8xg with its checksum, in a single write.
+//returns false if they don't fit in one file or the write fails
+bool yvar_Write(FILE *file, const char *comment, const yvar_t *vars, unsigned amount);
 
 #endif
 
-#endif
\ No newline at end of file
+#endif
@@ -0,0 +1,509 @@
+#include "poly.h"
+
+#include <string.h>
+
+#include "cas.h"
+#include "nary.h"
+#include "stack.h"
+
+void poly_Set(poly_t *p, ratio_t c) {
+    p->degree = 0;
+    p->coefficients[0] = c;
+}
+
+//drops leading zeros
+void poly_Trim(poly_t *p) {
+    while (p->degree > 0 && p->coefficients[p->degree].num == 0)
+        p->degree--;
+}
+
+bool poly_IsZero(const poly_t *p) {
+    return p->degree == 0 && p->coefficients[0].num == 0;
+}
+
+bool poly_Equal(const poly_t *a, const poly_t *b) {
+    uint8_t i;
+
+    if (a->degree != b->degree)
+        return false;
+
+    for (i = 0; i <= a->degree; i++) {
+        if (a->coefficients[i].num != b->coefficients[i].num || a->coefficients[i].den != b->coefficients[i].den)
+            return false;
+    }
+
+    return true;
+}
+
+//r = a + sign * b. r can be a or b
+bool poly_Add(poly_t *r, const poly_t *a, const poly_t *b, int sign) {
+    uint8_t degree = a->degree > b->degree ? a->degree : b->degree;
+    ratio_t zero = { 0, 1, false };
+    uint8_t i;
+
+    for (i = 0; i <= degree; i++) {
+        ratio_t left = i <= a->degree ? a->coefficients[i] : zero;
+        ratio_t right = i <= b->degree ? b->coefficients[i] : zero;
+
+        right.num *= sign;
+
+        if (!ratio_Add(&r->coefficients[i], left, right))
+            return false;
+    }
+
+    r->degree = degree;
+    poly_Trim(r);
+    return true;
+}
+
+//r can't be a or b
+bool poly_Mul(poly_t *r, const poly_t *a, const poly_t *b) {
+    ratio_t zero = { 0, 1, false };
+    uint8_t i, j;
+
+    if (poly_IsZero(a) || poly_IsZero(b)) {
+        poly_Set(r, zero);
+        return true;
+    }
+
+    if (a->degree + b->degree > POLY_MAX_DEGREE)
+        return false;
+
+    r->degree = a->degree + b->degree;
+
+    for (i = 0; i <= r->degree; i++)
+        r->coefficients[i] = zero;
+
+    for (i = 0; i <= a->degree; i++) {
+        for (j = 0; j <= b->degree; j++) {
+            ratio_t product;
+
+            if (!ratio_Mul(&product, a->coefficients[i], b->coefficients[j])
+                || !ratio_Add(&r->coefficients[i + j], r->coefficients[i + j], product))
+                return false;
+        }
+    }
+
+    return true;
+}
+
+//p = p^exponent by repeated multiplication, which the degree limit keeps short
+bool poly_Pow(poly_t *p, uint32_t exponent) {
+    poly_t base = *p, result;
+    ratio_t one = { 1, 1, false };
+
+    poly_Set(p, one);
+
+    while (exponent--) {
+        if (!poly_Mul(&result, p, &base))
+            return false;
+        *p = result;
+    }
+
+    return true;
+}
+
+//the whole exponent of x^n, for n from 0 to what fits
+bool whole_exponent(ast_t *e, int32_t *exponent) {
+    ratio_t r;
+
+    if (!ratio_FromAst(e, &r) || r.den != 1 || r.num > POLY_MAX_DEGREE || r.num < -POLY_MAX_DEGREE)
+        return false;
+
+    *exponent = r.num;
+    return true;
+}
+
+bool poly_IsArithmetic(TokenType operator) {
+    switch (operator) {
+    case TOK_NEGATE:
+    case TOK_RECRIPROCAL:
+    case TOK_SQUARE:
+    case TOK_CUBE:
+    case TOK_ADD:
+    case TOK_SUBTRACT:
+    case TOK_MULTIPLY:
+    case TOK_DIVIDE:
+    case TOK_FRACTION:
+    case TOK_POWER:
+        return true;
+    default:
+        return false;
+    }
+}
+
+//numerator / denominator, what every subtree becomes on the way up
+typedef struct _Quotient {
+    poly_t numerator, denominator;
+} quotient_t;
+
+//x / 1 or c / 1 for the leaves, false when e isn't one of them
+bool quotient_Leaf(ast_t *e, uint8_t symbol, quotient_t *q) {
+    ratio_t c, zero = { 0, 1, false }, one = { 1, 1, false };
+
+    poly_Set(&q->denominator, one);
+
+    if (ratio_FromAst(e, &c)) {
+        poly_Set(&q->numerator, c);
+        return true;
+    }
+
+    if (e->type != NODE_SYMBOL || e->op.symbol != symbol || POLY_MAX_DEGREE < 1)
+        return false;
+
+    q->numerator.degree = 1;
+    q->numerator.coefficients[0] = zero;
+    q->numerator.coefficients[1] = one;
+    return true;
+}
+
+//q = 1 / q
+bool quotient_Invert(quotient_t *q) {
+    poly_t n;
+
+    if (poly_IsZero(&q->numerator))
+        return false;
+
+    n = q->numerator;
+    q->numerator = q->denominator;
+    q->denominator = n;
+    return true;
+}
+
+//q = the operator of e applied to q, and r for binary ones. exponent is the whole exponent
+//of a power
+bool quotient_Apply(ast_t *e, int32_t exponent, quotient_t *q, const quotient_t *r) {
+    poly_t product;
+    uint8_t i;
+
+    if (e->type == NODE_UNARY) {
+        switch (e->op.unary.operator) {
+        case TOK_NEGATE:
+            for (i = 0; i <= q->numerator.degree; i++)
+                q->numerator.coefficients[i].num = -q->numerator.coefficients[i].num;
+            return true;
+        case TOK_RECRIPROCAL:
+            return quotient_Invert(q);
+        case TOK_SQUARE:
+        case TOK_CUBE:
+            exponent = e->op.unary.operator == TOK_SQUARE ? 2 : 3;
+            return poly_Pow(&q->numerator, exponent) && poly_Pow(&q->denominator, exponent);
+        }
+
+        return false;
+    }
+
+    switch (e->op.binary.operator) {
+    case TOK_POWER:
+        if (exponent < 0) {
+            if (!quotient_Invert(q))
+                return false;
+            exponent = -exponent;
+        }
+
+        return poly_Pow(&q->numerator, exponent) && poly_Pow(&q->denominator, exponent);
+    case TOK_ADD:
+    case TOK_SUBTRACT: {
+        int sign = e->op.binary.operator == TOK_ADD ? 1 : -1;
+
+        //a/b + c/b keeps the denominator as it is
+        if (poly_Equal(&q->denominator, &r->denominator))
+            return poly_Add(&q->numerator, &q->numerator, &r->numerator, sign);
+
+        //a/b + c/d = (ad + cb) / bd
+        if (!poly_Mul(&product, &q->numerator, &r->denominator))
+            return false;
+        q->numerator = product;
+
+        if (!poly_Mul(&product, &r->numerator, &q->denominator) || !poly_Add(&q->numerator, &q->numerator, &product, sign))
+            return false;
+
+        if (!poly_Mul(&product, &q->denominator, &r->denominator))
+            return false;
+        q->denominator = product;
+        return true;
+    } case TOK_MULTIPLY:
+        if (!poly_Mul(&product, &q->numerator, &r->numerator))
+            return false;
+        q->numerator = product;
+
+        if (!poly_Mul(&product, &q->denominator, &r->denominator))
+            return false;
+        q->denominator = product;
+        return true;
+    case TOK_DIVIDE:
+    case TOK_FRACTION:
+        if (poly_IsZero(&r->numerator))
+            return false;
+
+        if (!poly_Mul(&product, &q->numerator, &r->denominator))
+            return false;
+        q->numerator = product;
+
+        if (!poly_Mul(&product, &q->denominator, &r->numerator))
+            return false;
+        q->denominator = product;
+        return true;
+    }
+
+    return false;
+}
+
+//a node waiting on the quotients of its operands
+typedef struct _Visit {
+    ast_t *e;
+    bool expanded;
+    int32_t exponent; //of a power, found before its base is worked out
+} visit_t;
+
+bool poly_FromAstRational(ast_t *e, uint8_t symbol, poly_t *numerator, poly_t *denominator) {
+    stack_t visits, quotients;
+    visit_t v;
+    quotient_t *q, *r = NULL;
+    bool ok;
+
+    //a lone leaf doesn't need the walk
+    if (e->type != NODE_UNARY && e->type != NODE_BINARY) {
+        quotient_t leaf;
+
+        if (!quotient_Leaf(e, symbol, &leaf))
+            return false;
+
+        *numerator = leaf.numerator;
+        *denominator = leaf.denominator;
+        return true;
+    }
+
+    stack_CreateOf(&visits, visit_t);
+    stack_CreateOf(&quotients, quotient_t);
+
+    v.e = e;
+    v.expanded = false;
+    ok = stack_PushOf(&visits, visit_t, &v);
+
+    while (ok && !stack_IsEmpty(&visits)) {
+        visit_t *top = stack_PeekOf(&visits, visit_t);
+
+        if (!top->expanded) {
+            ast_t *first, *second = NULL;
+
+            //quotients are big enough that they're made where they go instead of being copied there
+            q = stack_Reserve(&quotients);
+
+            if (q == NULL) {
+                ok = false;
+                break;
+            }
+
+            if (quotient_Leaf(top->e, symbol, q)) {
+                stack_PopOf(&visits, visit_t);
+                continue;
+            }
+
+            stack_PopOf(&quotients, quotient_t);
+
+            //anything else is an operator to apply once its operands are done
+            if (top->e->type == NODE_UNARY) {
+                if (!poly_IsArithmetic(top->e->op.unary.operator))
+                    break;
+                first = top->e->op.unary.operand;
+            } else if (top->e->type == NODE_BINARY) {
+                ast_t *left = top->e->op.binary.left, *right = top->e->op.binary.right;
+
+                if (!poly_IsArithmetic(top->e->op.binary.operator)
+                    || (top->e->op.binary.operator == TOK_POWER && !whole_exponent(right, &top->exponent)))
+                    break;
+
+                //the exponent of a power was just checked, only the base has to be a quotient
+                first = left;
+                if (top->e->op.binary.operator != TOK_POWER)
+                    second = right;
+            } else {
+                break;
+            }
+
+            top->expanded = true;
+
+            //the left side ends up under the right one
+            v.expanded = false;
+            v.e = second;
+            if (second != NULL && !stack_PushOf(&visits, visit_t, &v))
+                break;
+            v.e = first;
+            ok = stack_PushOf(&visits, visit_t, &v);
+            continue;
+        }
+
+        v = *stack_PopOf(&visits, visit_t);
+
+        //applied in place, the right operand stays readable until the next push
+        if (v.e->type == NODE_BINARY && v.e->op.binary.operator != TOK_POWER)
+            r = stack_PopOf(&quotients, quotient_t);
+        q = stack_PeekOf(&quotients, quotient_t);
+
+        ok = quotient_Apply(v.e, v.exponent, q, r);
+    }
+
+    //stopped early on something that isn't a quotient of polynomials
+    ok = ok && stack_IsEmpty(&visits);
+
+    if (ok) {
+        q = stack_PopOf(&quotients, quotient_t);
+        *numerator = q->numerator;
+        *denominator = q->denominator;
+    }
+
+    stack_Cleanup(&visits);
+    stack_Cleanup(&quotients);
+    return ok;
+}
+
+bool poly_FromAst(ast_t *e, uint8_t symbol, poly_t *p) {
+    poly_t denominator;
+    uint8_t i;
+
+    if (!poly_FromAstRational(e, symbol, p, &denominator) || denominator.degree != 0)
+        return false;
+
+    //a constant denominator just scales the coefficients
+    for (i = 0; i <= p->degree; i++) {
+        if (!ratio_Div(&p->coefficients[i], p->coefficients[i], denominator.coefficients[0]))
+            return false;
+    }
+
+    return true;
+}
+
+bool poly_Derivative(const poly_t *p, poly_t *derivative) {
+    ratio_t zero = { 0, 1, false };
+    uint8_t i;
+
+    poly_Set(derivative, zero);
+
+    for (i = 1; i <= p->degree; i++) {
+        ratio_t power = { i, 1, false };
+
+        if (!ratio_Mul(&derivative->coefficients[i - 1], p->coefficients[i], power))
+            return false;
+    }
+
+    derivative->degree = p->degree > 0 ? p->degree - 1 : 0;
+    return true;
+}
+
+double poly_Evaluate(const poly_t *p, double x) {
+    double result = (double)p->coefficients[p->degree].num / p->coefficients[p->degree].den;
+    int i;
+
+    for (i = p->degree - 1; i >= 0; i--)
+        result = result * x + (double)p->coefficients[i].num / p->coefficients[i].den;
+
+    return result;
+}
+
+unsigned poly_CountNodes(const poly_t *p) {
+    unsigned nodes = 0;
+    int i;
+
+    for (i = p->degree; i >= 0; i--) {
+        ratio_t c = p->coefficients[i];
+
+        if (c.num == 0)
+            continue;
+
+        //joined to the terms before it
+        if (nodes > 0)
+            nodes++;
+
+        if (i > 0)
+            nodes += i == 1 ? 1 : i <= 3 ? 2 : 3;
+
+        //the coefficient, and the multiply it takes unless it's 1
+        if (i == 0 || (c.num != c.den && c.num != -c.den))
+            nodes += (c.den == 1 ? 1 : 3) + (i > 0);
+    }
+
+    return nodes > 0 ? nodes : 1;
+}
+
+ast_t *poly_ToAst(const poly_t *p, uint8_t symbol) {
+    ast_t *ret = NULL, *canonical;
+    bool started = false;
+    int i;
+
+    for (i = p->degree; i >= 0; i--) {
+        ratio_t c = p->coefficients[i];
+        ast_t *term;
+
+        if (c.num == 0)
+            continue;
+
+        if (i == 0) {
+            term = ratio_ToAst(c);
+        } else {
+            ratio_t power = { i, 1, false };
+
+            term = ast_MakeSymbol(symbol);
+            if (i > 1)
+                term = ast_MakeBinary(TOK_POWER, term, ratio_ToAst(power));
+
+            term = ast_MakeBinary(TOK_MULTIPLY, ratio_ToAst(c), term);
+        }
+
+        ret = started ? ast_MakeBinary(TOK_ADD, ret, term) : term;
+        started = true;
+    }
+
+    if (!started) {
+        ratio_t zero = { 0, 1, false };
+        return ratio_ToAst(zero);
+    }
+
+    if (ret == NULL)
+        return NULL;
+
+    //the same layout simplify would give it, signs on the - and powers as squares and cubes
+    canonical = nary_Simplify(ret);
+
+    if (canonical == NULL)
+        return ret;
+
+    ast_Cleanup(ret);
+    return canonical;
+}
+
+ast_t *poly_DerivativeAst(ast_t *e, uint8_t symbol) {
+    poly_t n, d, dn, dd, left, right, scale;
+    ratio_t inverse, one = { 1, 1, false };
+
+    if (!poly_FromAstRational(e, symbol, &n, &d))
+        return NULL;
+
+    if (d.degree == 0) {
+        //dividing by a constant only scales. a factored polynomial like (X+1)^3 would only grow
+        //from being multiplied out, so it's left to the chain rule
+        if (!ratio_Div(&inverse, one, d.coefficients[0]))
+            return NULL;
+
+        poly_Set(&scale, inverse);
+
+        if (!poly_Mul(&left, &n, &scale) || !poly_Derivative(&left, &dn) || poly_CountNodes(&dn) > ast_CountNodes(e))
+            return NULL;
+
+        return poly_ToAst(&dn, symbol);
+    }
+
+    //(n'd - nd') / d^2, with the square left as one
+    if (!poly_Derivative(&n, &dn) || !poly_Derivative(&d, &dd) || !poly_Mul(&left, &dn, &d)
+        || !poly_Mul(&right, &n, &dd) || !poly_Add(&left, &left, &right, -1))
+        return NULL;
+
+    //the same goes for a multiplied out numerator and denominator, like 1/(X+1)^5 would get
+    if (poly_CountNodes(&left) + poly_CountNodes(&d) + 2 > ast_CountNodes(e))
+        return NULL;
+
+    return ast_MakeBinary(TOK_FRACTION,
+        poly_ToAst(&left, symbol),
+        ast_MakeUnary(TOK_SQUARE,
+            poly_ToAst(&d, symbol)));
+}
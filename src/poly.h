@@ -0,0 +1,45 @@
+#ifndef _POLY_H_
+#define _POLY_H_
+
+#include "ast.h"
+#include "rational.h"
+
+//Polynomials and quotients of polynomials in one symbol with exact coefficients, kept dense.
+//Trees that are only + - * / and whole powers of the symbol and numbers are recognized and
+//then differentiated coefficient by coefficient and evaluated with Horner's scheme.
+
+#ifdef __TICE__
+#define POLY_MAX_DEGREE 8
+#else
+#define POLY_MAX_DEGREE 32
+#endif
+
+typedef struct _Poly {
+    uint8_t degree; //0 for constants, including 0
+    ratio_t coefficients[POLY_MAX_DEGREE + 1]; //coefficients[i] goes with x^i
+} poly_t;
+
+//the operators a polynomial or a quotient of them can be written with, so callers can skip
+//anything else without looking further
+bool poly_IsArithmetic(TokenType operator);
+
+//false if e isn't a polynomial in symbol, or is too big
+bool poly_FromAst(ast_t *e, uint8_t symbol, poly_t *p);
+//e = numerator / denominator. the denominator is 1 when e is a polynomial
+bool poly_FromAstRational(ast_t *e, uint8_t symbol, poly_t *numerator, poly_t *denominator);
+
+bool poly_Derivative(const poly_t *p, poly_t *derivative);
+double poly_Evaluate(const poly_t *p, double x);
+
+//about how many nodes poly_ToAst makes, without making them
+unsigned poly_CountNodes(const poly_t *p);
+
+//the polynomial written out as a sum from the highest power down
+ast_t *poly_ToAst(const poly_t *p, uint8_t symbol);
+
+//the derivative of e when it's a polynomial or a quotient of polynomials in symbol, built
+//straight from the coefficients. NULL otherwise, when multiplying out a polynomial would make
+//it bigger than e, or when out of memory
+ast_t *poly_DerivativeAst(ast_t *e, uint8_t symbol);
+
+#endif
@@ -0,0 +1,368 @@
+#include "program.h"
+
+#include <stdint.h>
+#include <string.h>
+
+#include "cas.h"
+#include "batch.h"
+#include "poly.h"
+#include "stack.h"
+
+//subtrees without any variables get folded into a single constant register
+bool is_foldable(ast_t *e) {
+    analyze(e);
+    return !(e->symbols & ~(SYMBOL_BIT_E | SYMBOL_BIT_PI));
+}
+
+int program_SymbolIndex(program_t *p, uint8_t symbol) {
+    unsigned i;
+    for (i = 0; i < p->amount_symbols; i++) {
+        if (p->symbols[i] == symbol)
+            return i;
+    }
+    return -1;
+}
+
+//symbols are given registers in env slot order
+void collect_symbols(program_t *p, ast_t *e) {
+    uint8_t symbol;
+
+    analyze(e);
+
+    for (symbol = 'A'; symbol <= 'Z'; symbol++) {
+        if (e->symbols & symbol_bit(symbol))
+            p->symbols[p->amount_symbols++] = symbol;
+    }
+
+    if (e->symbols & symbol_bit(SYMBOL_THETA))
+        p->symbols[p->amount_symbols++] = SYMBOL_THETA;
+}
+
+//registers of the nodes emitted so far, so a node shared in a DAG is only computed once
+typedef struct _Emitted {
+    unsigned size; //a power of 2
+    struct {
+        ast_t *node;
+        unsigned reg;
+    } *entries;
+} emitted_t;
+
+#define emitted_slot(emitted, e) ((unsigned)(((uintptr_t)(e) >> 3) * 2654435761u) & ((emitted)->size - 1))
+
+unsigned add_instruction(program_t *p, uint8_t operator, unsigned left, unsigned right) {
+    instruction_t *i = &p->instructions[p->amount_instructions++];
+
+    i->operator = operator;
+    i->left = left;
+    i->right = right;
+    i->dest = p->amount_registers++;
+    return i->dest;
+}
+
+unsigned add_constant(program_t *p, ratio_t c) {
+    p->registers[p->amount_registers] = (double)c.num / c.den;
+    return p->amount_registers++;
+}
+
+//a polynomial in one symbol written out longhand, like 3X^3-2X^2+X-5, takes a few instructions
+//per term. Horner's scheme takes one multiply and at most one add per degree. only used when
+//that can't take more registers than the tree has nodes, which is what ast_Compile reserves.
+//a candidate is tried once, from the top, and nothing below it is tried again either way
+#define horner_candidate(e) ((e)->type != NODE_SYMBOL && (e)->arithmetic && ((e)->symbols & SYMBOL_BITS_VARIABLES) \
+    && !((e)->symbols & ((e)->symbols - 1)))
+
+bool emit_horner(program_t *p, ast_t *e, unsigned *reg) {
+    poly_t poly;
+    unsigned symbol, result;
+    int i;
+
+    for (symbol = 0; symbol < p->amount_symbols && symbol_bit(p->symbols[symbol]) != e->symbols; symbol++);
+
+    if (!poly_FromAst(e, p->symbols[symbol], &poly) || poly.degree < 2 || 3u * poly.degree + 1 > ast_CountNodes(e))
+        return false;
+
+    result = add_constant(p, poly.coefficients[poly.degree]);
+
+    for (i = poly.degree - 1; i >= 0; i--) {
+        result = add_instruction(p, TOK_MULTIPLY, result, symbol);
+        if (poly.coefficients[i].num != 0)
+            result = add_instruction(p, TOK_ADD, result, add_constant(p, poly.coefficients[i]));
+    }
+
+    *reg = result;
+    return true;
+}
+
+void remember(emitted_t *emitted, ast_t *e, unsigned reg) {
+    unsigned slot;
+
+    for (slot = emitted_slot(emitted, e); emitted->entries[slot].node != NULL; slot = (slot + 1) & (emitted->size - 1));
+    emitted->entries[slot].node = e;
+    emitted->entries[slot].reg = reg;
+}
+
+//a node waiting for the registers of its children
+typedef struct _Emitting {
+    ast_t *e;
+    bool horner; //false below a node that was already tried as a polynomial
+    bool expanded; //the children have been pushed
+} emitting_t;
+
+//the register e already has without emitting anything for it, if it has one
+bool emitted_register(program_t *p, emitted_t *emitted, ast_t *e, unsigned *reg) {
+    unsigned slot;
+
+    if (is_foldable(e)) {
+        p->registers[p->amount_registers] = evaluate(e);
+        *reg = p->amount_registers++;
+        return true;
+    }
+
+    if (e->type == NODE_SYMBOL) {
+        *reg = program_SymbolIndex(p, e->op.symbol);
+        return true;
+    }
+
+    for (slot = emitted_slot(emitted, e); emitted->entries[slot].node != NULL; slot = (slot + 1) & (emitted->size - 1)) {
+        if (emitted->entries[slot].node == e) {
+            *reg = emitted->entries[slot].reg;
+            return true;
+        }
+    }
+
+    return false;
+}
+
+//emits instructions in post order and gives the register holding e. false when out of memory
+bool emit(program_t *p, emitted_t *emitted, ast_t *e, unsigned *result) {
+    stack_t visits, registers;
+    emitting_t v;
+    unsigned reg;
+
+    stack_CreateOf(&visits, emitting_t);
+    stack_CreateOf(&registers, unsigned);
+
+    v.e = e;
+    v.horner = true;
+    v.expanded = false;
+
+    if (!stack_PushOf(&visits, emitting_t, &v))
+        return false;
+
+    while (!stack_IsEmpty(&visits)) {
+        emitting_t *top = stack_PeekOf(&visits, emitting_t);
+
+        if (!top->expanded) {
+            bool done = emitted_register(p, emitted, top->e, &reg);
+
+            if (!done && top->horner && horner_candidate(top->e)) {
+                top->horner = false;
+
+                done = emit_horner(p, top->e, &reg);
+                if (done)
+                    remember(emitted, top->e, reg);
+            }
+
+            if (!done) {
+                //the left child goes on top, so its instructions come first
+                top->expanded = true;
+                v = *top;
+                v.expanded = false;
+
+                if (v.e->type == NODE_UNARY) {
+                    v.e = top->e->op.unary.operand;
+                    if (!stack_PushOf(&visits, emitting_t, &v))
+                        break;
+                } else {
+                    ast_t *left = top->e->op.binary.left;
+
+                    v.e = top->e->op.binary.right;
+                    if (!stack_PushOf(&visits, emitting_t, &v))
+                        break;
+                    v.e = left;
+                    if (!stack_PushOf(&visits, emitting_t, &v))
+                        break;
+                }
+                continue;
+            }
+
+            stack_PopOf(&visits, emitting_t);
+        } else {
+            v = *stack_PopOf(&visits, emitting_t);
+
+            if (v.e->type == NODE_UNARY) {
+                reg = add_instruction(p, v.e->op.unary.operator, *stack_PopOf(&registers, unsigned), 0);
+            } else {
+                unsigned right = *stack_PopOf(&registers, unsigned);
+                unsigned left = *stack_PopOf(&registers, unsigned);
+
+                reg = add_instruction(p, v.e->op.binary.operator, left, right);
+            }
+
+            remember(emitted, v.e, reg);
+        }
+
+        if (!stack_PushOf(&registers, unsigned, &reg))
+            break;
+    }
+
+    //stopped early when out of memory
+    if (!stack_IsEmpty(&visits)) {
+        stack_Cleanup(&visits);
+        stack_Cleanup(&registers);
+        return false;
+    }
+
+    *result = *stack_PopOf(&registers, unsigned);
+
+    stack_Cleanup(&visits);
+    stack_Cleanup(&registers);
+    return true;
+}
+
+Error ast_Compile(ast_t *e, program_t *p) {
+    //every node takes at most one register or instruction, plus room for the symbols
+    unsigned nodes = ast_CountNodes(e);
+    emitted_t emitted;
+
+    p->amount_instructions = 0;
+    p->amount_symbols = 0;
+    p->instructions = NULL;
+    p->registers = NULL;
+    p->lanes = NULL;
+
+    //symbols without an env slot can never be bound
+    collect_symbols(p, e);
+    if (e->symbols & SYMBOL_BIT_OTHER)
+        return E_EVAL_UNBOUND;
+
+    for (emitted.size = 16; emitted.size < nodes * 2; emitted.size *= 2);
+
+    p->amount_registers = p->amount_symbols;
+    p->instructions = ast_Alloc(nodes * sizeof(instruction_t));
+    p->registers = ast_Alloc((nodes + p->amount_symbols) * sizeof(double));
+    emitted.entries = ast_Alloc(emitted.size * sizeof(*emitted.entries));
+
+    if (p->instructions == NULL || p->registers == NULL || emitted.entries == NULL) {
+        ast_Free(emitted.entries);
+        program_Cleanup(p);
+        return E_MEMORY;
+    }
+
+    memset(emitted.entries, 0, emitted.size * sizeof(*emitted.entries));
+
+    if (!emit(p, &emitted, e, &p->result)) {
+        ast_Free(emitted.entries);
+        program_Cleanup(p);
+        return E_MEMORY;
+    }
+
+    ast_Free(emitted.entries);
+
+    return E_SUCCESS;
+}
+
+Error program_Bind(program_t *p, const env_t *env, double *values) {
+    unsigned i;
+
+    for (i = 0; i < p->amount_symbols; i++) {
+        int slot = env_Slot(p->symbols[i]);
+
+        if (slot < 0 || !(env->bound & ((uint32_t)1 << slot)))
+            return E_EVAL_UNBOUND;
+
+        values[i] = env->values[slot];
+    }
+
+    return E_SUCCESS;
+}
+
+void program_Cleanup(program_t *p) {
+    ast_Free(p->instructions);
+    ast_Free(p->registers);
+    ast_Free(p->lanes);
+    p->instructions = NULL;
+    p->registers = NULL;
+    p->lanes = NULL;
+}
+
+double program_Evaluate(program_t *p, const double *values) {
+    double *r = p->registers;
+    const instruction_t *i = p->instructions, *end = i + p->amount_instructions;
+
+    memcpy(r, values, p->amount_symbols * sizeof(double));
+
+    for (; i < end; i++) {
+        switch (i->operator) {
+        case TOK_ADD: r[i->dest] = r[i->left] + r[i->right]; break;
+        case TOK_SUBTRACT: r[i->dest] = r[i->left] - r[i->right]; break;
+        case TOK_MULTIPLY: r[i->dest] = r[i->left] * r[i->right]; break;
+        case TOK_DIVIDE:
+        case TOK_FRACTION: r[i->dest] = r[i->left] / r[i->right]; break;
+        case TOK_NEGATE: r[i->dest] = -r[i->left]; break;
+        case TOK_POWER:
+        case TOK_SCIENTIFIC:
+        case TOK_ROOT:
+        case TOK_LOG_BASE:
+            r[i->dest] = evaluate_binary(i->operator, r[i->left], r[i->right]);
+            break;
+        default:
+            r[i->dest] = evaluate_unary(i->operator, r[i->left]);
+            break;
+        }
+    }
+
+    return r[p->result];
+}
+
+#define lane(reg) (p->lanes + (reg) * PROGRAM_BATCH)
+
+Error program_EvaluateBatch(program_t *p, const double *values, uint8_t symbol, const double *xs, double *out, unsigned count) {
+    int index = program_SymbolIndex(p, symbol);
+    unsigned done, i, j;
+
+    //doesn't depend on symbol at all
+    if (index < 0) {
+        double result = program_Evaluate(p, values);
+        for (i = 0; i < count; i++)
+            out[i] = result;
+        return E_SUCCESS;
+    }
+
+    if (p->lanes == NULL) {
+        p->lanes = ast_Alloc(p->amount_registers * PROGRAM_BATCH * sizeof(double));
+
+        if (p->lanes == NULL)
+            return E_MEMORY;
+
+        //the constants never change, so they only need spreading out once
+        for (i = 0; i < p->amount_registers; i++) {
+            for (j = 0; j < PROGRAM_BATCH; j++)
+                lane(i)[j] = p->registers[i];
+        }
+    }
+
+    for (i = 0; i < p->amount_symbols; i++) {
+        if (i == (unsigned)index) continue;
+        for (j = 0; j < PROGRAM_BATCH; j++)
+            lane(i)[j] = values[i];
+    }
+
+    for (done = 0; done < count; done += PROGRAM_BATCH) {
+        unsigned n = count - done < PROGRAM_BATCH ? count - done : PROGRAM_BATCH;
+        const instruction_t *ins = p->instructions, *end = ins + p->amount_instructions;
+
+        memcpy(lane(index), xs + done, n * sizeof(double));
+
+        for (; ins < end; ins++) {
+            if (program_IsBinary(ins->operator))
+                batch_Binary(ins->operator, lane(ins->dest), lane(ins->left), lane(ins->right), n);
+            else
+                batch_Unary(ins->operator, lane(ins->dest), lane(ins->left), n);
+        }
+
+        memcpy(out + done, lane(p->result), n * sizeof(double));
+    }
+
+    return E_SUCCESS;
+}
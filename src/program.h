@@ -0,0 +1,63 @@
+#ifndef _PROGRAM_H_
+#define _PROGRAM_H_
+
+#include "ast.h"
+#include "cas.h"
+
+//A tree lowered into a flat list of register instructions so it can be evaluated many times
+//without recursing or allocating. Registers are laid out as the symbols first, then the
+//constants, then one register per instruction result.
+
+//A through Z and theta
+#define PROGRAM_MAX_SYMBOLS 27
+
+//how many points program_EvaluateBatch works on at a time. each register gets this many lanes
+#ifdef __TICE__
+#define PROGRAM_BATCH 8
+#else
+#define PROGRAM_BATCH 64
+#endif
+
+//whether an instruction uses right as well as left
+#define program_IsBinary(operator) (((operator) >= TOK_ADD && (operator) <= TOK_ROOT) || (operator) == TOK_LOG_BASE)
+
+typedef struct _Instruction {
+    uint8_t operator; //the TokenType, unary operators only use left
+    unsigned dest, left, right;
+} instruction_t;
+
+typedef struct _Program {
+    unsigned amount_instructions;
+    instruction_t *instructions;
+
+    unsigned amount_registers;
+    double *registers;
+
+    //symbols[i] is loaded into register i
+    unsigned amount_symbols;
+    uint8_t symbols[PROGRAM_MAX_SYMBOLS];
+
+    unsigned result;
+
+    //PROGRAM_BATCH lanes per register, made by the first program_EvaluateBatch
+    double *lanes;
+} program_t;
+
+Error ast_Compile(ast_t *e, program_t *p);
+void program_Cleanup(program_t *p);
+
+//the register symbol is loaded into, or -1 if the program doesn't use it
+int program_SymbolIndex(program_t *p, uint8_t symbol);
+
+//fills values[i] with the value of p->symbols[i] from env, E_EVAL_UNBOUND if one isn't set
+Error program_Bind(program_t *p, const env_t *env, double *values);
+
+//values[i] is the value of p->symbols[i]. uses the program's registers, so one program
+//can't be evaluated on two threads at once
+double program_Evaluate(program_t *p, const double *values);
+
+//evaluates the program at each of the count values in xs for symbol, writing the results to
+//out. the other symbols take their value from values like in program_Evaluate
+Error program_EvaluateBatch(program_t *p, const double *values, uint8_t symbol, const double *xs, double *out, unsigned count);
+
+#endif
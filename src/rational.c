@@ -0,0 +1,738 @@
+#include "rational.h"
+
+#include <string.h>
+
+#include "cas.h"
+
+//enough for the decimal form of the largest big_t, a 16 bit limb is under 5 digits
+#define BIG_DIGITS (BIG_LIMBS * 5 + 1)
+//a decimal is those digits with a point, and a 0 in front when they're all after it
+#define DECIMAL_DIGITS (BIG_DIGITS + 2)
+
+#define big_IsZero(a) ((a)->length == 0)
+#define big_IsOne(a) ((a)->length == 1 && (a)->limbs[0] == 1)
+#define big_IsSmall(a) ((a)->length <= 1)
+
+void big_SetU32(big_t *a, uint32_t value) {
+    a->length = 0;
+    while (value) {
+        a->limbs[a->length++] = (uint16_t)value;
+        value >>= 16;
+    }
+}
+
+bool big_ToU32(const big_t *a, uint32_t *value) {
+    int i;
+
+    if (a->length > 2)
+        return false;
+
+    *value = 0;
+    for (i = a->length - 1; i >= 0; i--)
+        *value = (*value << 16) | a->limbs[i];
+
+    return true;
+}
+
+void big_Trim(big_t *a) {
+    while (a->length > 0 && a->limbs[a->length - 1] == 0)
+        a->length--;
+}
+
+int big_Compare(const big_t *a, const big_t *b) {
+    int i;
+
+    if (a->length != b->length)
+        return a->length < b->length ? -1 : 1;
+
+    for (i = a->length - 1; i >= 0; i--) {
+        if (a->limbs[i] != b->limbs[i])
+            return a->limbs[i] < b->limbs[i] ? -1 : 1;
+    }
+
+    return 0;
+}
+
+bool big_Add(big_t *r, const big_t *a, const big_t *b) {
+    uint8_t length = a->length > b->length ? a->length : b->length;
+    uint32_t carry = 0;
+    uint8_t i;
+
+    for (i = 0; i < length; i++) {
+        carry += (uint32_t)(i < a->length ? a->limbs[i] : 0) + (i < b->length ? b->limbs[i] : 0);
+        r->limbs[i] = (uint16_t)carry;
+        carry >>= 16;
+    }
+
+    if (carry) {
+        if (length == BIG_LIMBS)
+            return false;
+        r->limbs[length++] = (uint16_t)carry;
+    }
+
+    r->length = length;
+    return true;
+}
+
+//a has to be at least b
+void big_Sub(big_t *r, const big_t *a, const big_t *b) {
+    int32_t borrow = 0;
+    uint8_t i;
+
+    for (i = 0; i < a->length; i++) {
+        int32_t diff = (int32_t)a->limbs[i] - (i < b->length ? b->limbs[i] : 0) - borrow;
+
+        borrow = diff < 0;
+        r->limbs[i] = (uint16_t)(diff + (borrow ? 0x10000 : 0));
+    }
+
+    r->length = a->length;
+    big_Trim(r);
+}
+
+bool big_Mul(big_t *r, const big_t *a, const big_t *b) {
+    uint16_t product[BIG_LIMBS * 2];
+    unsigned length = a->length + b->length;
+    uint8_t i, j;
+
+    if (big_IsZero(a) || big_IsZero(b)) {
+        r->length = 0;
+        return true;
+    }
+
+    //the product has either length or length - 1 limbs
+    if (length - 1 > BIG_LIMBS)
+        return false;
+
+    memset(product, 0, length * sizeof(uint16_t));
+
+    for (i = 0; i < a->length; i++) {
+        uint32_t carry = 0;
+
+        for (j = 0; j < b->length; j++) {
+            carry += product[i + j] + (uint32_t)a->limbs[i] * b->limbs[j];
+            product[i + j] = (uint16_t)carry;
+            carry >>= 16;
+        }
+
+        product[i + b->length] = (uint16_t)carry;
+    }
+
+    if (product[length - 1] == 0)
+        length--;
+
+    if (length > BIG_LIMBS)
+        return false;
+
+    memcpy(r->limbs, product, length * sizeof(uint16_t));
+    r->length = (uint8_t)length;
+    return true;
+}
+
+//a = a * m + add
+bool big_MulAdd(big_t *a, uint16_t m, uint16_t add) {
+    uint32_t carry = add;
+    uint8_t i;
+
+    for (i = 0; i < a->length; i++) {
+        carry += (uint32_t)a->limbs[i] * m;
+        a->limbs[i] = (uint16_t)carry;
+        carry >>= 16;
+    }
+
+    if (carry) {
+        if (a->length == BIG_LIMBS)
+            return false;
+        a->limbs[a->length++] = (uint16_t)carry;
+    }
+
+    big_Trim(a);
+    return true;
+}
+
+//a = a / d, returns the remainder
+uint16_t big_DivSmall(big_t *a, uint16_t d) {
+    uint32_t remainder = 0;
+    int i;
+
+    for (i = a->length - 1; i >= 0; i--) {
+        remainder = (remainder << 16) | a->limbs[i];
+        a->limbs[i] = (uint16_t)(remainder / d);
+        remainder %= d;
+    }
+
+    big_Trim(a);
+    return (uint16_t)remainder;
+}
+
+//long division a bit at a time, b can't be 0. either result can be NULL
+void big_DivMod(big_t *quotient, big_t *remainder, const big_t *a, const big_t *b) {
+    big_t q, rem;
+    int bit;
+
+    q.length = a->length;
+    memset(q.limbs, 0, q.length * sizeof(uint16_t));
+    rem.length = 0;
+
+    for (bit = a->length * 16 - 1; bit >= 0; bit--) {
+        uint16_t carry = (a->limbs[bit / 16] >> (bit % 16)) & 1;
+        uint8_t i;
+
+        //rem = rem * 2 + the next bit. rem is under b, so this uses at most the spare limb
+        for (i = 0; i < rem.length; i++) {
+            uint16_t top = rem.limbs[i] >> 15;
+            rem.limbs[i] = (uint16_t)(rem.limbs[i] << 1) | carry;
+            carry = top;
+        }
+        if (carry)
+            rem.limbs[rem.length++] = carry;
+
+        if (big_Compare(&rem, b) >= 0) {
+            big_Sub(&rem, &rem, b);
+            q.limbs[bit / 16] |= (uint16_t)1 << (bit % 16);
+        }
+    }
+
+    big_Trim(&q);
+
+    if (quotient != NULL)
+        *quotient = q;
+    if (remainder != NULL)
+        *remainder = rem;
+}
+
+void big_Gcd(big_t *g, const big_t *a, const big_t *b) {
+    big_t x = *a, y = *b, rem;
+
+    while (!big_IsZero(&y)) {
+        big_DivMod(NULL, &rem, &x, &y);
+        x = y;
+        y = rem;
+    }
+
+    *g = x;
+}
+
+//buffer needs BIG_DIGITS characters, the result isn't terminated
+uint8_t big_ToDecimal(const big_t *a, char *buffer) {
+    char digits[BIG_DIGITS];
+    big_t copy = *a;
+    uint8_t length = 0, i;
+
+    do {
+        digits[length++] = '0' + big_DivSmall(&copy, 10);
+    } while (!big_IsZero(&copy));
+
+    for (i = 0; i < length; i++)
+        buffer[i] = digits[length - 1 - i];
+
+    return length;
+}
+
+uint32_t gcd_u32(uint32_t a, uint32_t b) {
+    while (b) {
+        uint32_t t = a % b;
+        a = b;
+        b = t;
+    }
+    return a;
+}
+
+void rational_Reduce(rational_t *r) {
+    uint32_t n, d;
+    big_t g;
+
+    if (big_IsZero(&r->numerator)) {
+        big_SetU32(&r->denominator, 1);
+        r->negative = false;
+        return;
+    }
+
+    if (big_ToU32(&r->numerator, &n) && big_ToU32(&r->denominator, &d)) {
+        uint32_t divisor = gcd_u32(n, d);
+
+        big_SetU32(&r->numerator, n / divisor);
+        big_SetU32(&r->denominator, d / divisor);
+        return;
+    }
+
+    big_Gcd(&g, &r->numerator, &r->denominator);
+
+    if (!big_IsOne(&g)) {
+        big_DivMod(&r->numerator, NULL, &r->numerator, &g);
+        big_DivMod(&r->denominator, NULL, &r->denominator, &g);
+    }
+}
+
+void rational_SetU32(rational_t *r, uint32_t value) {
+    r->negative = false;
+    r->decimal = false;
+    big_SetU32(&r->numerator, value);
+    big_SetU32(&r->denominator, 1);
+}
+
+bool rational_Add(rational_t *r, const rational_t *a, const rational_t *b) {
+    rational_t t;
+    big_t x, y;
+
+    t.decimal = a->decimal || b->decimal;
+
+    if (big_IsSmall(&a->numerator) && big_IsSmall(&a->denominator)
+        && big_IsSmall(&b->numerator) && big_IsSmall(&b->denominator)) {
+        uint32_t an, ad, bn, bd, sum;
+
+        big_ToU32(&a->numerator, &an);
+        big_ToU32(&a->denominator, &ad);
+        big_ToU32(&b->numerator, &bn);
+        big_ToU32(&b->denominator, &bd);
+
+        //each product fits in 32 bits, only the sum can overflow
+        an *= bd;
+        bn *= ad;
+        sum = an + bn;
+
+        if (a->negative != b->negative || sum >= an) {
+            if (a->negative == b->negative) {
+                t.negative = a->negative;
+                big_SetU32(&t.numerator, sum);
+            } else {
+                t.negative = an >= bn ? a->negative : b->negative;
+                big_SetU32(&t.numerator, an >= bn ? an - bn : bn - an);
+            }
+
+            big_SetU32(&t.denominator, ad * bd);
+            rational_Reduce(&t);
+            *r = t;
+            return true;
+        }
+    }
+
+    if (!big_Mul(&x, &a->numerator, &b->denominator)
+        || !big_Mul(&y, &b->numerator, &a->denominator)
+        || !big_Mul(&t.denominator, &a->denominator, &b->denominator))
+        return false;
+
+    if (a->negative == b->negative) {
+        t.negative = a->negative;
+        if (!big_Add(&t.numerator, &x, &y))
+            return false;
+    } else if (big_Compare(&x, &y) >= 0) {
+        t.negative = a->negative;
+        big_Sub(&t.numerator, &x, &y);
+    } else {
+        t.negative = b->negative;
+        big_Sub(&t.numerator, &y, &x);
+    }
+
+    rational_Reduce(&t);
+    *r = t;
+    return true;
+}
+
+bool rational_Sub(rational_t *r, const rational_t *a, const rational_t *b) {
+    rational_t negated = *b;
+
+    negated.negative = !negated.negative && !big_IsZero(&negated.numerator);
+    return rational_Add(r, a, &negated);
+}
+
+bool rational_Mul(rational_t *r, const rational_t *a, const rational_t *b) {
+    rational_t t;
+
+    t.negative = a->negative != b->negative;
+    t.decimal = a->decimal || b->decimal;
+
+    if (big_IsSmall(&a->numerator) && big_IsSmall(&a->denominator)
+        && big_IsSmall(&b->numerator) && big_IsSmall(&b->denominator)) {
+        uint32_t an, ad, bn, bd;
+
+        big_ToU32(&a->numerator, &an);
+        big_ToU32(&a->denominator, &ad);
+        big_ToU32(&b->numerator, &bn);
+        big_ToU32(&b->denominator, &bd);
+
+        big_SetU32(&t.numerator, an * bn);
+        big_SetU32(&t.denominator, ad * bd);
+    } else if (!big_Mul(&t.numerator, &a->numerator, &b->numerator)
+        || !big_Mul(&t.denominator, &a->denominator, &b->denominator)) {
+        return false;
+    }
+
+    rational_Reduce(&t);
+    *r = t;
+    return true;
+}
+
+bool rational_Div(rational_t *r, const rational_t *a, const rational_t *b) {
+    rational_t inverse;
+
+    if (big_IsZero(&b->numerator))
+        return false;
+
+    inverse.negative = b->negative;
+    inverse.decimal = b->decimal;
+    inverse.numerator = b->denominator;
+    inverse.denominator = b->numerator;
+
+    return rational_Mul(r, a, &inverse);
+}
+
+bool rational_Pow(rational_t *r, const rational_t *a, const rational_t *b) {
+    rational_t result, base = *a;
+    uint32_t exponent;
+
+    if (!big_IsOne(&b->denominator) || !big_ToU32(&b->numerator, &exponent))
+        return false;
+
+    rational_SetU32(&result, 1);
+
+    //square and multiply, every step keeps the numbers reduced
+    while (exponent) {
+        if ((exponent & 1) && !rational_Mul(&result, &result, &base))
+            return false;
+
+        exponent >>= 1;
+
+        if (exponent && !rational_Mul(&base, &base, &base))
+            return false;
+    }
+
+    if (b->negative) {
+        rational_t one;
+
+        rational_SetU32(&one, 1);
+        return rational_Div(r, &one, &result);
+    }
+
+    *r = result;
+    return true;
+}
+
+bool rational_FromNumber(num_t num, rational_t *r) {
+    bool digits = false, fraction = false;
+    uint16_t i;
+
+    rational_SetU32(r, 0);
+    big_SetU32(&r->denominator, 1);
+
+    for (i = 0; i < num.length; i++) {
+        char c = num_Char(num, i);
+
+        if (c == '-' && i == 0) {
+            r->negative = true;
+        } else if (c == '.' && !fraction) {
+            fraction = true;
+        } else if (c >= '0' && c <= '9') {
+            //every digit after the point scales the denominator too
+            if (!big_MulAdd(&r->numerator, 10, (uint16_t)(c - '0'))
+                || (fraction && !big_MulAdd(&r->denominator, 10, 0)))
+                return false;
+            digits = true;
+        } else {
+            return false;
+        }
+    }
+
+    if (!digits)
+        return false;
+
+    r->decimal = fraction;
+    rational_Reduce(r);
+    return true;
+}
+
+bool rational_ToInt32(const rational_t *r, int32_t *numerator, int32_t *denominator) {
+    uint32_t n, d;
+
+    if (!big_ToU32(&r->numerator, &n) || !big_ToU32(&r->denominator, &d)
+        || n > INT32_MAX || d > INT32_MAX)
+        return false;
+
+    *numerator = r->negative ? -(int32_t)n : (int32_t)n;
+    *denominator = (int32_t)d;
+    return true;
+}
+
+void rational_FromInt32(rational_t *r, int32_t numerator, int32_t denominator) {
+    r->negative = (numerator < 0) != (denominator < 0) && numerator != 0;
+    r->decimal = false;
+    big_SetU32(&r->numerator, numerator < 0 ? 0 - (uint32_t)numerator : (uint32_t)numerator);
+    big_SetU32(&r->denominator, denominator < 0 ? 0 - (uint32_t)denominator : (uint32_t)denominator);
+    rational_Reduce(r);
+}
+
+bool rational_FromAst(ast_t *e, rational_t *r) {
+    rational_t left, right;
+
+    switch (e->type) {
+    case NODE_NUMBER:
+        return rational_FromNumber(e->op.number, r);
+    case NODE_UNARY:
+        if (!rational_FromAst(e->op.unary.operand, &left))
+            return false;
+
+        switch (e->op.unary.operator) {
+        case TOK_NEGATE:
+            *r = left;
+            r->negative = !left.negative && !big_IsZero(&left.numerator);
+            return true;
+        case TOK_RECRIPROCAL:
+            rational_SetU32(&right, 1);
+            return rational_Div(r, &right, &left);
+        case TOK_SQUARE:
+            return rational_Mul(r, &left, &left);
+        case TOK_CUBE:
+            return rational_Mul(r, &left, &left) && rational_Mul(r, r, &left);
+        }
+
+        return false;
+    case NODE_BINARY:
+        if (!rational_FromAst(e->op.binary.left, &left) || !rational_FromAst(e->op.binary.right, &right))
+            return false;
+
+        switch (e->op.binary.operator) {
+        case TOK_ADD: return rational_Add(r, &left, &right);
+        case TOK_SUBTRACT: return rational_Sub(r, &left, &right);
+        case TOK_MULTIPLY: return rational_Mul(r, &left, &right);
+        case TOK_DIVIDE:
+        case TOK_FRACTION: return rational_Div(r, &left, &right);
+        case TOK_POWER: return rational_Pow(r, &left, &right);
+        case TOK_SCIENTIFIC: {
+            rational_t ten;
+
+            //2E-3 is as much a decimal as 0.002
+            rational_SetU32(&ten, 10);
+            ten.decimal = true;
+            return rational_Pow(&ten, &ten, &right) && rational_Mul(r, &left, &ten);
+        }
+        }
+
+        return false;
+    default:
+        return false;
+    }
+}
+
+//the text of |r| with a point, like 0.25, when r is a decimal that ends. 0 otherwise
+uint8_t decimal_Text(const rational_t *r, char *buffer) {
+    char digits[BIG_DIGITS];
+    big_t numerator = r->numerator, denominator = r->denominator, rest;
+    uint8_t places = 0, length, i;
+
+    if (!r->decimal || big_IsOne(&denominator))
+        return 0;
+
+    //n / (2d) is 5n / 10d and n / (5d) is 2n / 10d, until only the power of 10 is left
+    while (!big_IsOne(&denominator)) {
+        uint16_t factor = 2;
+
+        rest = denominator;
+        if (big_DivSmall(&rest, 2)) {
+            factor = 5;
+            rest = denominator;
+            if (big_DivSmall(&rest, 5))
+                return 0;
+        }
+
+        if (places == BIG_DIGITS || !big_MulAdd(&numerator, 10 / factor, 0))
+            return 0;
+
+        denominator = rest;
+        places++;
+    }
+
+    //both factors of 10 don't each need a place of their own
+    for (;;) {
+        rest = numerator;
+        if (big_DivSmall(&rest, 10))
+            break;
+        numerator = rest;
+        places--;
+    }
+
+    length = big_ToDecimal(&numerator, digits);
+
+    //0.05 for 5 with 2 places
+    if (length <= places) {
+        buffer[0] = '0';
+        buffer[1] = '.';
+        memset(buffer + 2, '0', places - length);
+        memcpy(buffer + 2 + places - length, digits, length);
+        return 2 + places;
+    }
+
+    for (i = 0; i < length - places; i++)
+        buffer[i] = digits[i];
+    buffer[i] = '.';
+    memcpy(buffer + i + 1, digits + i, places);
+    return length + 1;
+}
+
+bool rational_IsWritable(const rational_t *r) {
+    char buffer[DECIMAL_DIGITS];
+
+    return !r->decimal || big_IsOne(&r->denominator) || decimal_Text(r, buffer) != 0;
+}
+
+ast_t *rational_ToAst(const rational_t *r) {
+    char buffer[DECIMAL_DIGITS + 1];
+    uint8_t length = decimal_Text(r, buffer);
+    ast_t *ret;
+
+    if (length > 0) {
+        buffer[length] = '\0';
+        ret = ast_MakeNumber(num_Create(buffer));
+        return r->negative ? ast_MakeUnary(TOK_NEGATE, ret) : ret;
+    }
+
+    buffer[big_ToDecimal(&r->numerator, buffer)] = '\0';
+    ret = ast_MakeNumber(num_Create(buffer));
+
+    if (!big_IsOne(&r->denominator)) {
+        buffer[big_ToDecimal(&r->denominator, buffer)] = '\0';
+        ret = ast_MakeBinary(TOK_FRACTION, ret, ast_MakeNumber(num_Create(buffer)));
+    }
+
+    if (r->negative)
+        ret = ast_MakeUnary(TOK_NEGATE, ret);
+
+    return ret;
+}
+
+//whether e is a number written exactly like text. a number borrowed from the equation has the
+//calculator's point in it, so it's read with num_Char
+bool is_text(ast_t *e, const char *text, uint8_t length) {
+    uint8_t i;
+
+    if (e->type != NODE_NUMBER || e->op.number.length != length)
+        return false;
+
+    for (i = 0; i < length; i++) {
+        if (num_Char(e->op.number, i) != text[i])
+            return false;
+    }
+
+    return true;
+}
+
+//whether e is a number written exactly like a
+bool is_big(ast_t *e, const big_t *a) {
+    char buffer[BIG_DIGITS];
+
+    return is_text(e, buffer, big_ToDecimal(a, buffer));
+}
+
+bool rational_IsCanonical(ast_t *e, const rational_t *r) {
+    char buffer[DECIMAL_DIGITS];
+    uint8_t length;
+
+    if (r->negative) {
+        if (e->type != NODE_UNARY || e->op.unary.operator != TOK_NEGATE)
+            return false;
+        e = e->op.unary.operand;
+    }
+
+    if ((length = decimal_Text(r, buffer)) > 0)
+        return is_text(e, buffer, length);
+
+    if (big_IsOne(&r->denominator))
+        return is_big(e, &r->numerator);
+
+    return e->type == NODE_BINARY && e->op.binary.operator == TOK_FRACTION
+        && is_big(e->op.binary.left, &r->numerator)
+        && is_big(e->op.binary.right, &r->denominator);
+}
+
+int64_t gcd_i64(int64_t a, int64_t b) {
+    if (a < 0) a = -a;
+    if (b < 0) b = -b;
+
+    while (b) {
+        int64_t t = a % b;
+        a = b;
+        b = t;
+    }
+
+    return a;
+}
+
+bool ratio_Make(ratio_t *r, int64_t num, int64_t den) {
+    int64_t divisor;
+
+    if (den == 0)
+        return false;
+
+    if (den < 0) {
+        num = -num;
+        den = -den;
+    }
+
+    divisor = gcd_i64(num, den);
+    if (divisor > 1) {
+        num /= divisor;
+        den /= divisor;
+    }
+
+    //INT32_MIN is left out so every ratio can be negated
+    if (num > INT32_MAX || num < -INT32_MAX || den > INT32_MAX)
+        return false;
+
+    r->num = (int32_t)num;
+    r->den = (int32_t)den;
+    r->decimal = false;
+    return true;
+}
+
+//marks r as a decimal or not, false when it's one that doesn't end. a decimal ends when
+//its denominator only has 2s and 5s in it
+bool ratio_Decimal(ratio_t *r, bool decimal) {
+    int32_t den = r->den;
+
+    r->decimal = decimal;
+
+    if (decimal) {
+        while (den % 2 == 0) den /= 2;
+        while (den % 5 == 0) den /= 5;
+    }
+
+    return den == 1 || !decimal;
+}
+
+bool ratio_Add(ratio_t *r, ratio_t a, ratio_t b) {
+    return ratio_Make(r, (int64_t)a.num * b.den + (int64_t)b.num * a.den, (int64_t)a.den * b.den)
+        && ratio_Decimal(r, a.decimal || b.decimal);
+}
+
+bool ratio_Mul(ratio_t *r, ratio_t a, ratio_t b) {
+    return ratio_Make(r, (int64_t)a.num * b.num, (int64_t)a.den * b.den)
+        && ratio_Decimal(r, a.decimal || b.decimal);
+}
+
+bool ratio_Div(ratio_t *r, ratio_t a, ratio_t b) {
+    return ratio_Make(r, (int64_t)a.num * b.den, (int64_t)a.den * b.num)
+        && ratio_Decimal(r, a.decimal || b.decimal);
+}
+
+int ratio_Compare(ratio_t a, ratio_t b) {
+    int64_t left = (int64_t)a.num * b.den, right = (int64_t)b.num * a.den;
+    return left < right ? -1 : left > right;
+}
+
+bool ratio_FromAst(ast_t *e, ratio_t *r) {
+    rational_t value;
+
+    analyze(e);
+
+    if (e->symbols != 0 || !rational_FromAst(e, &value) || !rational_ToInt32(&value, &r->num, &r->den))
+        return false;
+
+    return ratio_Decimal(r, value.decimal);
+}
+
+ast_t *ratio_ToAst(ratio_t r) {
+    rational_t value;
+
+    rational_FromInt32(&value, r.num, r.den);
+    value.decimal = r.decimal;
+    return rational_ToAst(&value);
+}
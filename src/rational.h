@@ -0,0 +1,78 @@
+#ifndef _RATIONAL_H_
+#define _RATIONAL_H_
+
+#include "ast.h"
+
+//Exact rational arithmetic for constant folding. Magnitudes are big integers of up to
+//BIG_LIMBS 16 bit limbs, which is far past anything a double can tell apart, so an operation
+//that would need more reports overflow and the tree is just left alone. Anything that fits
+//in 16 bits takes a fast path on plain integers.
+
+#ifdef __TICE__
+#define BIG_LIMBS 16
+#else
+#define BIG_LIMBS 32
+#endif
+
+typedef struct _Big {
+    uint8_t length; //limbs in use, the top one is never 0. 0 is length 0
+    uint16_t limbs[BIG_LIMBS + 1]; //least significant first, plus room to shift during division
+} big_t;
+
+typedef struct _Rational {
+    //always reduced, with a positive denominator and 0 never negative
+    bool negative;
+    big_t numerator;
+    big_t denominator;
+    bool decimal; //some number it came from was written with a point, so it's written back as one
+} rational_t;
+
+//these return false on overflow or dividing by 0, r can be the same as a or b
+
+//the value of a tree made only of numbers and + - * / fractions, negation, whole powers,
+//squares, cubes, reciprocals and scientific notation with whole exponents
+bool rational_FromAst(ast_t *e, rational_t *r);
+bool rational_FromNumber(num_t num, rational_t *r);
+
+bool rational_Add(rational_t *r, const rational_t *a, const rational_t *b);
+bool rational_Sub(rational_t *r, const rational_t *a, const rational_t *b);
+bool rational_Mul(rational_t *r, const rational_t *a, const rational_t *b);
+bool rational_Div(rational_t *r, const rational_t *a, const rational_t *b);
+//b has to be a whole number
+bool rational_Pow(rational_t *r, const rational_t *a, const rational_t *b);
+
+//to and from plain integers. ToInt32 is false when either part doesn't fit
+bool rational_ToInt32(const rational_t *r, int32_t *numerator, int32_t *denominator);
+void rational_FromInt32(rational_t *r, int32_t numerator, int32_t denominator);
+
+//false for a decimal like 0.1/3 that doesn't end, which is left unfolded instead of turning
+//into a fraction nobody wrote
+bool rational_IsWritable(const rational_t *r);
+
+//n, -n, n/d or -(n/d). a decimal that ends is written as one, like 0.25 or -0.25
+ast_t *rational_ToAst(const rational_t *r);
+
+//whether e is already exactly what rational_ToAst would make for r
+bool rational_IsCanonical(ast_t *e, const rational_t *r);
+
+//Plain integer fractions for small exact values like coefficients and exponents, where a
+//full rational_t would be too big to keep many of. reduced, with a positive denominator
+typedef struct _Ratio {
+    int32_t num;
+    int32_t den;
+    bool decimal; //same as rational_t
+} ratio_t;
+
+//these return false when the result doesn't fit, or is a decimal that doesn't end. Make
+//is never a decimal
+bool ratio_Make(ratio_t *r, int64_t num, int64_t den);
+bool ratio_Add(ratio_t *r, ratio_t a, ratio_t b);
+bool ratio_Mul(ratio_t *r, ratio_t a, ratio_t b);
+bool ratio_Div(ratio_t *r, ratio_t a, ratio_t b);
+int ratio_Compare(ratio_t a, ratio_t b);
+
+//the exact value of a constant subtree, if it has one that fits
+bool ratio_FromAst(ast_t *e, ratio_t *r);
+ast_t *ratio_ToAst(ratio_t r);
+
+#endif
@@ -1,42 +1,72 @@
 #include "stack.h"
 
 #include <stdlib.h>
+#include <string.h>
 
-void stack_Create(stack_t *s) {
+#define slot(s, i) ((s)->items + (i) * (s)->size)
+
+void stack_Create(stack_t *s, unsigned size) {
+    s->size = size;
     s->top = 0;
-    s->_max = STACK_START;
-    s->items = malloc(STACK_START * sizeof(void*));
+    s->max = STACK_SMALL / size;
+    s->items = s->small;
 }
 
 void stack_Cleanup(stack_t *s) {
-    free(s->items);
+    if (s->items != s->small)
+        free(s->items);
+
+    s->items = s->small;
+    s->max = STACK_SMALL / s->size;
+    s->top = 0;
 }
 
-void stack_Push(stack_t *s, void *item) {
-    if (s->top >= s->_max) {
-        s->_max *= 2;
-        s->items = realloc(s->items, s->_max * sizeof(void*));
+void *stack_Reserve(stack_t *s) {
+    if (s->top >= s->max) {
+        unsigned max = s->max > 0 ? s->max * 2 : 4;
+        uint8_t *items;
+
+        if (s->items == s->small) {
+            items = malloc(max * s->size);
+            if (items != NULL)
+                memcpy(items, s->small, s->top * s->size);
+        }
+        else {
+            items = realloc(s->items, max * s->size);
+        }
+
+        if (items == NULL)
+            return NULL;
+
+        s->items = items;
+        s->max = max;
     }
 
-    s->items[s->top++] = item;
+    return slot(s, s->top++);
+}
+
+bool stack_Push(stack_t *s, const void *item) {
+    void *top = stack_Reserve(s);
+
+    if (top == NULL)
+        return false;
+
+    memcpy(top, item, s->size);
+    return true;
 }
 
 void *stack_Pop(stack_t *s) {
-    if (s->top <= 0) {
-        s->top = 0;
+    if (s->top == 0)
         return NULL;
-    }
 
-    return s->items[--s->top];
+    return slot(s, --s->top);
 }
 
 void *stack_Peek(stack_t *s) {
-    if (s->top <= 0) {
-        s->top = 0;
+    if (s->top == 0)
         return NULL;
-    }
 
-    return s->items[s->top - 1];
+    return slot(s, s->top - 1);
 }
 
 void stack_Clear(stack_t *s) {
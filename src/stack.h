@@ -1,22 +1,49 @@
 #ifndef _STACK_H_
 #define _STACK_H_
 
-//the default stack size
-#define STACK_START 10
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+//Stack of fixed size items stored by value. The first STACK_SMALL bytes worth of items live
+//inside the stack itself, so a stack declared as a local only touches the heap once it gets
+//deeper than that.
+
+#ifdef __TICE__
+#define STACK_SMALL 128
+#else
+#define STACK_SMALL 512
+#endif
 
 typedef struct _Stack {
-    unsigned int _max;
-    unsigned int top;
-    void **items;
+    unsigned size; //bytes per item
+    unsigned top, max;
+    uint8_t *items; //small until it outgrows it
+    uint8_t small[STACK_SMALL];
 } stack_t;
 
-void stack_Create(stack_t *s);
+//size is the size of each item, usually sizeof the type being pushed
+void stack_Create(stack_t *s, unsigned size);
 void stack_Cleanup(stack_t *s);
 
-void stack_Push(stack_t *s, void *item);
+//copies size bytes from item. false when out of memory
+bool stack_Push(stack_t *s, const void *item);
+//room for one more item on top, for the caller to fill in. NULL when out of memory
+void *stack_Reserve(stack_t *s);
+//the popped item, which stays valid until the next push. NULL when empty
 void *stack_Pop(stack_t *s);
+//the top item, NULL when empty
 void *stack_Peek(stack_t *s);
 
 void stack_Clear(stack_t *s);
 
+#define stack_IsEmpty(s) ((s)->top == 0)
+
+//typed versions, so callers don't cast every item themselves. knowing the type they copy
+//items directly and only call out when the stack has to grow
+#define stack_CreateOf(s, type) stack_Create(s, sizeof(type))
+#define stack_PushOf(s, type, item) ((s)->top < (s)->max ? (((type*)(s)->items)[(s)->top++] = *(item), true) : stack_Push(s, item))
+#define stack_PopOf(s, type) ((s)->top > 0 ? &((type*)(s)->items)[--(s)->top] : (type*)NULL)
+#define stack_PeekOf(s, type) ((s)->top > 0 ? &((type*)(s)->items)[(s)->top - 1] : (type*)NULL)
+
 #endif
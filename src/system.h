@@ -28,4 +28,13 @@
 #define __TICE__
 #endif
 
+//per-thread state on host builds. the calculator only has one thread
+#ifdef __TICE__
+#define THREAD_LOCAL
+#elif defined(_MSC_VER)
+#define THREAD_LOCAL __declspec(thread)
+#else
+#define THREAD_LOCAL __thread
+#endif
+
 #endif
@@ -0,0 +1,380 @@
+#ifdef _WIN32
+#define _USE_MATH_DEFINES
+#endif
+
+#include "taylor.h"
+
+#include <string.h>
+#include <math.h>
+
+#include "cas.h"
+
+#define TAYLOR_SCRATCH 3
+
+#define series(t, reg) (&(t)->series[(reg) * ((t)->order + 1)])
+
+//all the series below are len coefficients long, and the result never aliases an operand
+
+void series_Mul(double *c, const double *a, const double *b, unsigned len) {
+    unsigned k, j;
+
+    for (k = 0; k < len; k++) {
+        c[k] = 0;
+        for (j = 0; j <= k; j++)
+            c[k] += a[j] * b[k - j];
+    }
+}
+
+void series_Div(double *c, const double *a, const double *b, unsigned len) {
+    unsigned k, j;
+
+    for (k = 0; k < len; k++) {
+        c[k] = a[k];
+        for (j = 1; j <= k; j++)
+            c[k] -= b[j] * c[k - j];
+        c[k] /= b[0];
+    }
+}
+
+//the rest build c up from c' written in terms of c and a', so c0 is given
+
+//c' = a'c
+void series_Exp(double *c, const double *a, double c0, unsigned len) {
+    unsigned k, j;
+
+    c[0] = c0;
+    for (k = 1; k < len; k++) {
+        c[k] = 0;
+        for (j = 1; j <= k; j++)
+            c[k] += j * a[j] * c[k - j];
+        c[k] /= k;
+    }
+}
+
+//ac' = a'
+void series_Ln(double *c, const double *a, double c0, unsigned len) {
+    unsigned k, j;
+
+    c[0] = c0;
+    for (k = 1; k < len; k++) {
+        c[k] = k * a[k];
+        for (j = 1; j < k; j++)
+            c[k] -= (k - j) * a[j] * c[k - j];
+        c[k] /= k * a[0];
+    }
+}
+
+//ac' = ra'c
+void series_Pow(double *c, const double *a, double r, double c0, unsigned len) {
+    unsigned k, j;
+
+    c[0] = c0;
+    for (k = 1; k < len; k++) {
+        c[k] = 0;
+        for (j = 1; j <= k; j++)
+            c[k] += (r * j - (double)(k - j)) * a[j] * c[k - j];
+        c[k] /= k * a[0];
+    }
+}
+
+//c' = a'q, where q is the derivative of the operator at a
+void series_Integrate(double *c, const double *a, const double *q, double c0, unsigned len) {
+    unsigned k, j;
+
+    c[0] = c0;
+    for (k = 1; k < len; k++) {
+        c[k] = 0;
+        for (j = 1; j <= k; j++)
+            c[k] += j * a[j] * q[k - j];
+        c[k] /= k;
+    }
+}
+
+//s' = a'c and c' = -a'c, or c' = a's for the hyperbolic functions
+void series_SinCos(double *s, double *c, const double *a, bool hyperbolic, unsigned len) {
+    unsigned k, j;
+
+    s[0] = hyperbolic ? sinh(a[0]) : sin(a[0]);
+    c[0] = hyperbolic ? cosh(a[0]) : cos(a[0]);
+
+    for (k = 1; k < len; k++) {
+        s[k] = c[k] = 0;
+        for (j = 1; j <= k; j++) {
+            s[k] += j * a[j] * c[k - j];
+            c[k] += j * a[j] * s[k - j];
+        }
+        s[k] /= k;
+        c[k] /= hyperbolic ? k : -(double)k;
+    }
+}
+
+//a^r for r that doesn't depend on the symbol
+void series_Power(double *c, const double *a, double r, double c0, double *scratch, unsigned len) {
+    unsigned i;
+
+    //the recurrence divides by a0, but whole powers of a series through 0 are just products
+    if (a[0] == 0 && r >= 0 && r == floor(r)) {
+        memset(c, 0, len * sizeof(double));
+        c[0] = c0;
+
+        //every coefficient below the rth is 0
+        if (r == 0 || r >= len)
+            return;
+
+        memcpy(c, a, len * sizeof(double));
+        for (i = 1; i < (unsigned)r; i++) {
+            series_Mul(scratch, c, a, len);
+            memcpy(c, scratch, len * sizeof(double));
+        }
+        return;
+    }
+
+    series_Pow(c, a, r, c0, len);
+}
+
+//whether a series has no terms past the constant
+bool series_IsConstant(const double *a, unsigned len) {
+    unsigned k;
+
+    for (k = 1; k < len; k++) {
+        if (a[k] != 0)
+            return false;
+    }
+
+    return true;
+}
+
+Error taylor_Record(ast_t *e, uint8_t symbol, unsigned order, taylor_t *t) {
+    Error error = ast_Compile(e, &t->program);
+    unsigned len = order + 1;
+    unsigned reg;
+
+    t->order = order;
+    t->symbol = program_SymbolIndex(&t->program, symbol);
+    t->series = NULL;
+
+    if (error != E_SUCCESS)
+        return error;
+
+    t->series = ast_Alloc((t->program.amount_registers + TAYLOR_SCRATCH) * len * sizeof(double));
+
+    if (t->series == NULL) {
+        program_Cleanup(&t->program);
+        return E_MEMORY;
+    }
+
+    //the constants never change. instruction results are written over each time
+    memset(t->series, 0, (t->program.amount_registers + TAYLOR_SCRATCH) * len * sizeof(double));
+    for (reg = t->program.amount_symbols; reg < t->program.amount_registers; reg++)
+        series(t, reg)[0] = t->program.registers[reg];
+
+    return E_SUCCESS;
+}
+
+void taylor_Cleanup(taylor_t *t) {
+    program_Cleanup(&t->program);
+    ast_Free(t->series);
+    t->series = NULL;
+}
+
+Error taylor_Coefficients(taylor_t *t, const double *values, double *coefficients) {
+    program_t *p = &t->program;
+    const instruction_t *i, *end = p->instructions + p->amount_instructions;
+    unsigned len = t->order + 1;
+    unsigned k;
+    double *s1 = series(t, p->amount_registers), *s2 = s1 + len, *s3 = s2 + len;
+
+    for (k = 0; k < p->amount_symbols; k++) {
+        double *x = series(t, k);
+
+        memset(x, 0, len * sizeof(double));
+        x[0] = values[k];
+        if ((int)k == t->symbol && len > 1)
+            x[1] = 1;
+    }
+
+    for (i = p->instructions; i < end; i++) {
+        const double *a = series(t, i->left), *b = series(t, i->right);
+        double *c = series(t, i->dest);
+        double value;
+
+        if (program_IsBinary(i->operator))
+            value = evaluate_binary(i->operator, a[0], b[0]);
+        else
+            value = evaluate_unary(i->operator, a[0]);
+
+        switch (i->operator) {
+        case TOK_ADD:
+            for (k = 0; k < len; k++) c[k] = a[k] + b[k];
+            break;
+        case TOK_SUBTRACT:
+            for (k = 0; k < len; k++) c[k] = a[k] - b[k];
+            break;
+        case TOK_MULTIPLY:
+            series_Mul(c, a, b, len);
+            break;
+        case TOK_DIVIDE:
+        case TOK_FRACTION:
+            series_Div(c, a, b, len);
+            break;
+        case TOK_POWER:
+            if (series_IsConstant(b, len)) {
+                series_Power(c, a, b[0], value, s1, len);
+            } else {
+                series_Ln(s1, a, log(a[0]), len);
+                series_Mul(s2, s1, b, len);
+                series_Exp(c, s2, value, len);
+            }
+            break;
+        case TOK_SCIENTIFIC:
+            for (k = 0; k < len; k++) s1[k] = b[k] * log(10);
+            series_Exp(s2, s1, pow(10, b[0]), len);
+            series_Mul(c, a, s2, len);
+            break;
+        case TOK_ROOT:
+            //a is the index, so this is b^(1/a)
+            if (series_IsConstant(a, len)) {
+                series_Power(c, b, 1 / a[0], value, s1, len);
+            } else {
+                series_Ln(s1, b, log(b[0]), len);
+                series_Div(s2, s1, a, len);
+                series_Exp(c, s2, value, len);
+            }
+            break;
+        case TOK_LOG_BASE:
+            series_Ln(s1, a, log(a[0]), len);
+            series_Ln(s2, b, log(b[0]), len);
+            series_Div(c, s1, s2, len);
+            break;
+
+        case TOK_NEGATE:
+            for (k = 0; k < len; k++) c[k] = -a[k];
+            break;
+        case TOK_RECRIPROCAL:
+            memset(s1, 0, len * sizeof(double));
+            s1[0] = 1;
+            series_Div(c, s1, a, len);
+            break;
+        case TOK_SQUARE:
+            series_Mul(c, a, a, len);
+            break;
+        case TOK_CUBE:
+            series_Mul(s1, a, a, len);
+            series_Mul(c, s1, a, len);
+            break;
+
+        case TOK_INT:
+            //int has no derivative where it depends on the symbol
+            if (!series_IsConstant(a, len))
+                return E_DERIV_NOT_ALLOWED;
+            memset(c, 0, len * sizeof(double));
+            break;
+        case TOK_ABS:
+            for (k = 0; k < len; k++) c[k] = a[0] / fabs(a[0]) * a[k];
+            break;
+
+        case TOK_SQRT:
+            series_Power(c, a, 0.5, value, s1, len);
+            break;
+        case TOK_CUBED_ROOT:
+            series_Power(c, a, 1.0 / 3, value, s1, len);
+            break;
+
+        case TOK_LN:
+            series_Ln(c, a, value, len);
+            break;
+        case TOK_LOG:
+            series_Ln(c, a, value, len);
+            for (k = 1; k < len; k++) c[k] /= log(10);
+            break;
+        case TOK_E_TO_POWER:
+            series_Exp(c, a, value, len);
+            break;
+        case TOK_10_TO_POWER:
+            for (k = 0; k < len; k++) s1[k] = a[k] * log(10);
+            series_Exp(c, s1, value, len);
+            break;
+
+        case TOK_SIN:
+            series_SinCos(c, s1, a, false, len);
+            break;
+        case TOK_COS:
+            series_SinCos(s1, c, a, false, len);
+            break;
+        case TOK_TAN:
+            series_SinCos(s1, s2, a, false, len);
+            series_Div(c, s1, s2, len);
+            break;
+        case TOK_SINH:
+            series_SinCos(c, s1, a, true, len);
+            break;
+        case TOK_COSH:
+            series_SinCos(s1, c, a, true, len);
+            break;
+        case TOK_TANH:
+            series_SinCos(s1, s2, a, true, len);
+            series_Div(c, s1, s2, len);
+            break;
+
+        //the inverse functions integrate their derivative, in s3
+        case TOK_SIN_INV:
+        case TOK_COS_INV:
+        case TOK_SINH_INV:
+        case TOK_COSH_INV:
+            //1 / sqrt(1 - a^2), 1 / sqrt(a^2 + 1) or 1 / sqrt(a^2 - 1)
+            series_Mul(s1, a, a, len);
+            if (i->operator == TOK_SIN_INV || i->operator == TOK_COS_INV) {
+                for (k = 0; k < len; k++) s1[k] = -s1[k];
+                s1[0] += 1;
+            } else {
+                s1[0] += i->operator == TOK_SINH_INV ? 1 : -1;
+            }
+            series_Power(s3, s1, -0.5, 1 / sqrt(s1[0]), s2, len);
+
+            if (i->operator == TOK_COS_INV) {
+                for (k = 0; k < len; k++) s3[k] = -s3[k];
+            }
+
+            series_Integrate(c, a, s3, value, len);
+            break;
+        case TOK_TAN_INV:
+        case TOK_TANH_INV:
+            //1 / (1 + a^2) or 1 / (1 - a^2)
+            series_Mul(s1, a, a, len);
+            if (i->operator == TOK_TANH_INV) {
+                for (k = 0; k < len; k++) s1[k] = -s1[k];
+            }
+            s1[0] += 1;
+
+            memset(s2, 0, len * sizeof(double));
+            s2[0] = 1;
+            series_Div(s3, s2, s1, len);
+
+            series_Integrate(c, a, s3, value, len);
+            break;
+
+        default:
+            return E_DERIV_UNIMPLEMENTED;
+        }
+
+        //the constant term is always exactly what evaluate() gives
+        c[0] = value;
+    }
+
+    memcpy(coefficients, series(t, p->result), len * sizeof(double));
+
+    return E_SUCCESS;
+}
+
+Error taylor_Derivatives(taylor_t *t, const double *values, double *derivatives) {
+    Error error = taylor_Coefficients(t, values, derivatives);
+    double factorial = 1;
+    unsigned k;
+
+    for (k = 1; k <= t->order; k++) {
+        factorial *= k;
+        derivatives[k] *= factorial;
+    }
+
+    return error;
+}
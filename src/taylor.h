@@ -0,0 +1,32 @@
+#ifndef _TAYLOR_H_
+#define _TAYLOR_H_
+
+#include "ast.h"
+#include "program.h"
+
+//Taylor mode automatic differentiation. Every register of the compiled program holds a
+//truncated power series in one symbol instead of a number, so the first n derivatives come
+//out of a single run without ever building a derivative tree. Each instruction costs about n^2.
+
+typedef struct _Taylor {
+    program_t program;
+    unsigned order;
+
+    //where symbol is in the program's symbols, or -1 if the expression doesn't use it
+    int symbol;
+
+    //order + 1 coefficients per register, then a few series of scratch space
+    double *series;
+} taylor_t;
+
+//the series are taken around the value of symbol. values are indexed like program_Evaluate
+Error taylor_Record(ast_t *e, uint8_t symbol, unsigned order, taylor_t *t);
+void taylor_Cleanup(taylor_t *t);
+
+//coefficients[k] = f^(k)(x) / k! for k up to t->order. E_DERIV_NOT_ALLOWED where the result
+//depends on int()
+Error taylor_Coefficients(taylor_t *t, const double *values, double *coefficients);
+//derivatives[k] = f^(k)(x)
+Error taylor_Derivatives(taylor_t *t, const double *values, double *derivatives);
+
+#endif